@@ -0,0 +1,96 @@
+// Counts calls to operator new in the process it is preloaded into.
+//
+//   LD_PRELOAD=liballoc_counter.so ALLOC_COUNTER_FILE=<file> webserver ...
+//
+// The count is kept in the first 8 bytes of the file, mapped shared, so
+// alloc_per_request.py reads it while the server runs. Deletes are left to
+// the standard library, which frees what malloc() and aligned_alloc()
+// return.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+// Null until the file is mapped, allocations before that are not counted
+std::atomic<std::uint64_t>* counter = nullptr;
+
+__attribute__((constructor)) void mapCounter() {
+    const char* path = std::getenv("ALLOC_COUNTER_FILE");
+    if (!path) {
+        return;
+    }
+    int fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return;
+    }
+    void* data = MAP_FAILED;
+    if (::ftruncate(fd, sizeof(std::uint64_t)) == 0) {
+        data = ::mmap(nullptr, sizeof(std::uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (data != MAP_FAILED) {
+        counter = static_cast<std::atomic<std::uint64_t>*>(data);
+    }
+}
+
+void* allocate(std::size_t size) noexcept {
+    if (counter) {
+        counter->fetch_add(1, std::memory_order_relaxed);
+    }
+    return std::malloc(size ? size : 1);
+}
+
+void* allocate(std::size_t size, std::align_val_t alignment) noexcept {
+    if (counter) {
+        counter->fetch_add(1, std::memory_order_relaxed);
+    }
+    // aligned_alloc wants a multiple of the alignment
+    auto const align = static_cast<std::size_t>(alignment);
+    return std::aligned_alloc(align, size ? (size + align - 1) / align * align : align);
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    if (void* p = allocate(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* p = allocate(size, alignment)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, alignment);
+}
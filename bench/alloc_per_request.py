@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Heap allocations per keep-alive request, counted with operator new.
+
+Starts the server with alloc_counter preloaded and one plugin, in shared
+and in per-core mode. After a warm-up, sends the requests one after the
+other on a single keep-alive connection, and divides the operator new
+calls the server made in that time by the number of requests. The count
+covers every thread of the server, the plugin included.
+
+    alloc_per_request.py <webserver> <alloc_counter.so> <plugin.so>:<target>... [--requests N]
+"""
+
+import argparse
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+from reload_latency import Client, free_port
+
+
+def count(path):
+    with open(path, "rb") as f:
+        return struct.unpack("<Q", f.read(8))[0]
+
+
+def measure(server, counter, plugin, target, mode, requests, warmup=200):
+    """operator new calls per request"""
+    work = tempfile.mkdtemp(prefix="alloc_per_request.")
+    try:
+        plugins = os.path.join(work, "endpoints")
+        os.makedirs(plugins)
+        shutil.copy(plugin, os.path.join(plugins, os.path.basename(plugin)))
+        counts = os.path.join(work, "count")
+
+        environment = dict(os.environ, LD_PRELOAD=counter, ALLOC_COUNTER_FILE=counts)
+        port = free_port()
+        process = subprocess.Popen([server, "127.0.0.1", str(port), "1", "--mode=" + mode,
+                                    "--plugins=" + plugins],
+                                   cwd=work, env=environment, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        try:
+            deadline = time.monotonic() + 10
+            while True:
+                try:
+                    client = Client(port)
+                    if client.get(target)[0] == 200:
+                        break
+                except OSError:
+                    pass
+                if time.monotonic() > deadline or process.poll() is not None:
+                    sys.exit(f"{target} was not served in {mode} mode")
+                time.sleep(0.05)
+
+            for _ in range(warmup):
+                client.get(target)
+            # Let the log thread write out what the warm-up logged
+            time.sleep(0.2)
+            before = count(counts)
+            for _ in range(requests):
+                client.get(target)
+            return (count(counts) - before) / requests
+        finally:
+            process.terminate()
+            process.wait()
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("server")
+    parser.add_argument("counter")
+    parser.add_argument("plugins", nargs="+", metavar="plugin.so:target")
+    parser.add_argument("--requests", type=int, default=1000)
+    args = parser.parse_args()
+
+    server = os.path.abspath(args.server)
+    counter = os.path.abspath(args.counter)
+    print(f"{'plugin':40} {'target':16} {'mode':9} {'allocs/request':>14}")
+    for spec in args.plugins:
+        plugin, _, target = spec.rpartition(":")
+        for mode in ("shared", "per-core"):
+            allocations = measure(server, counter, plugin, target, mode, args.requests)
+            print(f"{os.path.basename(plugin):40} {target:16} {mode:9} {allocations:14.2f}", flush=True)
+
+
+if __name__ == "__main__":
+    main()
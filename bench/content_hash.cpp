@@ -0,0 +1,155 @@
+// Throughput of the plugin file fingerprint against what it replaced.
+//
+// Hashes one file of the given size, warm in the page cache, with
+// core::fileContentHash, with the ifstream + byte-wise FNV-1a that
+// FileMonitor used before, and with SHA-256 for reference. The in-memory
+// row is core::contentHash over a buffer, without reading a file.
+//
+//   content_hash [megabytes] [file]
+//
+// Without a file, one of random bytes is written to the temporary
+// directory and removed afterwards. The bench then checks that the file's
+// hash matches the in-memory one, and hashes a copy while another thread
+// keeps truncating and rewriting it, which must not crash.
+
+#include "core/ContentHash.hpp"
+#include <openssl/evp.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// As FileMonitor::calculateFileHash did it
+std::uint64_t streamFnv(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    file.seekg(0, std::ios::end);
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<char> buffer(size);
+    file.read(buffer.data(), size);
+
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (char c : buffer) {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::uint64_t sha256(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> chunk(1 << 20);
+    EVP_MD_CTX* context = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(context, EVP_sha256(), nullptr);
+    while (file.read(chunk.data(), chunk.size()) || file.gcount() > 0) {
+        EVP_DigestUpdate(context, chunk.data(), static_cast<std::size_t>(file.gcount()));
+    }
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(context, digest, &length);
+    EVP_MD_CTX_free(context);
+
+    std::uint64_t prefix = 0;
+    for (int i = 0; i < 8; ++i) {
+        prefix = prefix << 8 | digest[i];
+    }
+    return prefix;
+}
+
+// Best of 5 runs in milliseconds. The result is kept so the work is not
+// optimized away.
+template <class Hash>
+double measure(Hash&& hash, std::uint64_t& result) {
+    double best = 0;
+    for (int run = 0; run < 5; ++run) {
+        auto const start = Clock::now();
+        result ^= hash();
+        double const ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        best = (run == 0) ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+// Hashes of a file taken while another thread truncates and rewrites it
+std::size_t hashWhileTruncated(const std::vector<unsigned char>& data, const std::filesystem::path& path) {
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), data.size());
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        while (!done.load()) {
+            std::filesystem::resize_file(path, data.size() / 3);
+            std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), data.size());
+        }
+    });
+
+    std::size_t hashes = 0;
+    auto const deadline = Clock::now() + std::chrono::seconds(1);
+    while (Clock::now() < deadline) {
+        hashes += core::fileContentHash(path).has_value();
+    }
+    done = true;
+    writer.join();
+    std::filesystem::remove(path);
+    return hashes;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::size_t const megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50;
+    std::filesystem::path path = argc > 2 ? argv[2] : "";
+
+    std::vector<unsigned char> data;
+    bool const temporary = path.empty();
+    if (temporary) {
+        data.resize(megabytes << 20);
+        std::mt19937_64 rng(1);
+        for (std::size_t i = 0; i + 8 <= data.size(); i += 8) {
+            auto const word = rng();
+            std::memcpy(&data[i], &word, 8);
+        }
+        path = std::filesystem::temp_directory_path() / "content_hash.bench";
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), data.size());
+    } else {
+        std::ifstream file(path, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    double const size = static_cast<double>(std::filesystem::file_size(path));
+
+    std::uint64_t result = 0;
+    streamFnv(path);  // Warms the page cache
+    std::printf("%.1f MB file\n", size / (1 << 20));
+    std::printf("%-26s %10s %10s\n", "hash", "ms", "GB/s");
+    auto const report = [size](const char* name, double ms) {
+        std::printf("%-26s %10.2f %10.2f\n", name, ms, size / ms / 1e6);
+    };
+    report("ifstream + FNV-1a", measure([&] { return streamFnv(path); }, result));
+    report("SHA-256 (OpenSSL)", measure([&] { return sha256(path); }, result));
+    report("fileContentHash", measure([&] { return core::fileContentHash(path).value_or(0); }, result));
+    report("contentHash (in memory)", measure([&] { return core::contentHash(data.data(), data.size()); }, result));
+
+    if (temporary) {
+        bool const matches = core::fileContentHash(path) == core::contentHash(data.data(), data.size());
+        std::filesystem::remove(path);
+        if (!matches) {
+            std::printf("fileContentHash does not match contentHash\n");
+            return 1;
+        }
+        auto const copy = std::filesystem::temp_directory_path() / "content_hash.truncated";
+        std::printf("%zu hashes of a file truncated while it was read\n", hashWhileTruncated(data, copy));
+    }
+    return result == 42 ? 1 : 0;
+}
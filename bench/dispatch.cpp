@@ -0,0 +1,118 @@
+// Cost of dispatching a request to a plugin handler.
+//
+// Both plugins build the same "Hello" response, one through the C++
+// EndpointPlugin classes and one through the C endpoint table. They are
+// loaded with core::DynamicLoader and called through route table entries
+// set up as the plugin manager sets them up. For comparison, the response
+// built inline without any dispatch, and the per-request cast and
+// method/path comparison that the route table replaced. The arena is
+// rewound after every request, as the server does.
+//
+//   dispatch [C++ plugin] [C plugin] [requests]
+
+#include "core/Arena.hpp"
+#include "core/DynamicLoader.hpp"
+#include "core/NativeEndpoint.hpp"
+#include "core/RouteTable.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <string>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using plugins::endpoint::EndpointPlugin;
+
+// Nanoseconds per request, best of 5 runs
+template <class Handle>
+double measure(std::size_t requests, Handle&& handle) {
+    core::Arena arena;
+    double best = 0;
+    for (int run = 0; run < 5; ++run) {
+        auto const start = Clock::now();
+        for (std::size_t i = 0; i < requests; ++i) {
+            {
+                core::Arena::Scope scope(arena);
+                auto res = handle();
+                asm volatile("" : : "r"(&res) : "memory");
+            }
+            arena.reset();
+        }
+        double const ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / requests;
+        best = (run == 0) ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string const cpp_plugin = argc > 1 ? argv[1] : CPP_PLUGIN;
+    std::string const c_plugin = argc > 2 ? argv[2] : C_PLUGIN;
+    std::size_t const requests = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 2000000;
+
+    core::DynamicLoader loader;
+    std::shared_ptr<EndpointPlugin> cpp;
+    std::shared_ptr<core::NativeEndpoints> table;
+    try {
+        cpp = std::dynamic_pointer_cast<EndpointPlugin>(loader.loadPlugin(cpp_plugin));
+        table = std::dynamic_pointer_cast<core::NativeEndpoints>(loader.loadPlugin(c_plugin));
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    if (!cpp || !table) {
+        std::fprintf(stderr, "Expected a C++ endpoint and a C endpoint table\n");
+        return 1;
+    }
+    cpp->initialize();
+    table->initialize();
+    auto native = std::static_pointer_cast<core::NativeEndpoint>(table->endpoints().front());
+
+    EndpointPlugin::Request req{http::verb::get, "/hello/42", 11};
+    req.set(http::field::host, "localhost");
+    plugins::endpoint::RouteParams params;
+    params.push("id", "42");
+
+    core::RouteTable::Route cpp_route{http::verb::get, cpp->getPath(), cpp};
+    cpp_route.handler = cpp->getRouteHandler();
+    core::RouteTable::Route c_route{http::verb::get, native->getPath(), native};
+    c_route.handler = native->getRouteHandler();
+    c_route.native = &native->route();
+
+    std::shared_ptr<core::Plugin> const plugin = cpp;
+    std::string const method = "GET";
+    std::string const path = cpp->getPath();
+
+    double const inline_ns = measure(requests, [&req] {
+        EndpointPlugin::Response res{http::status::ok, req.version()};
+        res.set(http::field::content_type, "text/plain");
+        res.keep_alive(req.keep_alive());
+        res.body() = "Hello";
+        res.prepare_payload();
+        return res;
+    });
+    double const legacy_ns = measure(requests, [&] {
+        auto endpoint = std::dynamic_pointer_cast<EndpointPlugin>(plugin);
+        if (endpoint->getMethod() != method || endpoint->getPath() != path) {
+            std::abort();
+        }
+        return endpoint->getHandler()(req);
+    });
+    double const cpp_ns = measure(requests, [&] { return core::callRoute(cpp_route, req, params); });
+    double const c_ns = measure(requests, [&] { return core::callRoute(c_route, req, params); });
+
+    std::printf("%-44s %10s %10s\n", "dispatch", "ns/request", "overhead");
+    auto const report = [inline_ns](const char* name, double ns) {
+        std::printf("%-44s %10.1f %10.1f\n", name, ns, ns - inline_ns);
+    };
+    report("response built inline, no dispatch", inline_ns);
+    report("per-request cast and method/path compare", legacy_ns);
+    report("route table, C++ plugin (std::function)", cpp_ns);
+    report("route table, C plugin (function pointer)", c_ns);
+    return 0;
+}
@@ -0,0 +1,35 @@
+// Answers GET /hello/{id:int} with "Hello", the C++ side of the dispatch
+// benchmark. hello_dispatch.c builds the same response through the C
+// interface.
+
+#include "plugins/endpoints/EndpointPlugin.hpp"
+
+namespace plugins {
+namespace endpoint {
+
+class HelloDispatch : public EndpointPlugin {
+public:
+    std::string getName() const override { return "HelloDispatch"; }
+    void initialize() override {}
+
+    std::string getPath() const override { return "/hello/{id:int}"; }
+    std::string getMethod() const override { return "GET"; }
+
+protected:
+    Handler createHandler() const override {
+        return [](const Request& req) {
+            Response res{http::status::ok, req.version()};
+            res.set(http::field::content_type, "text/plain");
+            res.keep_alive(req.keep_alive());
+            res.body() = "Hello";
+            res.prepare_payload();
+            return res;
+        };
+    }
+};
+
+} // namespace endpoint
+} // namespace plugins
+
+PLUGIN_MANIFEST("HelloDispatch", "endpoint", PLUGIN_ROUTE("GET", "/hello/{id:int}"))
+EXPORT_PLUGIN(plugins::endpoint::HelloDispatch)
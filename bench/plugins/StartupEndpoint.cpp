@@ -0,0 +1,44 @@
+// Answers GET /startup/0000 with its route. startup_time.py deploys copies
+// of the built file with the number in the route, and in the build id,
+// patched, so every copy serves a route of its own.
+
+#include "plugins/endpoints/EndpointPlugin.hpp"
+
+namespace plugins {
+namespace endpoint {
+
+// Read at runtime, so the compiler keeps the bytes the copies patch
+volatile const char ROUTE[] = "/startup/0000";
+
+class StartupEndpoint : public EndpointPlugin {
+public:
+    std::string getName() const override { return "StartupEndpoint"; }
+    void initialize() override {}
+
+    std::string getPath() const override {
+        std::string path;
+        for (std::size_t i = 0; ROUTE[i]; ++i) {
+            path += ROUTE[i];
+        }
+        return path;
+    }
+    std::string getMethod() const override { return "GET"; }
+
+protected:
+    Handler createHandler() const override {
+        return [path = getPath()](const Request& req) {
+            Response res{http::status::ok, req.version()};
+            res.set(http::field::content_type, "text/plain");
+            res.keep_alive(req.keep_alive());
+            res.body() = path;
+            res.prepare_payload();
+            return res;
+        };
+    }
+};
+
+} // namespace endpoint
+} // namespace plugins
+
+PLUGIN_MANIFEST("StartupEndpoint", "endpoint", PLUGIN_ROUTE("GET", "/startup/0000"))
+EXPORT_PLUGIN(plugins::endpoint::StartupEndpoint)
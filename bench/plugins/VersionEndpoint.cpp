@@ -0,0 +1,34 @@
+// Answers GET /version with the VERSION it was built with, so a client can
+// tell when a new build has taken over the route.
+
+#include "plugins/endpoints/EndpointPlugin.hpp"
+
+namespace plugins {
+namespace endpoint {
+
+class VersionEndpoint : public EndpointPlugin {
+public:
+    std::string getName() const override { return "VersionEndpoint"; }
+    void initialize() override {}
+
+    std::string getPath() const override { return "/version"; }
+    std::string getMethod() const override { return "GET"; }
+
+protected:
+    Handler createHandler() const override {
+        return [](const Request& req) {
+            Response res{http::status::ok, req.version()};
+            res.set(http::field::content_type, "text/plain");
+            res.keep_alive(req.keep_alive());
+            res.body() = VERSION;
+            res.prepare_payload();
+            return res;
+        };
+    }
+};
+
+} // namespace endpoint
+} // namespace plugins
+
+PLUGIN_MANIFEST("VersionEndpoint", "endpoint", PLUGIN_ROUTE("GET", "/version"))
+EXPORT_PLUGIN(plugins::endpoint::VersionEndpoint)
@@ -0,0 +1,34 @@
+/*
+ * Answers GET /hello/{id:int} with "Hello" through the C interface, the C
+ * side of the dispatch benchmark.
+ */
+
+#include "core/EndpointAbi.h"
+
+static const endpoint_host_v1* host;
+
+static int hello(void* context, const endpoint_request* req, endpoint_response* res) {
+    (void)context;
+    (void)req;
+    host->set_header(res, ENDPOINT_STRING("Content-Type"), ENDPOINT_STRING("text/plain"));
+    host->append_body(res, ENDPOINT_STRING("Hello"));
+    return 0;
+}
+
+static const endpoint_route_v1 routes[] = {
+    {.method = "GET", .path = "/hello/{id:int}", .handler = hello},
+};
+
+static const endpoint_table_v1 table = {
+    .abi_version = ENDPOINT_ABI_VERSION,
+    .name = "HelloDispatch",
+    .route_count = 1,
+    .routes = routes,
+};
+
+ENDPOINT_EXPORT const endpoint_table_v1* webserver_endpoint_table_v1(const endpoint_host_v1* h) {
+    host = h;
+    return &table;
+}
+
+ENDPOINT_MANIFEST("HelloDispatch", PLUGIN_ROUTE("GET", "/hello/{id:int}"))
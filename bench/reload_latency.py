@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""Time from a finished plugin file to the first request served by it.
+
+Starts the server on an empty plugin directory and then deploys two builds
+of the version plugin in turn, each under a new file name. A deploy either
+renames a complete copy into the directory (IN_MOVED_TO) or writes the file
+in place (IN_CLOSE_WRITE). The clock starts once the rename or close has
+returned and stops when GET /version answers with the new build.
+
+    reload_latency.py <webserver> <version_a.so> <version_b.so> [--reloads N]
+"""
+
+import argparse
+import os
+import shutil
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+class Client:
+    """Keep-alive HTTP/1.1 client for small responses"""
+
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port), timeout=5)
+        self.buffer = b""
+
+    def get(self, target):
+        self.sock.sendall(f"GET {target} HTTP/1.1\r\nHost: localhost\r\n\r\n".encode())
+        while b"\r\n\r\n" not in self.buffer:
+            self.buffer += self._recv()
+        head, self.buffer = self.buffer.split(b"\r\n\r\n", 1)
+        length = 0
+        for line in head.split(b"\r\n")[1:]:
+            name, _, value = line.partition(b":")
+            if name.strip().lower() == b"content-length":
+                length = int(value)
+        while len(self.buffer) < length:
+            self.buffer += self._recv()
+        body, self.buffer = self.buffer[:length], self.buffer[length:]
+        return int(head.split()[1]), body.decode()
+
+    def _recv(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise ConnectionError("server closed the connection")
+        return data
+
+
+def wait_for(client, version, timeout=10):
+    deadline = time.monotonic() + timeout
+    while client.get("/version") != (200, version):
+        if time.monotonic() > deadline:
+            raise TimeoutError(f"version {version} was not served within {timeout} s")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("server")
+    parser.add_argument("version_a")
+    parser.add_argument("version_b")
+    parser.add_argument("--reloads", type=int, default=20, help="deploys per method")
+    args = parser.parse_args()
+
+    work = tempfile.mkdtemp(prefix="reload_latency.")
+    plugins = os.path.join(work, "endpoints")
+    staging = os.path.join(work, "staging")
+    os.makedirs(plugins)
+    os.makedirs(staging)
+
+    port = free_port()
+    server = subprocess.Popen([os.path.abspath(args.server), "127.0.0.1", str(port), "1",
+                               "--plugins=" + plugins],
+                              cwd=work, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        deadline = time.monotonic() + 10
+        while True:
+            try:
+                client = Client(port)
+                break
+            except OSError:
+                if time.monotonic() > deadline or server.poll() is not None:
+                    sys.exit("server did not start")
+                time.sleep(0.05)
+
+        builds = {"a": open(args.version_a, "rb").read(), "b": open(args.version_b, "rb").read()}
+        previous = None
+        serial = 0
+        results = {}
+        for method in ("rename", "write"):
+            results[method] = []
+            for _ in range(args.reloads + 1):
+                serial += 1
+                version = "ab"[serial % 2]
+                name = os.path.join(plugins, f"libversion_{serial}.so")
+                if method == "rename":
+                    copy = os.path.join(staging, "next.so")
+                    with open(copy, "wb") as f:
+                        f.write(builds[version])
+                    os.rename(copy, name)
+                else:
+                    with open(name, "wb") as f:
+                        f.write(builds[version])
+                start = time.perf_counter()
+                wait_for(client, version)
+                elapsed = (time.perf_counter() - start) * 1000
+                if previous:
+                    os.unlink(previous)
+                previous = name
+                # The very first deploy also starts the plugin directory scan
+                if serial > 1:
+                    results[method].append(elapsed)
+                time.sleep(0.1)
+            results[method] = results[method][:args.reloads]
+
+        print(f"{'deploy':10} {'reloads':>8} {'min ms':>8} {'median':>8} {'p90':>8} {'max':>8}")
+        for method, times in results.items():
+            times.sort()
+            p90 = times[min(len(times) - 1, int(len(times) * 0.9))]
+            print(f"{method:10} {len(times):8} {times[0]:8.1f} {statistics.median(times):8.1f} "
+                  f"{p90:8.1f} {times[-1]:8.1f}")
+    finally:
+        server.terminate()
+        server.wait()
+        shutil.rmtree(work, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,114 @@
+// Route lookup latency for growing route tables.
+//
+// Every route table holds the same mix of literal, parameter and wildcard
+// routes. The lookups hit routes spread over the whole table, so the cost
+// per lookup should not depend on its size. For comparison, the exact
+// string match over every route that the router replaced.
+//
+//   route_lookup [lookups]
+
+#include "core/RouteTable.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using core::RouteTable;
+
+struct Table {
+    std::vector<RouteTable::Route> routes;
+    std::vector<std::string> targets;  // One request target per route
+};
+
+Table makeTable(std::size_t size) {
+    Table table;
+    for (std::size_t i = 0; table.routes.size() < size; ++i) {
+        auto const n = std::to_string(i);
+        switch (i % 4) {
+        case 0:
+            table.routes.push_back({http::verb::get, "/api/v1/items" + n});
+            table.targets.push_back("/api/v1/items" + n);
+            break;
+        case 1:
+            table.routes.push_back({http::verb::get, "/api/v1/users" + n + "/{id:int}"});
+            table.targets.push_back("/api/v1/users" + n + "/42?fields=name");
+            break;
+        case 2:
+            table.routes.push_back({http::verb::get, "/api/v1/teams" + n + "/{team}/members/{id:int}"});
+            table.targets.push_back("/api/v1/teams" + n + "/core/members/7");
+            break;
+        case 3:
+            table.routes.push_back({http::verb::get, "/assets" + n + "/{rest*}"});
+            table.targets.push_back("/assets" + n + "/css/site.css");
+            break;
+        }
+    }
+    return table;
+}
+
+// Average nanoseconds per call of lookup over the targets, best of 5 runs
+template <class Lookup>
+double measure(const std::vector<std::string>& targets, std::size_t lookups, Lookup&& lookup) {
+    std::mt19937 rng(1);
+    std::vector<std::size_t> order(lookups);
+    for (auto& index : order) {
+        index = rng() % targets.size();
+    }
+
+    double best = 0;
+    std::size_t found = 0;
+    for (int run = 0; run < 5; ++run) {
+        auto const start = Clock::now();
+        for (auto index : order) {
+            found += lookup(targets[index]);
+        }
+        double const ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / lookups;
+        best = (run == 0) ? ns : std::min(best, ns);
+    }
+    if (found != 5 * lookups) {
+        std::fprintf(stderr, "Only %zu of %zu lookups matched\n", found, 5 * lookups);
+        std::exit(1);
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::size_t const lookups = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::printf("%8s  %16s  %22s\n", "routes", "tree ns/lookup", "linear scan ns/lookup");
+    for (std::size_t size : {10, 100, 1000, 10000}) {
+        auto table = makeTable(size);
+        auto const targets = table.targets;
+
+        // Literal routes only: the old exact match could not serve the others
+        std::vector<std::string> literals;
+        std::vector<std::string> literal_targets;
+        for (const auto& route : table.routes) {
+            literals.push_back(route.path);
+            literal_targets.push_back(route.path);
+        }
+
+        const RouteTable tree(std::move(table.routes));
+        double const tree_ns = measure(targets, lookups, [&tree](const std::string& target) {
+            plugins::endpoint::RouteParams params;
+            return tree.find(http::verb::get, target, params) != nullptr;
+        });
+        double const scan_ns = measure(literal_targets, lookups / 10 + 1, [&literals](const std::string& target) {
+            for (const auto& path : literals) {
+                if (path == target) {
+                    return true;
+                }
+            }
+            return false;
+        });
+        std::printf("%8zu  %16.1f  %22.1f\n", size, tree_ns, scan_ns);
+    }
+    return 0;
+}
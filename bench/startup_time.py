@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Time from starting the server to serving every plugin, by plugin count.
+
+Deploys N copies of the startup plugin into a fresh plugin directory, each
+with its route and build id patched, so every copy is a plugin of its own,
+and starts the server on it. The clock starts when the process is spawned
+and stops when GET /startup/<N-1> answers; the server publishes all plugins
+before it accepts connections. The first start also fills the backup store,
+the later ones are restarts. The load column is the plugin loading the
+server logs for itself.
+
+    startup_time.py <webserver> <startup_endpoint.so> [--plugins 1 10 50 100] [--starts N]
+"""
+
+import argparse
+import os
+import re
+import shutil
+import statistics
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+from reload_latency import Client, free_port
+
+ROUTE = b"/startup/0000"
+BUILD_ID = struct.pack("<III", 4, 20, 3) + b"GNU\0"  # Note header of a 20 byte GNU build id
+
+
+def patched(build, serial):
+    """The build serving /startup/<serial>, with a build id of its own"""
+    route = b"/startup/%04d" % serial
+    if build.count(ROUTE) < 2:
+        sys.exit("the route of the startup plugin was not found in the build")
+    data = bytearray(build.replace(ROUTE, route))
+    note = data.find(BUILD_ID)
+    if note < 0:
+        sys.exit("the startup plugin has no GNU build id")
+    data[note + len(BUILD_ID) + 16:note + len(BUILD_ID) + 20] = struct.pack("<I", serial)
+    return bytes(data)
+
+
+def start(server, work, last, timeout=60):
+    """Milliseconds until the last plugin's route answers, and the server process"""
+    port = free_port()
+    begin = time.perf_counter()
+    process = subprocess.Popen([server, "127.0.0.1", str(port), "1", "--plugins=" + os.path.join(work, "endpoints")],
+                               cwd=work, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    deadline = time.monotonic() + timeout
+    while True:
+        try:
+            status, _ = Client(port).get(last)
+            if status == 200:
+                return (time.perf_counter() - begin) * 1000, process
+        except OSError:
+            pass
+        if time.monotonic() > deadline or process.poll() is not None:
+            process.terminate()
+            process.wait()
+            sys.exit(f"{last} was not served within {timeout} s")
+        time.sleep(0.001)
+
+
+def logged_load(work):
+    """Milliseconds the last start spent loading plugins, from its log"""
+    with open(os.path.join(work, "logs", "webserver.log")) as f:
+        times = re.findall(r"Loaded \d+ of \d+ plugins .* in ([\d.]+) ms", f.read())
+    return float(times[-1]) if times else float("nan")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("server")
+    parser.add_argument("plugin")
+    parser.add_argument("--plugins", type=int, nargs="+", default=[1, 10, 50, 100], metavar="N")
+    parser.add_argument("--starts", type=int, default=5, help="starts per plugin count, the first fills the store")
+    args = parser.parse_args()
+
+    build = open(args.plugin, "rb").read()
+    server = os.path.abspath(args.server)
+    print(f"{'plugins':>8} {'first ms':>9} {'restart ms':>11} {'load ms':>8}")
+    for count in args.plugins:
+        work = tempfile.mkdtemp(prefix="startup_time.")
+        try:
+            plugins = os.path.join(work, "endpoints")
+            os.makedirs(plugins)
+            for serial in range(count):
+                with open(os.path.join(plugins, f"libstartup_{serial:04d}.so"), "wb") as f:
+                    f.write(patched(build, serial))
+
+            ready = []
+            loads = []
+            for _ in range(args.starts):
+                elapsed, process = start(server, work, f"/startup/{count - 1:04d}")
+                process.terminate()
+                process.wait()
+                ready.append(elapsed)
+                loads.append(logged_load(work))
+            restarts = ready[1:] or ready
+            print(f"{count:8} {ready[0]:9.1f} {statistics.median(restarts):11.1f} "
+                  f"{statistics.median(loads):8.1f}", flush=True)
+        finally:
+            shutil.rmtree(work, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    main()
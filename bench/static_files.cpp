@@ -0,0 +1,197 @@
+// Static file responses written to a loopback TCP connection: from the
+// hot-file cache, with sendfile() and through read() into a buffer.
+//
+// The responses come from core::StaticFiles like in the server. A reader
+// thread drains the connection, and each response is written the way the
+// server writes it: cached bodies as shared buffers, file bodies as a
+// header followed by sendfile(). The read() path writes the same file body
+// through the serializer, which pread()s it into a buffer.
+//
+// Afterwards a cached file is replaced, and the bench fails if it is still
+// served stale through a path with empty or "." segments.
+//
+//   static_files [seconds per case]
+
+#include "core/Arena.hpp"
+#include "core/StaticFiles.hpp"
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/http/serializer.hpp>
+#include <boost/beast/http/write.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <sys/sendfile.h>
+
+namespace {
+
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+enum class Path {
+    cached,
+    sendfile,
+    read
+};
+
+void sendFile(tcp::socket& socket, core::StaticFiles::Response& res) {
+    boost::beast::http::response_serializer<plugins::endpoint::EndpointPlugin::Response::body_type,
+                                            plugins::endpoint::EndpointPlugin::Fields> serializer(res);
+    boost::beast::http::write_header(socket, serializer);
+
+    const auto& region = res.body().file();
+    auto offset = static_cast<off_t>(region.offset);
+    auto const end = static_cast<off_t>(region.offset + region.length);
+    while (offset < end) {
+        if (::sendfile(socket.native_handle(), region.file->fd(), &offset,
+                       static_cast<std::size_t>(end - offset)) <= 0) {
+            throw std::runtime_error("sendfile failed");
+        }
+    }
+}
+
+// Requests per second for one file and path
+double measure(core::StaticFiles& files, const std::string& target, Path path, double seconds) {
+    net::io_context context;
+    tcp::acceptor acceptor(context, {net::ip::make_address("127.0.0.1"), 0});
+    tcp::socket client(context);
+    client.connect(acceptor.local_endpoint());
+    tcp::socket server = acceptor.accept();
+
+    std::atomic<std::uint64_t> received{0};
+    std::thread reader([&client, &received] {
+        static char buffer[1 << 16];
+        boost::system::error_code ec;
+        while (true) {
+            auto n = client.read_some(net::buffer(buffer), ec);
+            if (ec) {
+                return;
+            }
+            received.fetch_add(n, std::memory_order_relaxed);
+        }
+    });
+
+    plugins::endpoint::EndpointPlugin::Request req{http::verb::get, target, 11};
+    core::Arena arena;
+    std::uint64_t sent = 0;
+    std::uint64_t requests = 0;
+    auto const start = Clock::now();
+    auto const deadline = start + std::chrono::duration<double>(seconds);
+    while (Clock::now() < deadline) {
+        {
+            core::Arena::Scope scope(arena);
+            auto res = files.serve(req);
+            if (!res || res->result() != http::status::ok) {
+                throw std::runtime_error("Not served: " + target);
+            }
+            if (path == Path::sendfile) {
+                sendFile(server, *res);
+            } else {
+                boost::beast::http::response_serializer<plugins::endpoint::EndpointPlugin::Response::body_type,
+                                                        plugins::endpoint::EndpointPlugin::Fields> serializer(*res);
+                boost::beast::http::write(server, serializer);
+            }
+            sent += res->body().size();
+        }
+        arena.reset();
+        ++requests;
+    }
+    // Count a request once its body has been read
+    while (received.load(std::memory_order_relaxed) < sent) {
+        std::this_thread::yield();
+    }
+    double const elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    server.shutdown(tcp::socket::shutdown_both);
+    reader.join();
+    return requests / elapsed;
+}
+
+// First byte of a served body, cached bodies are shared buffers
+char firstByte(core::StaticFiles& files, const std::string& target) {
+    plugins::endpoint::EndpointPlugin::Request req{http::verb::get, target, 11};
+    auto res = files.serve(req);
+    if (!res || res->result() != http::status::ok) {
+        throw std::runtime_error("Not served: " + target);
+    }
+    const auto& body = res->body();
+    if (body.buffersBegin() != body.buffersEnd()) {
+        return *static_cast<const char*>(body.buffersBegin()->data());
+    }
+    return body.text().empty() ? '\0' : body.text().front();
+}
+
+// Replace a cached file and check that it is served fresh through every
+// spelling of its path, the watcher only names the file by its real path
+bool servesReplacedFile(core::StaticFiles& files, const std::filesystem::path& directory) {
+    const std::string targets[] = {"/8KB", "//8KB", "/./8KB", "/.//./8KB"};
+    for (const auto& target : targets) {
+        firstByte(files, target);
+    }
+
+    std::ofstream(directory / "8KB.next") << std::string(8 << 10, 'y');
+    std::filesystem::rename(directory / "8KB.next", directory / "8KB");
+    auto const deadline = Clock::now() + std::chrono::seconds(5);
+    while (firstByte(files, targets[0]) != 'y') {
+        if (Clock::now() > deadline) {
+            std::printf("replaced file not served within 5 s\n");
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    bool fresh = true;
+    for (const auto& target : targets) {
+        if (firstByte(files, target) != 'y') {
+            std::printf("stale body served for %s\n", target.c_str());
+            fresh = false;
+        }
+    }
+    return fresh;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    double const seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+
+    auto const directory = std::filesystem::temp_directory_path() / ("static_files_bench." + std::to_string(::getpid()));
+    std::filesystem::create_directories(directory);
+    struct Size {
+        const char* name;
+        std::size_t bytes;
+    };
+    const Size sizes[] = {{"8KB", 8 << 10}, {"64KB", 64 << 10}, {"2MB", 2 << 20}};
+    for (const auto& size : sizes) {
+        std::ofstream(directory / size.name) << std::string(size.bytes, 'x');
+    }
+
+    // One instance caches what it can, the other sends every file from disk
+    core::StaticFiles cached(64 << 20, 4 << 20);
+    core::StaticFiles uncached(64 << 20, 0);
+    cached.mount("/", directory);
+    uncached.mount("/", directory);
+
+    std::printf("%-8s %14s %14s %14s\n", "size", "cached req/s", "sendfile req/s", "read() req/s");
+    for (const auto& size : sizes) {
+        std::string const target = std::string("/") + size.name;
+        std::printf("%-8s %14.0f %14.0f %14.0f\n", size.name,
+                    measure(cached, target, Path::cached, seconds),
+                    measure(uncached, target, Path::sendfile, seconds),
+                    measure(uncached, target, Path::read, seconds));
+    }
+
+    cached.start();
+    bool const fresh = servesReplacedFile(cached, directory);
+    cached.stop();
+    std::printf("replaced file under non-canonical paths: %s\n", fresh ? "fresh" : "STALE");
+
+    std::filesystem::remove_all(directory);
+    return fresh ? 0 : 1;
+}
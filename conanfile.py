@@ -16,13 +16,13 @@ class AlpineAppConan(ConanFile):
 
     def requirements(self):
         self.requires("boost/1.84.0", options={
-            "without_log": False,  # Enable log (includes log_setup)
-            "without_thread": False,  # Required for logging
-            "without_filesystem": False,  # Required for logging
-            "without_date_time": False,  # Required for logging
-            "without_regex": False,  # Required for logging
-            "without_chrono": False,  # Required for logging
-            "without_atomic": False,  # Required for logging
+            "without_log": True,  # core::Logger has its own backend
+            "without_thread": False,  # Linked by webserver_core
+            "without_filesystem": False,  # Linked by webserver_core
+            "without_date_time": False,  # Linked by webserver_core
+            "without_regex": False,  # Linked by webserver_core
+            "without_chrono": False,  # Linked by webserver_core
+            "without_atomic": False,  # Linked by webserver_core
             "shared": False,  # Force static linking
             "header_only": False,  # Ensure we build the libraries
             "error_code_header_only": False,
@@ -61,7 +61,3 @@ class AlpineAppConan(ConanFile):
         cmake = CMake(self)
         cmake.configure()
         cmake.build()
-
-    def package_info(self):
-        # Declare boost_log_setup as a system library
-        self.cpp_info.system_libs.append("boost_log_setup") 
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "Arena.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+namespace core {
+
+namespace {
+
+thread_local Arena* current_arena = nullptr;
+
+std::byte* alignUp(std::byte* ptr, std::size_t alignment) {
+    auto value = reinterpret_cast<std::uintptr_t>(ptr);
+    return reinterpret_cast<std::byte*>((value + alignment - 1) & ~(alignment - 1));
+}
+
+} // namespace
+
+Arena::~Arena() {
+    while (blocks_) {
+        auto* next = blocks_->next;
+        ::operator delete(blocks_);
+        blocks_ = next;
+    }
+}
+
+void* Arena::allocate(std::size_t bytes, std::size_t alignment) {
+    auto* ptr = alignUp(cursor_, alignment);
+    if (ptr + bytes > end_) {
+        if (!useNextBlock(bytes, alignment)) {
+            // Keep the block for later requests, it is freed with the arena
+            auto size = std::max(BLOCK_SIZE, sizeof(Block) + bytes + alignment);
+            auto* block = static_cast<Block*>(::operator new(size));
+            block->next = nullptr;
+            block->size = size;
+            if (last_) {
+                last_->next = block;
+            } else {
+                blocks_ = block;
+            }
+            last_ = block;
+            active_ = block;
+            cursor_ = reinterpret_cast<std::byte*>(block + 1);
+            end_ = reinterpret_cast<std::byte*>(block) + size;
+        }
+        ptr = alignUp(cursor_, alignment);
+    }
+    cursor_ = ptr + bytes;
+    return ptr;
+}
+
+bool Arena::useNextBlock(std::size_t bytes, std::size_t alignment) {
+    // Walk the blocks kept from earlier requests, skipping any that are too small
+    for (auto* block = active_ ? active_->next : blocks_; block; block = block->next) {
+        auto* begin = reinterpret_cast<std::byte*>(block + 1);
+        auto* end = reinterpret_cast<std::byte*>(block) + block->size;
+        active_ = block;
+        cursor_ = begin;
+        end_ = end;
+        if (alignUp(begin, alignment) + bytes <= end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Arena::reset() {
+    cursor_ = inline_;
+    end_ = inline_ + INLINE_SIZE;
+    active_ = nullptr;
+}
+
+Arena* Arena::current() {
+    return current_arena;
+}
+
+void* HandlerMemory::allocate(std::size_t bytes) {
+    if (bytes <= SLOT_SIZE) {
+        for (std::size_t i = 0; i < SLOTS; ++i) {
+            if (!used_[i].load(std::memory_order_relaxed) && !used_[i].exchange(true, std::memory_order_acquire)) {
+                return slots_[i].data;
+            }
+        }
+    }
+    return ::operator new(bytes);
+}
+
+void HandlerMemory::deallocate(void* p) noexcept {
+    auto const at = reinterpret_cast<std::uintptr_t>(p);
+    auto const begin = reinterpret_cast<std::uintptr_t>(slots_);
+    if (at >= begin && at < begin + sizeof(slots_)) {
+        used_[(at - begin) / sizeof(Slot)].store(false, std::memory_order_release);
+        return;
+    }
+    ::operator delete(p);
+}
+
+Arena::Scope::Scope(Arena& arena)
+    : previous_(current_arena) {
+    current_arena = &arena;
+}
+
+Arena::Scope::~Scope() {
+    current_arena = previous_;
+}
+
+} // namespace core
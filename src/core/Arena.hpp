@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+namespace core {
+
+// Monotonic bump allocator for per-connection data.
+// Memory comes from an inline block first and then from heap blocks. reset()
+// rewinds the arena but keeps its blocks, so a connection that serves
+// similar requests stops touching the heap after the first few of them.
+// Individual deallocations are no-ops.
+class Arena {
+public:
+    static constexpr std::size_t INLINE_SIZE = 4096;
+    static constexpr std::size_t BLOCK_SIZE = 8192;
+
+    Arena() = default;
+    ~Arena();
+
+    // Prevent copying
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(std::size_t bytes, std::size_t alignment);
+
+    // Release everything at once. Nothing allocated before may be used afterwards.
+    void reset();
+
+    // Arena picked up by default constructed ArenaAllocators on this thread
+    static Arena* current();
+
+    // Makes an arena current for the lifetime of the scope
+    class Scope {
+    public:
+        explicit Scope(Arena& arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Arena* previous_;
+    };
+
+private:
+    struct Block {
+        Block* next;
+        std::size_t size;
+    };
+
+    bool useNextBlock(std::size_t bytes, std::size_t alignment);
+
+    alignas(std::max_align_t) std::byte inline_[INLINE_SIZE];
+    std::byte* cursor_{inline_};
+    std::byte* end_{inline_ + INLINE_SIZE};
+    Block* blocks_{nullptr};  // Every heap block, in the order they are used
+    Block* last_{nullptr};    // Last heap block in the list
+    Block* active_{nullptr};  // Heap block cursor_ points into, nullptr for inline_
+};
+
+// Standard allocator backed by an Arena.
+// A default constructed allocator uses Arena::current(), or the heap when no
+// arena is current. Copies of containers always go to the heap because they
+// may outlive the arena; moves keep the arena.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    ArenaAllocator() noexcept : arena_(Arena::current()) {}
+    explicit ArenaAllocator(Arena* arena) noexcept : arena_(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+    T* allocate(std::size_t n) {
+        if (!arena_) {
+            return std::allocator<T>().allocate(n);
+        }
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        if (!arena_) {
+            std::allocator<T>().deallocate(p, n);
+        }
+    }
+
+    ArenaAllocator select_on_container_copy_construction() const noexcept {
+        return ArenaAllocator(nullptr);
+    }
+
+    Arena* arena() const noexcept { return arena_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena_ == other.arena(); }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena_ != other.arena(); }
+
+private:
+    Arena* arena_;
+};
+
+// String whose buffer comes from the current arena
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+// Recycled storage for the state of a connection's asynchronous operations.
+// Asio allocates an operation through its completion handler's associated
+// allocator and frees it before the handler runs, so a connection has only
+// a few operations alive at a time and their slots are reused for every
+// request. Larger or further operations go to the heap. An operation may be
+// freed on another thread than the one that allocated it.
+class HandlerMemory {
+public:
+    static constexpr std::size_t SLOTS = 4;
+    static constexpr std::size_t SLOT_SIZE = 1024;
+
+    HandlerMemory() = default;
+
+    // Prevent copying
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(std::size_t bytes);
+    void deallocate(void* p) noexcept;
+
+private:
+    struct alignas(std::max_align_t) Slot {
+        std::byte data[SLOT_SIZE];
+    };
+
+    Slot slots_[SLOTS];
+    std::atomic<bool> used_[SLOTS]{};
+};
+
+// Associated allocator of a connection's completion handlers. The memory
+// has to outlive every operation allocated from it.
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory* memory) noexcept : memory_(memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory()) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(memory_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        memory_->deallocate(p);
+    }
+
+    HandlerMemory* memory() const noexcept { return memory_; }
+
+    template <typename U>
+    bool operator==(const HandlerAllocator<U>& other) const noexcept { return memory_ == other.memory(); }
+
+    template <typename U>
+    bool operator!=(const HandlerAllocator<U>& other) const noexcept { return memory_ != other.memory(); }
+
+private:
+    HandlerMemory* memory_;
+};
+
+} // namespace core
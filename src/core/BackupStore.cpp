@@ -0,0 +1,392 @@
+#include "BackupStore.hpp"
+#include "Logger.hpp"
+#include "PluginManifest.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <link.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+
+namespace core {
+
+namespace {
+
+constexpr char INDEX_FILE[] = "index";
+
+std::string toHex(const unsigned char* data, std::size_t size) {
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(size * 2);
+    for (std::size_t i = 0; i < size; ++i) {
+        result.push_back(hex[data[i] >> 4]);
+        result.push_back(hex[data[i] & 0xf]);
+    }
+    return result;
+}
+
+constexpr std::size_t READ_CHUNK = 64 * 1024;
+
+// Read up to size bytes at offset, fewer only at the end of the file
+ssize_t readAt(int fd, void* buffer, std::size_t size, std::uint64_t offset) {
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::pread(fd, static_cast<char*>(buffer) + done, size - done,
+                            static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return static_cast<ssize_t>(done);
+}
+
+// Whether all of [offset, offset + size) could be read into buffer
+bool readExactly(int fd, void* buffer, std::size_t size, std::uint64_t offset) {
+    return readAt(fd, buffer, size, offset) == static_cast<ssize_t>(size);
+}
+
+// The NT_GNU_BUILD_ID note of an ELF file as hex, empty if it has none
+std::string buildId(int fd, std::uint64_t size) {
+    ElfW(Ehdr) header;
+    if (!readExactly(fd, &header, sizeof(header), 0) ||
+        std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 ||
+        header.e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+        header.e_phentsize != sizeof(ElfW(Phdr)) ||
+        header.e_phoff > size || header.e_phnum > (size - header.e_phoff) / sizeof(ElfW(Phdr))) {
+        return {};
+    }
+
+    std::vector<ElfW(Phdr)> phdrs(header.e_phnum);
+    if (!readExactly(fd, phdrs.data(), phdrs.size() * sizeof(ElfW(Phdr)), header.e_phoff)) {
+        return {};
+    }
+    for (const auto& phdr : phdrs) {
+        if (phdr.p_type != PT_NOTE || phdr.p_offset > size || phdr.p_filesz > size - phdr.p_offset) {
+            continue;
+        }
+        std::string notes(static_cast<std::size_t>(phdr.p_filesz), '\0');
+        if (!readExactly(fd, notes.data(), notes.size(), phdr.p_offset)) {
+            return {};
+        }
+        if (auto id = buildIdFromNote(notes); !id.empty()) {
+            return id;
+        }
+    }
+    return {};
+}
+
+// SHA-256 of the first size bytes of the file, empty if they cannot be read
+std::string sha256(int fd, std::uint64_t size) {
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> context(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    if (!context || EVP_DigestInit_ex(context.get(), EVP_sha256(), nullptr) != 1) {
+        return {};
+    }
+    std::vector<unsigned char> buffer(READ_CHUNK);
+    for (std::uint64_t done = 0; done < size;) {
+        auto const wanted = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), size - done));
+        if (!readExactly(fd, buffer.data(), wanted, done) ||
+            EVP_DigestUpdate(context.get(), buffer.data(), wanted) != 1) {
+            return {};
+        }
+        done += wanted;
+    }
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (EVP_DigestFinal_ex(context.get(), digest, &length) != 1) {
+        return {};
+    }
+    return toHex(digest, length);
+}
+
+} // namespace
+
+BackupStore::BackupStore(std::filesystem::path dir)
+    : dir_(std::filesystem::absolute(dir)) {
+    std::filesystem::create_directories(dir_);
+
+    std::ifstream index(dir_ / INDEX_FILE);
+    std::string line;
+    while (std::getline(index, line)) {
+        // route \t id \t deployed \t size \t modified \t file, newest first per route
+        std::istringstream fields(line);
+        std::string route, id, deployed, size, modified, file;
+        if (std::getline(fields, route, '\t') && std::getline(fields, id, '\t') &&
+            std::getline(fields, deployed, '\t') && std::getline(fields, size, '\t') &&
+            std::getline(fields, modified, '\t') && std::getline(fields, file) &&
+            std::filesystem::exists(objectPath(id))) {
+            history_[route].push_back(Version{id, file, std::atoll(deployed.c_str()),
+                                              std::strtoumax(size.c_str(), nullptr, 10),
+                                              std::atoll(modified.c_str())});
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    collect();
+}
+
+std::string BackupStore::versionId(const std::filesystem::path& path) {
+    // Read rather than mapped: the file may be a deployed plugin, or a hard
+    // link to one, truncated by a deploy while it is read. A mapping would
+    // fault, a read fails and the file is taken as unreadable.
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) {
+        return {};
+    }
+    std::string id;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        auto const size = static_cast<std::uint64_t>(st.st_size);
+        if (auto build = buildId(fd, size); !build.empty()) {
+            id = "b-" + build;
+        } else if (auto digest = sha256(fd, size); !digest.empty()) {
+            id = "s-" + digest;
+        }
+    }
+    ::close(fd);
+    return id;
+}
+
+std::string BackupStore::add(const std::string& route, const std::filesystem::path& file, const std::string& name) {
+    auto id = versionId(file);
+    if (id.empty()) {
+        LOG_ERROR << "Cannot back up " << file << ": unreadable";
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // A stored file changed through its hard link is replaced
+    if (std::filesystem::exists(objectPath(id)) && checkedPath(id).empty()) {
+        std::error_code ec;
+        std::filesystem::remove(objectPath(id), ec);
+    }
+    Version added{id, name.empty() ? file.filename().string() : name, 0};
+    auto const method = link(file, objectPath(id));
+    switch (method) {
+    case Method::failed:
+        LOG_ERROR << "Cannot back up " << file << " as " << id;
+        return {};
+    case Method::existing:
+        break;
+    case Method::reflink:
+        LOG_INFO << "Backed up " << file.filename() << " as " << id << " (reflink)";
+        break;
+    case Method::hardlink:
+        LOG_INFO << "Backed up " << file.filename() << " as " << id << " (hard link)";
+        break;
+    case Method::copy:
+        LOG_INFO << "Backed up " << file.filename() << " as " << id << " (copy)";
+        break;
+    }
+    if (!stamp(objectPath(id), added)) {
+        return {};
+    }
+
+    auto& versions = history_[route];
+    versions.erase(std::remove_if(versions.begin(), versions.end(),
+                                  [&id](const Version& version) { return version.id == id; }),
+                   versions.end());
+    added.deployed = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    versions.push_front(std::move(added));
+    while (versions.size() > VERSIONS_PER_ROUTE) {
+        versions.pop_back();
+    }
+
+    save();
+    collect();
+    return id;
+}
+
+std::vector<BackupStore::Version> BackupStore::history(const std::string& route) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = history_.find(route);
+    if (it == history_.end()) {
+        return {};
+    }
+    return std::vector<Version>(it->second.begin(), it->second.end());
+}
+
+std::map<std::string, std::vector<BackupStore::Version>> BackupStore::routes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, std::vector<Version>> routes;
+    for (const auto& [route, versions] : history_) {
+        routes.emplace(route, std::vector<Version>(versions.begin(), versions.end()));
+    }
+    return routes;
+}
+
+std::filesystem::path BackupStore::file(const std::string& id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return checkedPath(id);
+}
+
+std::filesystem::path BackupStore::checkedPath(const std::string& id) const {
+    const Version* recorded = nullptr;
+    for (const auto& [route, versions] : history_) {
+        for (const auto& version : versions) {
+            if (version.id == id) {
+                recorded = &version;
+            }
+        }
+    }
+
+    // A hard link shares the file with the deployed one, which may have been
+    // rewritten in place since
+    auto path = objectPath(id);
+    Version current;
+    if (!stamp(path, current)) {
+        return {};
+    }
+    if ((recorded && (current.size != recorded->size || current.modified_ns != recorded->modified_ns)) ||
+        versionId(path) != id) {
+        LOG_WARNING << "Stored version " << id << " was modified, it cannot be used";
+        return {};
+    }
+    return path;
+}
+
+bool BackupStore::stamp(const std::filesystem::path& path, Version& version) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    version.size = static_cast<std::uintmax_t>(st.st_size);
+    version.modified_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool BackupStore::restore(const std::string& id, const std::filesystem::path& path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const stored = checkedPath(id);
+    if (stored.empty()) {
+        return false;
+    }
+    auto const method = link(stored, path);
+    return method != Method::failed && method != Method::existing;
+}
+
+bool BackupStore::contains(const std::filesystem::path& path) const {
+    return std::filesystem::absolute(path).parent_path() == dir_;
+}
+
+std::filesystem::path BackupStore::objectPath(const std::string& id) const {
+    return dir_ / (id + ".so");
+}
+
+BackupStore::Method BackupStore::link(const std::filesystem::path& from, const std::filesystem::path& to) {
+    std::error_code ec;
+    if (std::filesystem::exists(to, ec)) {
+        return Method::existing;
+    }
+
+    // A reflink shares the blocks until either file is written, so the
+    // stored version survives a deployment that rewrites the original
+    auto tmp = to;
+    tmp += ".tmp";
+    ::unlink(tmp.c_str());
+    Method method = Method::failed;
+    int src = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src >= 0) {
+        int dst = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0444);
+        if (dst >= 0) {
+            if (::ioctl(dst, FICLONE, src) == 0) {
+                method = Method::reflink;
+            }
+            ::close(dst);
+        }
+        ::close(src);
+    }
+
+    // Hard links share the file itself, BackupStore::file() checks it still
+    // holds the version before it is used
+    if (method == Method::failed) {
+        ::unlink(tmp.c_str());
+        if (::link(from.c_str(), to.c_str()) == 0) {
+            return Method::hardlink;
+        }
+        if (errno == EEXIST) {
+            return Method::existing;
+        }
+        if (std::filesystem::copy_file(from, tmp, ec)) {
+            method = Method::copy;
+        }
+    }
+    if (method == Method::failed) {
+        return method;
+    }
+
+    // Keep the modification time, newer versions are told apart by it
+    auto modified = std::filesystem::last_write_time(from, ec);
+    if (!ec) {
+        std::filesystem::last_write_time(tmp, modified, ec);
+    }
+    // link() does not replace an existing file, unlike rename()
+    if (::link(tmp.c_str(), to.c_str()) != 0) {
+        method = errno == EEXIST ? Method::existing : Method::failed;
+    }
+    ::unlink(tmp.c_str());
+    return method;
+}
+
+void BackupStore::save() const {
+    auto tmp = dir_ / INDEX_FILE;
+    tmp += ".tmp";
+    {
+        std::ofstream index(tmp, std::ios::trunc);
+        for (const auto& [route, versions] : history_) {
+            for (const auto& version : versions) {
+                index << route << '\t' << version.id << '\t' << version.deployed << '\t' << version.size
+                      << '\t' << version.modified_ns << '\t' << version.file << '\n';
+            }
+        }
+        if (!index) {
+            LOG_ERROR << "Cannot write backup index " << tmp;
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, dir_ / INDEX_FILE, ec);
+    if (ec) {
+        LOG_ERROR << "Cannot write backup index: " << ec.message();
+    }
+}
+
+void BackupStore::collect() const {
+    std::set<std::string> kept;
+    for (const auto& [route, versions] : history_) {
+        for (const auto& version : versions) {
+            kept.insert(version.id);
+        }
+    }
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+        auto const& path = entry.path();
+        if (path.extension() == ".so" && !kept.count(path.stem().string())) {
+            std::filesystem::remove(path, ec);
+            LOG_INFO << "Removed old backup: " << path.filename();
+        }
+    }
+}
+
+} // namespace core
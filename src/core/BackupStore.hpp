@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace core {
+
+// Retained versions of the plugins, stored by content in a directory of
+// their own. A version is named by the ELF build id the linker put in the
+// library, or by the SHA-256 of the file when it has none, so deploying the
+// same build twice keeps one file. Files enter the store as reflinks where
+// the filesystem supports them and as hard links otherwise, and are only
+// copied as a last resort. Stored files are never written to again and can
+// be loaded in place, which makes a rollback a plain load and route swap.
+//
+// Every route keeps a history of its last VERSIONS_PER_ROUTE deployments,
+// saved in an index next to the files. Files no history refers to are
+// removed. Safe to use from any thread.
+class BackupStore {
+public:
+    static constexpr std::size_t VERSIONS_PER_ROUTE = 3;
+
+    struct Version {
+        std::string id;        // "b-<build id>" or "s-<sha256>"
+        std::string file;      // Name it was deployed as, given by the caller
+        std::int64_t deployed; // Seconds since the epoch
+
+        // Of the stored file when it was added. A hard linked file rewritten
+        // in place no longer matches, even if its build id does.
+        std::uintmax_t size{0};
+        std::int64_t modified_ns{0};
+    };
+
+    // Opens the store in dir, creating it if needed, and reads its index
+    explicit BackupStore(std::filesystem::path dir);
+
+    // Prevent copying
+    BackupStore(const BackupStore&) = delete;
+    BackupStore& operator=(const BackupStore&) = delete;
+
+    // Keep file as the newest version of route ("METHOD path"), deployed as
+    // name or under its own name. Returns its id, or an empty string if it
+    // could not be stored.
+    std::string add(const std::string& route, const std::filesystem::path& file, const std::string& name = {});
+
+    // Versions of a route, newest first
+    std::vector<Version> history(const std::string& route) const;
+
+    // Every route with its versions, newest first
+    std::map<std::string, std::vector<Version>> routes() const;
+
+    // The stored file of a version, checked to still match its id. Empty if
+    // the version is gone or its file was changed through a hard link.
+    std::filesystem::path file(const std::string& id) const;
+
+    // Make the stored version available under path again, the way it was
+    // stored. Returns false if path exists or the version is gone.
+    bool restore(const std::string& id, const std::filesystem::path& path) const;
+
+    // Whether path is a file inside the store
+    bool contains(const std::filesystem::path& path) const;
+
+    const std::filesystem::path& directory() const { return dir_; }
+
+    // Id of a plugin file, empty if it cannot be read
+    static std::string versionId(const std::filesystem::path& path);
+
+private:
+    // How a file entered the store, for the log
+    enum class Method { existing, reflink, hardlink, copy, failed };
+
+    std::filesystem::path objectPath(const std::string& id) const;
+    std::filesystem::path checkedPath(const std::string& id) const;  // mutex_ must be held
+    static bool stamp(const std::filesystem::path& path, Version& version);
+    static Method link(const std::filesystem::path& from, const std::filesystem::path& to);
+    void save() const;     // mutex_ must be held
+    void collect() const;  // mutex_ must be held
+
+    std::filesystem::path dir_;
+    mutable std::mutex mutex_;
+    std::map<std::string, std::deque<Version>> history_;  // route -> versions, newest first
+};
+
+} // namespace core
@@ -0,0 +1,175 @@
+#include "ContentHash.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace core {
+
+namespace {
+
+// Same structure as XXH3's long input loop: every lane multiplies the low
+// and high halves of its input word mixed with a key, and also adds the
+// plain word to its neighbour, so no input bit is lost to the multiply.
+// The lanes are scrambled after every block to spread their bits.
+constexpr std::size_t LANES = 8;
+constexpr std::size_t STRIPE = LANES * sizeof(std::uint64_t);
+constexpr std::size_t STRIPES_PER_BLOCK = 16;
+constexpr std::size_t BLOCK = STRIPE * STRIPES_PER_BLOCK;
+constexpr std::size_t READ_CHUNK = 128 * BLOCK;  // Read from a file at a time
+
+constexpr std::uint64_t PRIME32_1 = 0x9E3779B1U;
+constexpr std::uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+
+constexpr std::uint64_t KEYS[LANES + STRIPES_PER_BLOCK] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+    0xcb00c391bb52283cULL, 0xa32e531b8b65d088ULL, 0x4ef90da297486471ULL, 0xd8acdea946ef1938ULL,
+    0x3f349ce33f76faa8ULL, 0x1d4f0bc7c7bbdcf9ULL, 0x3159b4cd4be0518aULL, 0x647378d9c97e9fc8ULL,
+    0xc3ebd33483acc5eaULL, 0xeb6313faffa081c5ULL, 0x49daf0b751dd0d17ULL, 0x9e68d429265516d3ULL,
+    0xfca1477d58be162bULL, 0xce31d07ad1b8f88fULL, 0x280416958f3acb45ULL, 0x7e404bbbcafbd7afULL,
+};
+
+constexpr std::uint64_t SEEDS[LANES] = {PRIME32_1, PRIME64_1, PRIME64_2, PRIME64_3,
+                                        PRIME64_1 ^ PRIME64_2, PRIME64_2 ^ PRIME64_3, PRIME64_3 ^ PRIME32_1,
+                                        PRIME64_1 + 1};
+
+inline std::uint64_t load64(const unsigned char* p) {
+    std::uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline std::uint64_t avalanche(std::uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    return h ^ (h >> 32);
+}
+
+inline std::uint64_t mix(std::uint64_t a, std::uint64_t b) {
+    auto const product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+}
+
+// The hot loop, built once per instruction set and chosen when the program
+// is loaded
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+__attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+void accumulateBlocks(std::uint64_t* __restrict acc, const unsigned char* __restrict data, std::size_t blocks) {
+    for (std::size_t b = 0; b < blocks; ++b, data += BLOCK) {
+        for (std::size_t s = 0; s < STRIPES_PER_BLOCK; ++s) {
+            const unsigned char* stripe = data + s * STRIPE;
+            for (std::size_t i = 0; i < LANES; ++i) {
+                std::uint64_t const word = load64(stripe + i * 8);
+                std::uint64_t const keyed = word ^ KEYS[i + s];
+                acc[i ^ 1] += word;
+                acc[i] += (keyed & 0xffffffffULL) * (keyed >> 32);
+            }
+        }
+        for (std::size_t i = 0; i < LANES; ++i) {
+            std::uint64_t a = acc[i];
+            a ^= a >> 47;
+            a ^= KEYS[i];
+            acc[i] = a * PRIME32_1;
+        }
+    }
+}
+
+// Whatever is left of the last block, a word at a time, then the tail and
+// the length of the whole input
+std::uint64_t finish(std::uint64_t* acc, const unsigned char* p, std::size_t rest, std::uint64_t size) {
+    for (std::size_t i = 0; rest >= 8; ++i, p += 8, rest -= 8) {
+        acc[i % LANES] = mix(acc[i % LANES] ^ load64(p), PRIME64_2 + i);
+    }
+    std::uint64_t tail = 0;
+    if (rest > 0) {
+        std::memcpy(&tail, p, rest);
+    }
+    acc[0] = mix(acc[0] ^ tail, PRIME64_3 + rest);
+
+    std::uint64_t h = size * PRIME64_1;
+    for (std::size_t i = 0; i < LANES; i += 2) {
+        h += mix(acc[i] ^ KEYS[LANES + i], acc[i + 1] ^ KEYS[LANES + i + 1]);
+    }
+    return avalanche(h);
+}
+
+// Read up to size bytes at offset, fewer only at the end of the file
+ssize_t readAt(int fd, unsigned char* buffer, std::size_t size, off_t offset) {
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::pread(fd, buffer + done, size - done, offset + static_cast<off_t>(done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return static_cast<ssize_t>(done);
+}
+
+} // namespace
+
+std::uint64_t contentHash(const void* data, std::size_t size) {
+    auto const* p = static_cast<const unsigned char*>(data);
+    std::uint64_t acc[LANES];
+    std::copy(std::begin(SEEDS), std::end(SEEDS), acc);
+
+    auto const blocks = size / BLOCK;
+    accumulateBlocks(acc, p, blocks);
+    return finish(acc, p + blocks * BLOCK, size - blocks * BLOCK, size);
+}
+
+std::optional<std::uint64_t> fileContentHash(const std::filesystem::path& path) {
+    // Non-blocking, so a FIFO does not hold up the open before it is
+    // turned away below
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    // Read rather than mapped: a file truncated while it is hashed would
+    // fault on the mapping, a read just ends early. The chunk is reused, it
+    // stays in cache while it is hashed.
+    thread_local unsigned char buffer[READ_CHUNK];
+    std::uint64_t acc[LANES];
+    std::copy(std::begin(SEEDS), std::end(SEEDS), acc);
+    auto const size = static_cast<std::uint64_t>(st.st_size);
+    std::uint64_t done = 0;
+    while (true) {
+        auto const wanted = static_cast<std::size_t>(std::min<std::uint64_t>(READ_CHUNK, size - done));
+        ssize_t n = readAt(fd, buffer, wanted, static_cast<off_t>(done));
+        if (n < 0) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        auto const got = static_cast<std::size_t>(n);
+        auto const blocks = got / BLOCK;
+        accumulateBlocks(acc, buffer, blocks);
+        done += got;
+
+        // A file that grew is hashed up to its size when it was opened,
+        // the write that grew it reports another change
+        if (got < wanted || done == size) {
+            ::close(fd);
+            return finish(acc, buffer + blocks * BLOCK, got - blocks * BLOCK, done);
+        }
+    }
+}
+
+} // namespace core
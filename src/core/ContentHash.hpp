@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+namespace core {
+
+// 64-bit fingerprint of file contents, to tell whether a file changed. Not
+// a cryptographic hash: use SHA-256 where contents may be forged. Reads
+// 64 bytes per step in eight independent lanes, which the compiler turns
+// into SIMD code, and picks the widest instructions the CPU has at runtime.
+std::uint64_t contentHash(const void* data, std::size_t size);
+
+// Fingerprint of a file, the same as contentHash over its contents. Read
+// in chunks with pread(), so a file truncated while it is hashed is hashed
+// as far as it could be read. Returns nullopt if the file cannot be read
+// or is not a regular file.
+std::optional<std::uint64_t> fileContentHash(const std::filesystem::path& path);
+
+} // namespace core
@@ -1,69 +1,240 @@
 #include "DynamicLoader.hpp"
+#include "Logger.hpp"
+#include "NativeEndpoint.hpp"
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
-#include <iostream>
 #include <filesystem>
+#include <set>
+#include <mutex>
 #include <thread>
+#include <utility>
 #include <chrono>
 
 namespace core {
 
-DynamicLoader::~DynamicLoader() {
-    for (const auto& [name, info] : loadedPlugins) {
-        if (info.handle) {
-            std::cout << "Closing plugin: " << name << std::endl;
-            if (info.plugin) {
-                info.plugin->cleanup();
+namespace {
+
+struct PrefaultContext {
+    const char* name;
+    std::size_t bytes;
+};
+
+int prefaultSegments(dl_phdr_info* info, std::size_t, void* data) {
+    auto* context = static_cast<PrefaultContext*>(data);
+    if (!info->dlpi_name || std::strcmp(info->dlpi_name, context->name) != 0) {
+        return 0;
+    }
+
+    auto const page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+        const auto& phdr = info->dlpi_phdr[i];
+        // Writable segments are private copies, faulted in as they are written
+        if (phdr.p_type != PT_LOAD || (phdr.p_flags & PF_W)) {
+            continue;
+        }
+        auto begin = (info->dlpi_addr + phdr.p_vaddr) & ~(page - 1);
+        auto end = (info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz + page - 1) & ~(page - 1);
+#ifdef MADV_POPULATE_READ
+        if (madvise(reinterpret_cast<void*>(begin), end - begin, MADV_POPULATE_READ) != 0)
+#endif
+        {
+            // Kernels before 5.14, touch every page
+            for (auto at = begin; at < end; at += page) {
+                (void)*reinterpret_cast<const volatile char*>(at);
             }
-            dlclose(info.handle);
         }
+        context->bytes += end - begin;
+    }
+    return 1;
+}
+
+// Whether a loaded object has the given name
+int findLoaded(dl_phdr_info* info, std::size_t, void* data) {
+    auto* name = static_cast<const char*>(data);
+    return info->dlpi_name && std::strcmp(info->dlpi_name, name) == 0 ? 1 : 0;
+}
+
+std::runtime_error systemError(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// A library is opened under a name no other loaded library has,
+// /proc/self/fd/<fd> of a descriptor held while it is loaded. dlopen() hands
+// back an already loaded library with the same name, so opening a new file
+// by its path would return the old version when it replaced a plugin under
+// the same name. A file renamed in has an inode of its own and is loaded in
+// place. dlopen() also matches the inode, so only a file rewritten in place
+// while its old contents are still loaded is loaded from a private copy.
+struct Image {
+    int fd;
+    std::string name;
+    dev_t device;  // Of a file loaded in place, registered in InPlaceFiles
+    ino_t inode;
+    bool inPlace;
+};
+
+} // namespace
+
+// Files whose library is loaded in place, by identity. Shared with the
+// plugins' deleters, which may run after the loader is gone.
+class InPlaceFiles {
+public:
+    // Register the file, false if a library is loaded from it already
+    bool add(dev_t device, ino_t inode) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return files_.emplace(device, inode).second;
+    }
+
+    void remove(dev_t device, ino_t inode) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        files_.erase({device, inode});
+    }
+
+private:
+    std::mutex mutex_;
+    std::set<std::pair<dev_t, ino_t>> files_;
+};
+
+namespace {
+
+Image openImage(const std::string& path, InPlaceFiles& inPlace) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        auto error = systemError("Failed to open library " + path);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw error;
+    }
+    if (inPlace.add(st.st_dev, st.st_ino)) {
+        return {fd, "/proc/self/fd/" + std::to_string(fd), st.st_dev, st.st_ino, true};
+    }
+
+    // Without a copy (memfd disabled), the file itself is loaded
+    int copy = ::memfd_create(std::filesystem::path(path).filename().c_str(), MFD_CLOEXEC);
+    off_t offset = 0;
+    while (copy >= 0 && offset < st.st_size) {
+        if (::sendfile(copy, fd, &offset, static_cast<std::size_t>(st.st_size - offset)) <= 0) {
+            ::close(copy);
+            copy = -1;
+        }
+    }
+    if (copy >= 0) {
+        ::close(fd);
+        fd = copy;
+    }
+    return {fd, "/proc/self/fd/" + std::to_string(fd), st.st_dev, st.st_ino, false};
+}
+
+// Called after dlclose(). A library that stayed loaded keeps its
+// descriptor, so its name is not given to another library, and its file
+// stays registered.
+void closeImage(const Image& image, InPlaceFiles& inPlace) {
+    if (!dl_iterate_phdr(findLoaded, const_cast<char*>(image.name.c_str()))) {
+        ::close(image.fd);
+        if (image.inPlace) {
+            inPlace.remove(image.device, image.inode);
+        }
+    }
+}
+
+} // namespace
+
+DynamicLoader::DynamicLoader()
+    : inPlace_(std::make_shared<InPlaceFiles>()) {
+}
+
+DynamicLoader::~DynamicLoader() {
+    for (const auto& [name, loaded] : loadedPlugins) {
+        LOG_INFO << "Closing plugin: " << name;
+        loaded.plugin->cleanup();
     }
 }
 
 std::shared_ptr<Plugin> DynamicLoader::loadPlugin(const std::filesystem::path& path) {
     auto abs_path = std::filesystem::absolute(path).string();
-    
-    // Check if plugin is already loaded
-    auto it = loadedPlugins.find(abs_path);
-    if (it != loadedPlugins.end()) {
-        return it->second.plugin;
+
+    struct stat st;
+    if (::stat(abs_path.c_str(), &st) != 0) {
+        throw systemError("Failed to load library " + abs_path);
+    }
+    auto const modified = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+    // Check if this version of the plugin is already loaded
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = loadedPlugins.find(abs_path);
+        if (it != loadedPlugins.end() && it->second.device == st.st_dev && it->second.inode == st.st_ino &&
+            it->second.size == st.st_size && it->second.modified == modified) {
+            return it->second.plugin;
+        }
     }
 
     // Load the shared library
-    void* handle = dlopen(abs_path.c_str(), RTLD_NOW);
+    auto image = openImage(abs_path, *inPlace_);
+    void* handle = dlopen(image.name.c_str(), RTLD_NOW);
     if (!handle) {
-        throw std::runtime_error("Failed to load library: " + std::string(dlerror()));
+        std::string error = dlerror();
+        closeImage(image, *inPlace_);
+        throw std::runtime_error("Failed to load library " + abs_path + ": " + error);
     }
-
-    // Get the create function
-    auto create = reinterpret_cast<CreatePluginFunc>(dlsym(handle, "createPlugin"));
-    if (!create) {
+    auto close = [handle, image, inPlace = inPlace_] {
         dlclose(handle);
-        throw std::runtime_error("Failed to get createPlugin function");
-    }
+        closeImage(image, *inPlace);
+    };
 
-    // Create the plugin
-    auto plugin = create();
-    if (!plugin) {
-        dlclose(handle);
+    // Create the plugin, from its C++ factory or from the C endpoint table
+    // it exports
+    std::shared_ptr<Plugin> created;
+    if (auto create = reinterpret_cast<CreatePluginFunc>(dlsym(handle, "createPlugin"))) {
+        created = create();
+    } else if (auto table = reinterpret_cast<endpoint_table_func_v1>(dlsym(handle, ENDPOINT_TABLE_SYMBOL))) {
+        try {
+            created = NativeEndpoints::create(table(&endpointHost()));
+        } catch (const std::exception&) {
+            close();
+            throw;
+        }
+    } else {
+        close();
+        throw std::runtime_error("Failed to get createPlugin or " ENDPOINT_TABLE_SYMBOL " function");
+    }
+    if (!created) {
+        close();
         throw std::runtime_error("Failed to create plugin");
     }
-    
-    // Store the plugin info
-    PluginInfo info;
-    info.handle = handle;
-    info.plugin = plugin;
-    loadedPlugins[abs_path] = std::move(info);
-    
+
+    // Destroying the plugin runs code from the library, so the library is
+    // closed only after the plugin is gone
+    std::shared_ptr<Plugin> plugin(created.get(), [created, close](Plugin*) mutable {
+        created.reset();
+        close();
+    });
+
+    // The version this replaces is released after the lock, by whoever
+    // still holds it last
+    Loaded loaded{plugin, image.name, st.st_dev, st.st_ino, st.st_size, modified};
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(loadedPlugins[abs_path], loaded);
     return plugin;
 }
 
 void DynamicLoader::unloadPlugin(const std::string& path) {
-    auto it = loadedPlugins.find(path);
-    if (it != loadedPlugins.end()) {
-        // Close the library handle
-        dlclose(it->second.handle);
-        // Remove from map
+    std::shared_ptr<Plugin> plugin;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = loadedPlugins.find(path); it != loadedPlugins.end()) {
+        // Released after the lock, closing the library runs plugin code
+        plugin = std::move(it->second.plugin);
         loadedPlugins.erase(it);
     }
 }
@@ -71,6 +242,7 @@ void DynamicLoader::unloadPlugin(const std::string& path) {
 std::shared_ptr<Plugin> DynamicLoader::getPlugin(const std::string& pluginPath) const {
     // Convert to absolute path if it's not already
     auto abs_path = std::filesystem::absolute(pluginPath).string();
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = loadedPlugins.find(abs_path);
     if (it != loadedPlugins.end()) {
         return it->second.plugin;
@@ -78,4 +250,21 @@ std::shared_ptr<Plugin> DynamicLoader::getPlugin(const std::string& pluginPath)
     return nullptr;
 }
 
+std::size_t DynamicLoader::prefault(const std::filesystem::path& libraryPath) const {
+    // The dynamic linker knows the library by the name it was opened under
+    std::string image;
+    {
+        auto abs_path = std::filesystem::absolute(libraryPath).string();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = loadedPlugins.find(abs_path);
+        if (it == loadedPlugins.end()) {
+            return 0;
+        }
+        image = it->second.image;
+    }
+    PrefaultContext context{image.c_str(), 0};
+    dl_iterate_phdr(prefaultSegments, &context);
+    return context.bytes;
+}
+
 } // namespace core
@@ -1,38 +1,60 @@
 #pragma once
 
 #include "Plugin.hpp"
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <filesystem>
+#include <sys/types.h>
 
 namespace core {
 
+class InPlaceFiles;
+
+// Safe to use from several threads, plugins are loaded concurrently at startup
 class DynamicLoader {
 public:
-    DynamicLoader() = default;
+    DynamicLoader();
     ~DynamicLoader();
 
     // Prevent copying
     DynamicLoader(const DynamicLoader&) = delete;
     DynamicLoader& operator=(const DynamicLoader&) = delete;
 
-    // Load a plugin from a shared library
+    // Load a plugin from a shared library. The returned pointer owns the
+    // library: it is closed after the last reference to the plugin is gone.
+    // Loading a path again returns the same plugin while the file is
+    // unchanged. A new file at that path is loaded next to the old version,
+    // which keeps serving until it is released.
     std::shared_ptr<Plugin> loadPlugin(const std::filesystem::path& libraryPath);
     
-    // Unload a plugin
+    // Forget a plugin. The library stays open while route tables or
+    // in-flight requests still refer to the plugin.
     void unloadPlugin(const std::string& pluginName);
     
     // Get a loaded plugin by name
     std::shared_ptr<Plugin> getPlugin(const std::string& pluginName) const;
 
+    // Fault in the code and read-only data of a loaded library, so its
+    // first requests do not stall on page faults. Returns the bytes covered.
+    std::size_t prefault(const std::filesystem::path& libraryPath) const;
+
 private:
-    struct PluginInfo {
-        void* handle;
+    struct Loaded {
         std::shared_ptr<Plugin> plugin;
+        std::string image;  // Name the library was opened under
+        dev_t device;       // Identity of the file it was loaded from
+        ino_t inode;
+        std::int64_t size;
+        std::int64_t modified;  // Nanoseconds
     };
-    
-    std::unordered_map<std::string, PluginInfo> loadedPlugins;
+
+    mutable std::mutex mutex_;  // Guards loadedPlugins, not the loading itself
+    std::unordered_map<std::string, Loaded> loadedPlugins;
+    std::shared_ptr<InPlaceFiles> inPlace_;
 };
 
 } // namespace core
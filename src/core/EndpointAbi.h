@@ -0,0 +1,139 @@
+#pragma once
+
+/*
+ * Plain C interface between the server and endpoint plugins. Unlike the C++
+ * classes in Plugin.hpp it does not depend on the compiler or standard
+ * library the server was built with, only on the C calling convention, so
+ * a plugin can be written in C or built with another C++ toolchain.
+ *
+ * A plugin exports ENDPOINT_TABLE_SYMBOL, which returns a table of its
+ * routes. The server calls it once when the library is loaded, and a
+ * request is then dispatched with a direct call through the route's
+ * handler pointer. Handlers read the request and build the response
+ * through the functions of the host table passed to the entry point.
+ *
+ *   static const endpoint_host_v1* host;
+ *
+ *   static int hello(void* context, const endpoint_request* req, endpoint_response* res) {
+ *       host->set_header(res, ENDPOINT_STRING("Content-Type"), ENDPOINT_STRING("text/plain"));
+ *       host->append_body(res, ENDPOINT_STRING("Hello"));
+ *       return 0;
+ *   }
+ *
+ *   static const endpoint_route_v1 routes[] = {
+ *       {.method = "GET", .path = "/hello", .handler = hello},
+ *   };
+ *   static const endpoint_table_v1 table = {
+ *       .abi_version = ENDPOINT_ABI_VERSION, .name = "Hello", .route_count = 1, .routes = routes,
+ *   };
+ *
+ *   ENDPOINT_EXPORT const endpoint_table_v1* webserver_endpoint_table_v1(const endpoint_host_v1* h) {
+ *       host = h;
+ *       return &table;
+ *   }
+ *
+ *   ENDPOINT_MANIFEST("Hello", PLUGIN_ROUTE("GET", "/hello"))
+ *
+ * A new version of this interface gets new structs and a new entry point
+ * symbol, a server keeps loading plugins built against the older ones.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#define ENDPOINT_EXPORT extern "C" __attribute__((visibility("default")))
+#else
+#define ENDPOINT_EXPORT __attribute__((visibility("default")))
+#endif
+
+#define ENDPOINT_ABI_VERSION 1
+#define ENDPOINT_TABLE_SYMBOL "webserver_endpoint_table_v1"
+
+/* ELF section that holds the plugin manifest */
+#define PLUGIN_MANIFEST_SECTION ".webserver_manifest"
+
+#define PLUGIN_STRINGIZE_(x) #x
+#define PLUGIN_STRINGIZE(x) PLUGIN_STRINGIZE_(x)
+
+/* One route in a manifest, several are written next to each other */
+#define PLUGIN_ROUTE(method, path) "route=" method " " path "\n"
+
+/* Manifest of a plugin that exports an endpoint table, see PLUGIN_MANIFEST */
+#define ENDPOINT_MANIFEST(name, routes) \
+    ENDPOINT_EXPORT __attribute__((used, section(PLUGIN_MANIFEST_SECTION))) \
+    const char webserverPluginManifest[] = \
+        "c_abi=" PLUGIN_STRINGIZE(ENDPOINT_ABI_VERSION) "\n" \
+        "name=" name "\n" \
+        "type=endpoint\n" \
+        routes;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes that are not necessarily null terminated. data is NULL for a
+ * missing value. */
+typedef struct endpoint_string {
+    const char* data;
+    size_t size;
+} endpoint_string;
+
+#ifdef __cplusplus
+#define ENDPOINT_STRING(literal) (endpoint_string{(literal), sizeof(literal) - 1})
+#else
+#define ENDPOINT_STRING(literal) ((endpoint_string){(literal), sizeof(literal) - 1})
+#endif
+
+/* Owned by the server, valid during the handler call */
+typedef struct endpoint_request endpoint_request;
+typedef struct endpoint_response endpoint_response;
+
+/* Functions of the server. Strings returned point into the request and stay
+ * valid until the handler returns. */
+typedef struct endpoint_host_v1 {
+    uint32_t abi_version;
+    endpoint_string (*method)(const endpoint_request* req);
+    endpoint_string (*target)(const endpoint_request* req);
+    endpoint_string (*header)(const endpoint_request* req, endpoint_string name);
+    endpoint_string (*body)(const endpoint_request* req);
+    /* Path parameter declared by the route pattern, and the query string
+     * without the leading '?' */
+    endpoint_string (*param)(const endpoint_request* req, endpoint_string name);
+    endpoint_string (*query)(const endpoint_request* req);
+
+    /* The response starts as an empty 200, the server sets its length */
+    void (*set_status)(endpoint_response* res, unsigned status);
+    void (*set_header)(endpoint_response* res, endpoint_string name, endpoint_string value);
+    void (*append_body)(endpoint_response* res, endpoint_string data);
+} endpoint_host_v1;
+
+/* Returns 0 once the response is complete, anything else answers the
+ * request with 500. Must not throw or unwind. */
+typedef int (*endpoint_handler_v1)(void* context, const endpoint_request* req, endpoint_response* res);
+
+typedef struct endpoint_route_v1 {
+    const char* method;
+    const char* path;  /* Route pattern, as EndpointPlugin::getPath() */
+    endpoint_handler_v1 handler;
+    void* context;  /* Passed to handler */
+    int blocking;  /* Run on the worker pool, as EndpointPlugin::isBlocking() */
+    uint32_t cache_ttl_ms;  /* Cache successful GET responses this long, 0 for never */
+    const char* warmup_target;  /* Request sent before the route serves, NULL for none */
+} endpoint_route_v1;
+
+typedef struct endpoint_table_v1 {
+    uint32_t abi_version;  /* ENDPOINT_ABI_VERSION */
+    const char* name;
+    size_t route_count;
+    const endpoint_route_v1* routes;
+    /* Both optional. A nonzero result of initialize rejects the plugin. */
+    int (*initialize)(void);
+    void (*cleanup)(void);
+} endpoint_table_v1;
+
+typedef const endpoint_table_v1* (*endpoint_table_func_v1)(const endpoint_host_v1* host);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,221 @@
+#include "Epoch.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace core {
+
+namespace {
+
+constexpr std::uint64_t OFFLINE = 0;
+
+// How often a pending retirement checks the readers again
+constexpr auto GRACE_POLL_INTERVAL = std::chrono::milliseconds(1);
+
+struct Record {
+    std::atomic<std::uint64_t> epoch{OFFLINE};  // Epoch seen when last quiescent
+};
+
+class Domain {
+public:
+    static Domain& instance() {
+        static Domain domain;
+        return domain;
+    }
+
+    ~Domain() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        // Whatever is still retired is left to the end of the process
+    }
+
+    std::atomic<std::uint64_t> global{1};
+
+    void add(Record* record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        readers_.push_back(record);
+    }
+
+    void remove(Record* record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        readers_.erase(std::remove(readers_.begin(), readers_.end(), record), readers_.end());
+    }
+
+    void addPin(const std::atomic<std::uint64_t>* pin) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pins_.insert(pin);
+    }
+
+    void removePin(const std::atomic<std::uint64_t>* pin) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pins_.erase(pin);
+    }
+
+    void retire(std::function<void()> destroy) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // Readers that see this epoch or a later one no longer hold a
+            // reference to the retired object
+            auto epoch = global.fetch_add(1, std::memory_order_seq_cst) + 1;
+            retired_.emplace_back(epoch, std::move(destroy));
+            if (!thread_.joinable()) {
+                thread_ = std::thread(&Domain::reclaimLoop, this);
+            }
+        }
+        cv_.notify_one();
+    }
+
+private:
+    Domain() = default;
+
+    // Oldest epoch any online reader or held pin may still use (mutex_ must
+    // be held). Pins are read after the threads: a pin is held before its
+    // thread's next quiescent state, so seeing that state makes the pin visible.
+    std::uint64_t oldestReader() const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto oldest = std::numeric_limits<std::uint64_t>::max();
+        for (const auto* record : readers_) {
+            auto epoch = record->epoch.load(std::memory_order_acquire);
+            if (epoch != OFFLINE) {
+                oldest = std::min(oldest, epoch);
+            }
+        }
+        for (const auto* pin : pins_) {
+            auto epoch = pin->load(std::memory_order_acquire);
+            if (epoch != OFFLINE) {
+                oldest = std::min(oldest, epoch);
+            }
+        }
+        return oldest;
+    }
+
+    void reclaimLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this] { return stopping_ || !retired_.empty(); });
+            if (stopping_) {
+                return;
+            }
+
+            // Retirements are queued in epoch order
+            auto oldest = oldestReader();
+            std::vector<std::function<void()>> ready;
+            while (!retired_.empty() && retired_.front().first <= oldest) {
+                ready.push_back(std::move(retired_.front().second));
+                retired_.pop_front();
+            }
+
+            if (ready.empty()) {
+                cv_.wait_for(lock, GRACE_POLL_INTERVAL);
+                continue;
+            }
+
+            lock.unlock();
+            for (auto& destroy : ready) {
+                try {
+                    destroy();
+                } catch (const std::exception& e) {
+                    LOG_ERROR << "Error destroying retired object: " << e.what();
+                }
+            }
+            ready.clear();
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Record*> readers_;
+    std::unordered_set<const std::atomic<std::uint64_t>*> pins_;
+    std::deque<std::pair<std::uint64_t, std::function<void()>>> retired_;
+    std::thread thread_;
+    bool stopping_{false};
+};
+
+thread_local Record* current = nullptr;
+
+} // namespace
+
+Epoch::Reader::Reader() {
+    current = new Record;
+    Domain::instance().add(current);
+}
+
+Epoch::Reader::~Reader() {
+    Domain::instance().remove(current);
+    delete current;
+    current = nullptr;
+}
+
+Epoch::Pin::Pin() {
+    Domain::instance().addPin(&epoch_);
+}
+
+Epoch::Pin::~Pin() {
+    Domain::instance().removePin(&epoch_);
+}
+
+void Epoch::Pin::hold() {
+    if (epoch_.load(std::memory_order_relaxed) != OFFLINE) {
+        return;
+    }
+    if (current) {
+        // The thread's own record already protects what it can reach
+        online();
+        epoch_.store(current->epoch.load(std::memory_order_relaxed), std::memory_order_release);
+    } else {
+        epoch_.store(Domain::instance().global.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void Epoch::Pin::release() {
+    epoch_.store(OFFLINE, std::memory_order_release);
+}
+
+void Epoch::quiescent() {
+    if (current) {
+        current->epoch.store(Domain::instance().global.load(std::memory_order_acquire),
+                             std::memory_order_release);
+    }
+}
+
+void Epoch::offline() {
+    if (current) {
+        current->epoch.store(OFFLINE, std::memory_order_release);
+    }
+}
+
+void Epoch::online() {
+    if (current && current->epoch.load(std::memory_order_relaxed) == OFFLINE) {
+        current->epoch.store(Domain::instance().global.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+        // Pairs with the fence in oldestReader(): either the reclaimer sees
+        // this thread online, or this thread sees what was published before
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void Epoch::retire(std::function<void()> destroy) {
+    Domain::instance().retire(std::move(destroy));
+}
+
+} // namespace core
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+namespace core {
+
+// Quiescent-state based reclamation for data the IO threads read without
+// locks or reference counts: route tables and the plugins behind them.
+//
+// Reader threads register once and announce a quiescent state between
+// handlers, when they hold no reference to shared data. A thread about to
+// block goes offline, and comes back online before it reads shared data
+// again. Objects passed to retire() are destroyed by a background thread
+// once every registered thread has been quiescent or offline since the
+// retirement, so a busy reader pays one plain store per handler.
+//
+// Work that outlives a handler, such as a request waiting for a coroutine
+// or for its response to be written, holds a Pin instead.
+//
+// Calls from threads that are not registered are no-ops.
+class Epoch {
+public:
+    // Registers the calling thread as a reader for the object's lifetime
+    class Reader {
+    public:
+        Reader();
+        ~Reader();
+
+        // Prevent copying
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+    };
+
+    // Keeps everything that was reachable when hold() was called from being
+    // reclaimed until release(), across handlers and threads. Holding and
+    // releasing are plain stores.
+    class Pin {
+    public:
+        Pin();
+        ~Pin();
+
+        // Prevent copying
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+
+        // Pin what the calling thread can reach now, no-op if already held
+        void hold();
+        void release();
+
+    private:
+        std::atomic<std::uint64_t> epoch_{0};
+    };
+
+    // The calling thread holds no reference to shared data
+    static void quiescent();
+
+    // The calling thread is about to block and holds no references
+    static void offline();
+
+    // The calling thread is about to read shared data. Cheap when the thread
+    // is already online, a full fence after it was offline.
+    static void online();
+
+    // Run destroy on the reclaimer thread after a grace period
+    static void retire(std::function<void()> destroy);
+};
+
+} // namespace core
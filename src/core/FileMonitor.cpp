@@ -1,163 +1,528 @@
 #include "FileMonitor.hpp"
-#include <fstream>
-#include <sstream>
-#include <regex>
+#include "ContentHash.hpp"
+#include "Logger.hpp"
+#include <boost/asio/post.hpp>
+#include <algorithm>
 #include <thread>
-#include <iostream>
 #include <array>
-#include <unordered_map>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
 #include <unistd.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <limits.h>
 
 namespace core {
 
-FileMonitor::FileMonitor() : running(false) {
-    // Initialize inotify
-    inotifyFd = inotify_init1(IN_NONBLOCK);
-    if (inotifyFd == -1) {
-        throw std::runtime_error("Failed to initialize inotify");
+const char* toString(FileEvent event) {
+    switch (event) {
+        case FileEvent::created: return "created";
+        case FileEvent::replaced: return "replaced";
+        case FileEvent::removed: return "removed";
     }
+    return "unknown";
 }
 
-std::string FileMonitor::calculateFileHash(const std::filesystem::path& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        return "";
+FileMonitor::Matcher::Matcher(const std::string& pattern) {
+    // Compiled in any case, so an invalid pattern is rejected the same way
+    // whether or not it would be matched as a suffix
+    regex_ = std::regex(pattern);
+    if (parseSuffixes(pattern)) {
+        kind_ = suffixes_.size() == 1 && suffixes_.front().empty() ? Kind::any : Kind::suffix;
     }
+}
+
+bool FileMonitor::Matcher::parseSuffixes(std::string_view pattern) {
+    // Reads a run of literal characters, stopping at the first operator
+    auto literal = [](std::string_view& p, std::string& out) {
+        while (!p.empty()) {
+            char const c = p.front();
+            if (c == '\\') {
+                // Escaped punctuation is literal, "\d" and the like are classes
+                if (p.size() < 2 || !std::ispunct(static_cast<unsigned char>(p[1]))) {
+                    return false;
+                }
+                out += p[1];
+                p.remove_prefix(2);
+            } else if (std::string_view(".^$|()[]{}*+?").find(c) != std::string_view::npos) {
+                return true;
+            } else {
+                out += c;
+                p.remove_prefix(1);
+            }
+        }
+        return true;
+    };
 
-    // Get file size
-    file.seekg(0, std::ios::end);
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    auto p = pattern;
+    if (!p.empty() && p.front() == '^') {
+        p.remove_prefix(1);
+    }
+    if (p.substr(0, 2) != ".*") {
+        return false;
+    }
+    p.remove_prefix(2);
 
-    // Read entire file content
-    std::vector<char> buffer(size);
-    if (!file.read(buffer.data(), size)) {
-        return "";
+    std::string stem;
+    if (!literal(p, stem)) {
+        return false;
+    }
+    std::vector<std::string> suffixes;
+    if (!p.empty() && p.front() == '(') {
+        p.remove_prefix(1);
+        if (p.substr(0, 2) == "?:") {
+            p.remove_prefix(2);
+        }
+        while (true) {
+            std::string alternative;
+            if (!literal(p, alternative) || p.empty()) {
+                return false;
+            }
+            suffixes.push_back(stem + alternative);
+            if (p.front() == ')') {
+                p.remove_prefix(1);
+                break;
+            }
+            if (p.front() != '|') {
+                return false;
+            }
+            p.remove_prefix(1);
+        }
+        if (!p.empty() && p.front() == '?') {
+            p.remove_prefix(1);
+            suffixes.push_back(stem);
+        }
+    } else {
+        suffixes.push_back(stem);
+    }
+    // regex_match matches the whole name anyway
+    if (p == "$") {
+        p.remove_prefix(1);
+    }
+    if (!p.empty()) {
+        return false;
     }
+    suffixes_ = std::move(suffixes);
+    return true;
+}
 
-    // Simple but effective hash
-    uint64_t hash = 14695981039346656037ULL; // FNV-1a hash
-    for (char c : buffer) {
-        hash ^= static_cast<uint8_t>(c);
-        hash *= 1099511628211ULL;
+bool FileMonitor::Matcher::operator()(std::string_view name) const {
+    switch (kind_) {
+        case Kind::any:
+            // "." does not match line terminators
+            return name.find_first_of("\n\r") == std::string_view::npos;
+        case Kind::suffix:
+            for (const auto& suffix : suffixes_) {
+                if (name.size() >= suffix.size() &&
+                    name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                    return name.substr(0, name.size() - suffix.size()).find_first_of("\n\r") == std::string_view::npos;
+                }
+            }
+            return false;
+        case Kind::regex:
+            return std::regex_match(name.begin(), name.end(), regex_);
     }
+    return false;
+}
 
-    std::stringstream ss;
-    ss << std::hex << hash;
-    return ss.str();
+FileMonitor::FileMonitor() : running(false), descriptor(context), flushTimer(context) {
+    // Initialize inotify
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd == -1) {
+        throw std::runtime_error("Failed to initialize inotify");
+    }
+    descriptor.assign(inotifyFd);
 }
 
 FileMonitor::~FileMonitor() {
     stop();
-    close(inotifyFd);
 }
 
 void FileMonitor::addWatch(const std::filesystem::path& directory,
                          const std::string& pattern,
-                         FileCallback onNewFile,
-                         FileCallback onModifiedFile,
-                         FileCallback onDeletedFile,
-                         FileCallback onCloseWrite) {
-    WatchInfo info;
-    info.pattern = pattern;
-    info.onNewFile = onNewFile;
-    info.onModifiedFile = onModifiedFile;
-    info.onDeletedFile = onDeletedFile;
-    info.onCloseWrite = onCloseWrite;
-
-    // Add inotify watch with IN_MOVED_TO flag to catch file creation via moves
-    int wd = inotify_add_watch(inotifyFd, directory.c_str(), 
-        IN_CREATE | IN_MODIFY | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_TO);
-    if (wd == -1) {
+                         EventCallback onEvent,
+                         WatchOptions options) {
+    WatchInfo info{directory, Matcher(pattern), std::move(onEvent), options, {}};
+    auto& watch = watches.insert_or_assign(directory, std::move(info)).first->second;
+
+    // Files already there count as complete, rewriting one unchanged is a
+    // no-op for a fingerprinting watch
+    if (!watchDirectory(watch, directory, true)) {
+        watches.erase(directory);
         throw std::runtime_error("Failed to add inotify watch");
     }
+}
 
-    watches[directory] = std::move(info);
+bool FileMonitor::watchDirectory(WatchInfo& watch, const std::filesystem::path& directory, bool initial,
+                                 std::unordered_set<std::filesystem::path>* found) {
+    // IN_MOVED_TO catches file creation via moves, IN_MOVED_FROM files and
+    // directories moved away
+    int wd = inotify_add_watch(inotifyFd, directory.c_str(),
+        IN_CREATE | IN_MODIFY | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_ONLYDIR);
+    if (wd == -1) {
+        if (directory != watch.root) {
+            LOG_ERROR << "FileMonitor: Cannot watch " << directory << ": " << std::strerror(errno);
+        }
+        return false;
+    }
+    // A directory renamed within the tree keeps its watch descriptor
+    if (auto old = watchDescriptors.find(wd); old != watchDescriptors.end() && old->second != directory) {
+        directories.erase(old->second);
+    }
     watchDescriptors[wd] = directory;
+    directories[directory] = DirectoryInfo{wd, watch.root};
+    if (found) {
+        found->insert(directory);
+    }
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        const auto& path = entry.path();
+        if (watch.options.recursive && entry.is_directory(ec) && !entry.is_symlink(ec)) {
+            if (!watch.options.skipHidden || path.filename().native().front() != '.') {
+                watchDirectory(watch, path, initial, found);
+            }
+            continue;
+        }
+        if (!watch.matcher(path.filename().native())) {
+            continue;
+        }
+        if (found) {
+            found->insert(path);
+        }
+
+        if (initial) {
+            auto& file = watch.files[path];
+            file.reported = true;
+            if (watch.options.fingerprint && entry.is_regular_file(ec)) {
+                updateFingerprint(file, path);
+            } else {
+                statFile(path, file);
+            }
+            continue;
+        }
+
+        // Written while nobody was watching
+        auto seen = watch.files.find(path);
+        if (seen == watch.files.end()) {
+            recordEvent(watch, path, IN_MOVED_TO);
+            continue;
+        }
+        FileInfo now;
+        if (statFile(path, now) && (now.size != seen->second.size || now.modifiedNs != seen->second.modifiedNs ||
+                                    now.inode != seen->second.inode)) {
+            recordEvent(watch, path, IN_CLOSE_WRITE);
+        }
+    }
+    return true;
 }
 
-bool FileMonitor::matchesPattern(const std::string& filename, const std::string& pattern) {
-    try {
-        std::regex regex(pattern);
-        return std::regex_match(filename, regex);
-    } catch (const std::regex_error& e) {
-        std::cerr << "Regex error: " << e.what() << std::endl;
+void FileMonitor::unwatchTree(const std::filesystem::path& directory) {
+    auto const& prefix = directory.native();
+    for (auto it = directories.begin(); it != directories.end();) {
+        auto const& path = it->first.native();
+        if (path == prefix || (path.size() > prefix.size() && path.compare(0, prefix.size(), prefix) == 0 &&
+                               path[prefix.size()] == '/')) {
+            inotify_rm_watch(inotifyFd, it->second.wd);
+            watchDescriptors.erase(it->second.wd);
+            it = directories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FileMonitor::rescan() {
+    auto const start = std::chrono::steady_clock::now();
+    std::size_t scanned = 0;
+
+    for (auto& [root, watch] : watches) {
+        std::unordered_set<std::filesystem::path> found;
+        watchDirectory(watch, root, false, &found);
+        scanned += found.size();
+
+        // Files and directories that went away took their events with them
+        for (const auto& [path, info] : watch.files) {
+            if (!found.count(path)) {
+                recordEvent(watch, path, IN_DELETE);
+            }
+        }
+        std::vector<std::filesystem::path> gone;
+        for (const auto& [path, info] : directories) {
+            if (info.root == root && !found.count(path)) {
+                gone.push_back(path);
+            }
+        }
+        for (const auto& path : gone) {
+            unwatchTree(path);
+        }
+    }
+
+    auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    LOG_WARNING << "FileMonitor: Event queue overflowed, rescanned " << scanned << " paths in "
+                << elapsed.count() / 1000.0 << " ms";
+}
+
+bool FileMonitor::statFile(const std::filesystem::path& path, FileInfo& info) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
         return false;
     }
+    info.size = static_cast<std::uintmax_t>(st.st_size);
+    info.modifiedNs = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+    info.inode = st.st_ino;
+    return true;
+}
+
+bool FileMonitor::updateFingerprint(FileInfo& info, const std::filesystem::path& path) {
+    bool const fingerprinted = info.fingerprinted;
+    auto const size = info.size;
+    auto const contentHash = info.contentHash;
+
+    auto hash = fileContentHash(path);
+    if (!hash || !statFile(path, info)) {
+        info.fingerprinted = false;
+        return true;  // Gone or unreadable, the callbacks decide
+    }
+    info.fingerprinted = true;
+    info.contentHash = *hash;
+    return !fingerprinted || size != info.size || contentHash != *hash;
 }
 
 void FileMonitor::handleInotifyEvent(const inotify_event* event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        overflowed = true;
+        return;
+    }
     auto it = watchDescriptors.find(event->wd);
     if (it == watchDescriptors.end()) return;
 
-    const auto& directory = it->second;
-    auto& watch = watches[directory];
-    std::filesystem::path filepath = directory / event->name;
+    if (event->mask & IN_IGNORED) {
+        // The directory was deleted, its files were reported before
+        if (auto dir = directories.find(it->second); dir != directories.end() && dir->second.wd == event->wd) {
+            directories.erase(dir);
+        }
+        watchDescriptors.erase(it);
+        return;
+    }
+    if (event->len == 0) return;
+
+    auto dir = directories.find(it->second);
+    if (dir == directories.end()) return;
+    auto found = watches.find(dir->second.root);
+    if (found == watches.end()) return;
+    auto& watch = found->second;
+    std::filesystem::path filepath = it->second / event->name;
+
+    if ((event->mask & IN_ISDIR) && watch.options.recursive) {
+        if (watch.options.skipHidden && event->name[0] == '.') return;
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            // Files may have been put there before the watch was added
+            watchDirectory(watch, filepath, false);
+        } else if (event->mask & IN_MOVED_FROM) {
+            // Its files left the tree with it, without events of their own
+            auto const prefix = filepath.native() + '/';
+            for (const auto& [path, info] : watch.files) {
+                if (path.native().compare(0, prefix.size(), prefix) == 0) {
+                    recordEvent(watch, path, IN_MOVED_FROM);
+                }
+            }
+            unwatchTree(filepath);
+        }
+        return;
+    }
 
-    if (!matchesPattern(event->name, watch.pattern)) return;
+    if (!watch.matcher(event->name)) return;
+    recordEvent(watch, filepath, event->mask);
+}
+
+void FileMonitor::recordEvent(WatchInfo& watch, const std::filesystem::path& path, std::uint32_t mask) {
+    auto const now = std::chrono::steady_clock::now();
+    auto [entry, inserted] = pending.try_emplace(path);
+    auto& state = entry->second;
+    if (inserted) {
+        state.root = watch.root;
+        state.sequence = nextSequence++;
+        state.existed = watch.files.count(path) != 0;
+        state.first = now;
+    }
+    state.last = now;
+    state.directoryEntry = (mask & IN_ISDIR) != 0;
+
+    if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        state.gone = true;
+        state.writing = false;
+        state.complete = false;
+    }
+    if (mask & IN_CREATE) {
+        // A directory is complete once it exists, a file once it is closed
+        state.gone = false;
+        state.writing = !state.directoryEntry;
+        state.complete = state.directoryEntry;
+    }
+    if (mask & IN_MODIFY) {
+        state.writing = true;
+    }
+    if (mask & IN_CLOSE_WRITE) {
+        state.writing = false;
+        state.complete = true;
+    }
+    // A file renamed into the directory was complete before the rename
+    if (mask & IN_MOVED_TO) {
+        state.gone = false;
+        state.writing = false;
+        state.complete = true;
+    }
+}
 
-    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
-        if (watch.onNewFile) {
-            std::cout << "FileMonitor: New file detected: " << filepath << std::endl;
-            watch.onNewFile(filepath);
+void FileMonitor::reportEvent(WatchInfo& watch, const std::filesystem::path& path, const PendingEvent& state) {
+    // A file created and removed again before it settled was never there
+    // as far as the callbacks are concerned
+    if (state.gone) {
+        watch.files.erase(path);
+        if (state.existed) {
+            LOG_INFO << "FileMonitor: removed: " << path;
+            if (watch.onEvent) {
+                watch.onEvent(path, FileEvent::removed);
+            }
         }
+        return;
+    }
+
+    auto& info = watch.files[path];
+    if (state.writing && !watch.options.partialWrites) {
+        return;  // Reported once the writer closes it
     }
-    if (event->mask & IN_MODIFY) {
-        if (watch.onModifiedFile) {
-            std::cout << "FileMonitor: File modified: " << filepath << std::endl;
-            watch.onModifiedFile(filepath);
+    if (state.complete && !state.writing && !state.directoryEntry) {
+        if (!watch.options.fingerprint) {
+            statFile(path, info);
+        } else if (!updateFingerprint(info, path)) {
+            info.reported = true;
+            LOG_INFO << "FileMonitor: Contents unchanged, ignoring: " << path;
+            return;
         }
     }
-    if (event->mask & IN_DELETE) {
-        if (watch.onDeletedFile) {
-            std::cout << "FileMonitor: File deleted: " << filepath << std::endl;
-            watch.onDeletedFile(filepath);
+
+    auto const event = info.reported ? FileEvent::replaced : FileEvent::created;
+    info.reported = true;
+    LOG_INFO << "FileMonitor: " << toString(event) << ": " << path;
+    if (watch.onEvent) {
+        watch.onEvent(path, event);
+    }
+}
+
+void FileMonitor::flushPending() {
+    auto const now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::time_point::max();
+
+    std::vector<std::pair<std::filesystem::path, PendingEvent>> settled;
+    for (auto it = pending.begin(); it != pending.end();) {
+        auto const due = std::min(it->second.last + COALESCE_WINDOW, it->second.first + COALESCE_LIMIT);
+        if (due > now) {
+            next = std::min(next, due);
+            ++it;
+            continue;
         }
+        settled.emplace_back(it->first, std::move(it->second));
+        it = pending.erase(it);
     }
-    if (event->mask & IN_CLOSE_WRITE) {
-        if (watch.onCloseWrite) {
-            std::cout << "FileMonitor: File write completed: " << filepath << std::endl;
-            watch.onCloseWrite(filepath);
+    std::sort(settled.begin(), settled.end(),
+              [](const auto& a, const auto& b) { return a.second.sequence < b.second.sequence; });
+
+    // Callbacks may add watches, look each one up again
+    for (const auto& [path, state] : settled) {
+        auto watch = watches.find(state.root);
+        if (watch != watches.end()) {
+            reportEvent(watch->second, path, state);
         }
     }
+
+    if (next != std::chrono::steady_clock::time_point::max()) {
+        armFlush(next);
+    }
 }
 
-void FileMonitor::monitorLoop() {
-    constexpr size_t EVENT_BUF_LEN = 4096;
-    std::array<char, EVENT_BUF_LEN> buffer;
+void FileMonitor::armFlush(std::chrono::steady_clock::time_point deadline) {
+    flushArmed = true;
+    flushTimer.expires_at(deadline);
+    flushTimer.async_wait([this](const boost::system::error_code& ec) {
+        flushArmed = false;
+        if (!ec) {
+            flushPending();
+        }
+    });
+}
 
-    while (running) {
+void FileMonitor::waitForEvents() {
+    descriptor.async_wait(
+        boost::asio::posix::stream_descriptor::wait_read,
+        [this](const boost::system::error_code& ec) {
+            if (ec) {
+                if (ec != boost::asio::error::operation_aborted) {
+                    LOG_ERROR << "Error waiting for inotify events: " << ec.message();
+                }
+                return;
+            }
+            readEvents();
+            if (overflowed) {
+                overflowed = false;
+                rescan();
+            }
+            // Paths that just saw their first event settle a window from now,
+            // ones already pending are due no earlier
+            if (!flushArmed && !pending.empty()) {
+                armFlush(std::chrono::steady_clock::now() + COALESCE_WINDOW);
+            }
+            if (running) {
+                waitForEvents();
+            }
+        });
+}
+
+void FileMonitor::readEvents() {
+    constexpr size_t EVENT_BUF_LEN = 16 * 1024;
+    alignas(inotify_event) std::array<char, EVENT_BUF_LEN> buffer;
+
+    // Drain everything queued so far
+    while (true) {
         ssize_t length = read(inotifyFd, buffer.data(), EVENT_BUF_LEN);
         if (length == -1) {
-            if (errno == EAGAIN) {
-                // No events available, wait a bit
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (errno == EINTR) {
                 continue;
             }
-            std::cerr << "Error reading inotify events" << std::endl;
-            break;
+            if (errno != EAGAIN) {
+                LOG_ERROR << "Error reading inotify events";
+            }
+            return;
         }
 
         // Process all events in buffer
         char* ptr = buffer.data();
         while (ptr < buffer.data() + length) {
             auto* event = reinterpret_cast<inotify_event*>(ptr);
-            handleInotifyEvent(event);
             ptr += sizeof(inotify_event) + event->len;
+            handleInotifyEvent(event);
         }
     }
 }
 
 void FileMonitor::start() {
     if (!running.exchange(true)) {
-        monitorThread = std::thread(&FileMonitor::monitorLoop, this);
+        context.restart();
+        waitForEvents();
+        monitorThread = std::thread([this] { context.run(); });
     }
 }
 
 void FileMonitor::stop() {
     if (running.exchange(false)) {
+        // Cancel on the monitor thread, run() returns once the waits complete
+        boost::asio::post(context, [this] {
+            descriptor.cancel();
+            flushTimer.cancel();
+        });
         if (monitorThread.joinable()) {
             monitorThread.join();
         }
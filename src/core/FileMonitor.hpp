@@ -1,20 +1,76 @@
 #pragma once
 
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
 #include <filesystem>
 #include <functional>
+#include <regex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <chrono>
+#include <unordered_set>
+#include <vector>
 #include <thread>
 #include <atomic>
+#include <cstdint>
 #include <sys/inotify.h>
-#include <unordered_map>
+#include <sys/types.h>
 
 namespace core {
 
+// What happened to a file, once the raw inotify events for it settled
+enum class FileEvent {
+    created,   // A new file is complete, or a directory was created
+    replaced,  // An existing file has new contents
+    removed,   // The file or directory is gone
+};
+
+const char* toString(FileEvent event);
+
+// How a FileMonitor watch reports files
+struct WatchOptions {
+    // Remember a fingerprint of every matching file's contents and drop
+    // completions that leave them unchanged, so rebuilding an unchanged
+    // plugin does not reload it. Reads the files already there when the
+    // watch is added.
+    bool fingerprint{false};
+
+    // Also report files written to and not closed yet, for watchers that
+    // only need to know a file changed
+    bool partialWrites{false};
+
+    // Watch the subdirectories as well, including ones created or moved in
+    // later. Their files are reported, the directories themselves are not.
+    bool recursive{false};
+
+    // Leave out subdirectories whose names start with "."
+    bool skipHidden{false};
+};
+
+// Watches directories with inotify. The inotify descriptor is registered on
+// an io_context run by a thread of the monitor's own, so events are handled
+// as soon as they arrive and the thread sleeps while nothing changes.
+// Callbacks run on that thread; they may load plugins, which is too slow
+// for the server's IO threads.
+//
+// A writer produces a run of raw events for one file: created, modified a
+// number of times, closed, maybe renamed over. They are collected per path
+// until the path has been quiet for COALESCE_WINDOW and then reported as a
+// single FileEvent. A file still open for writing is not reported until it
+// is closed, unless the watch asks for partial writes.
+//
+// Every watch remembers the files it has seen. When the kernel's event queue
+// overflows, events were lost, and the watched trees are scanned again and
+// compared against what was seen, so the changes are still reported.
 class FileMonitor {
 public:
-    using FileCallback = std::function<void(const std::filesystem::path&)>;
+    using EventCallback = std::function<void(const std::filesystem::path&, FileEvent)>;
+
+    static constexpr std::chrono::milliseconds COALESCE_WINDOW{10};
+    // A path written to without pause settles after this long anyway
+    static constexpr std::chrono::milliseconds COALESCE_LIMIT{250};
 
     FileMonitor();
     ~FileMonitor();
@@ -23,13 +79,15 @@ public:
     FileMonitor(const FileMonitor&) = delete;
     FileMonitor& operator=(const FileMonitor&) = delete;
 
-    // Add a directory to monitor with file pattern and callback
-    void addWatch(const std::filesystem::path& directory, 
+    // Report changes to the files in directory whose names match pattern, a
+    // regular expression. Patterns of the form ".*<literal>" and
+    // ".*<literal>(<literal>|...)?" are matched as plain suffixes. Throws if
+    // the pattern is not a valid regular expression or directory cannot be
+    // watched. A subdirectory that cannot be watched is logged and skipped.
+    void addWatch(const std::filesystem::path& directory,
                  const std::string& pattern,
-                 FileCallback onNewFile,
-                 FileCallback onModifiedFile,
-                 FileCallback onDeletedFile,
-                 FileCallback onCloseWrite);
+                 EventCallback onEvent,
+                 WatchOptions options = {});
 
     // Start monitoring
     void start();
@@ -38,31 +96,93 @@ public:
     void stop();
 
 private:
+    // A file name pattern, compiled once per watch
+    class Matcher {
+    public:
+        explicit Matcher(const std::string& pattern);
+        bool operator()(std::string_view name) const;
+
+    private:
+        enum class Kind { any, suffix, regex };
+        bool parseSuffixes(std::string_view pattern);
+
+        Kind kind_{Kind::regex};
+        std::vector<std::string> suffixes_;
+        std::regex regex_;
+    };
+
     struct FileInfo {
-        std::string contentHash;  // Hash of file content
-        std::filesystem::file_time_type lastModified;
-        int watchDescriptor;  // inotify watch descriptor
+        bool reported{false};          // Reported as complete, or there when the watch was added
+        bool fingerprinted{false};
+        std::uintmax_t size{0};
+        std::int64_t modifiedNs{0};
+        ino_t inode{0};
+        std::uint64_t contentHash{0};  // core::contentHash of the file
+    };
+
+    // Raw events of one path since it was last reported
+    struct PendingEvent {
+        std::filesystem::path root;  // Of the watch
+        std::uint64_t sequence{0};  // Order of the first event, paths are reported in it
+        bool existed{false};    // The path was there before the first of these events
+        bool directoryEntry{false};
+        bool writing{false};    // Created or modified and not closed since
+        bool complete{false};   // Closed after writing or renamed into place since
+        bool gone{false};       // Deleted or renamed away by the last event
+        std::chrono::steady_clock::time_point first;
+        std::chrono::steady_clock::time_point last;
     };
 
     struct WatchInfo {
-        std::string pattern;
-        FileCallback onNewFile;
-        FileCallback onModifiedFile;
-        FileCallback onDeletedFile;
-        FileCallback onCloseWrite;
-        std::unordered_map<std::filesystem::path, FileInfo> files;
+        std::filesystem::path root;
+        Matcher matcher;
+        EventCallback onEvent;
+        WatchOptions options;
+        std::unordered_map<std::filesystem::path, FileInfo> files;  // Matching files present
+    };
+
+    struct DirectoryInfo {
+        int wd;
+        std::filesystem::path root;  // Of the watch the directory belongs to
     };
 
-    bool matchesPattern(const std::string& filename, const std::string& pattern);
-    void monitorLoop();
-    std::string calculateFileHash(const std::filesystem::path& path);
+    void waitForEvents();
+    void readEvents();
     void handleInotifyEvent(const inotify_event* event);
+    // Record an event, raw or found by a scan, for a path of watch
+    void recordEvent(WatchInfo& watch, const std::filesystem::path& path, std::uint32_t mask);
+    // Add an inotify watch for directory, and for its subdirectories if the
+    // watch is recursive. Returns false if directory cannot be watched. The
+    // files found are taken as they are when initial, otherwise they are
+    // compared to the files seen and the differences recorded. The paths
+    // visited are added to found, if given.
+    bool watchDirectory(WatchInfo& watch, const std::filesystem::path& directory, bool initial,
+                        std::unordered_set<std::filesystem::path>* found = nullptr);
+    void unwatchTree(const std::filesystem::path& directory);
+    // Scan every watched tree and record the differences to the files seen
+    void rescan();
+    // Report the paths that settled and wait for the next one to
+    void flushPending();
+    void armFlush(std::chrono::steady_clock::time_point deadline);
+    void reportEvent(WatchInfo& watch, const std::filesystem::path& path, const PendingEvent& pending);
+    // Fingerprint a complete file. Returns false if its contents are the
+    // same as when it was last fingerprinted.
+    bool updateFingerprint(FileInfo& info, const std::filesystem::path& path);
+    static bool statFile(const std::filesystem::path& path, FileInfo& info);
 
-    std::unordered_map<std::filesystem::path, WatchInfo> watches;
+    std::unordered_map<std::filesystem::path, WatchInfo> watches;  // By root
+    std::unordered_map<std::filesystem::path, DirectoryInfo> directories;  // Every watched directory
     std::unordered_map<int, std::filesystem::path> watchDescriptors;  // maps watch descriptors to paths
+    std::unordered_map<std::filesystem::path, PendingEvent> pending;
+    std::uint64_t nextSequence{0};
+    bool overflowed{false};  // Events were lost since the last rescan
     std::atomic<bool> running;
     std::thread monitorThread;
-    int inotifyFd;  // inotify file descriptor
+    int inotifyFd;  // inotify file descriptor, owned by descriptor
+    boost::asio::io_context context;
+    boost::asio::posix::stream_descriptor descriptor;
+    boost::asio::steady_timer flushTimer;
+    bool flushArmed{false};
 };
 
 } // namespace core
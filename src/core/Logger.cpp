@@ -0,0 +1,503 @@
+#include "Logger.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace core {
+
+namespace {
+
+struct Slot {
+    std::chrono::system_clock::time_point time;
+    LogLevel level;
+    bool truncated;
+    std::uint16_t size;
+    char payload[LogRecord::PAYLOAD_SIZE];
+};
+
+// Single-producer single-consumer ring owned by one logging thread
+struct ThreadBuffer {
+    static constexpr std::uint64_t CAPACITY = 256;  // Must be a power of two
+
+    alignas(64) std::atomic<std::uint64_t> head{0};  // Next slot to format, written by the backend
+    alignas(64) std::atomic<std::uint64_t> tail{0};  // Next slot to fill, written by the owner
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<bool> abandoned{false};             // Owner thread has exited
+    long thread_id{0};
+    std::array<Slot, CAPACITY> slots;
+};
+
+class Backend {
+public:
+    ~Backend() {
+        stop();
+        if (wake_fd_ >= 0) {
+            ::close(wake_fd_);
+        }
+    }
+
+    void start(const std::filesystem::path& path, LogOverflowPolicy policy, bool console) {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        if (running_) {
+            return;
+        }
+
+        path_ = path;
+        file_ = std::fopen(path_.c_str(), "w");
+        file_size_ = 0;
+        rotate_at_ = nextMidnight();
+        console_ = console;
+        policy_.store(policy, std::memory_order_relaxed);
+        if (wake_fd_ < 0) {
+            wake_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        }
+        running_ = true;
+        thread_ = std::thread(&Backend::run, this);
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+        signal();
+        thread_.join();
+        if (file_) {
+            std::fclose(file_);
+            file_ = nullptr;
+        }
+    }
+
+    void flush() {
+        // Wait for two full drain passes, so everything published before
+        // this call has been formatted and written
+        std::unique_lock<std::mutex> lock(flush_mutex_);
+        auto target = passes_ + 2;
+        flush_target_ = std::max(flush_target_, target);
+        signal();
+        flush_cv_.wait_for(lock, std::chrono::seconds(1),
+                           [this, target] { return passes_ >= target || !running_; });
+    }
+
+    // Called by a producer after publishing a record. Only costs a syscall
+    // when the background thread is asleep.
+    void wake() {
+        if (sleeping_.load() && sleeping_.exchange(false)) {
+            signal();
+        }
+    }
+
+    ThreadBuffer* registerThread() {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->thread_id = static_cast<long>(::syscall(SYS_gettid));
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        buffers_.push_back(std::move(buffer));
+        return buffers_.back().get();
+    }
+
+    LogOverflowPolicy policy() const { return policy_.load(std::memory_order_relaxed); }
+
+    std::uint64_t dropped() {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        std::uint64_t total = retired_dropped_;
+        for (const auto& buffer : buffers_) {
+            total += buffer->dropped.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    void run() {
+        while (true) {
+            bool stopping = !running_;
+            bool wrote = drain();
+            {
+                std::lock_guard<std::mutex> lock(flush_mutex_);
+                ++passes_;
+            }
+            flush_cv_.notify_all();
+
+            if (stopping) {
+                break;
+            }
+            if (wrote || flushing()) {
+                continue;
+            }
+
+            if (file_ && file_size_ > 0 && std::chrono::system_clock::now() >= rotate_at_) {
+                rotate();
+            }
+
+            // Announce the sleep before the last look at the rings. A
+            // producer publishes before it checks sleeping_, so either this
+            // sees its record or it sees sleeping_ and wakes the thread.
+            sleeping_.store(true);
+            if (running_ && !pending()) {
+                waitForRecords();
+            }
+            sleeping_.store(false);
+        }
+    }
+
+    bool flushing() {
+        std::lock_guard<std::mutex> lock(flush_mutex_);
+        return passes_ < flush_target_;
+    }
+
+    bool pending() {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        return std::any_of(buffers_.begin(), buffers_.end(), [](const auto& buffer) {
+            return buffer->head.load(std::memory_order_relaxed) != buffer->tail.load();
+        });
+    }
+
+    // Block until a producer, flush() or stop() signals, or the daily
+    // rotation is due
+    void waitForRecords() {
+        auto const until_rotation = std::chrono::duration_cast<std::chrono::milliseconds>(
+            rotate_at_ - std::chrono::system_clock::now());
+        pollfd fd{wake_fd_, POLLIN, 0};
+        ::poll(&fd, 1, static_cast<int>(std::max<std::int64_t>(until_rotation.count(), 0) + 1));
+        std::uint64_t count;
+        while (::read(wake_fd_, &count, sizeof(count)) == sizeof(count)) {
+        }
+    }
+
+    void signal() {
+        std::uint64_t const one = 1;
+        [[maybe_unused]] auto result = ::write(wake_fd_, &one, sizeof(one));
+    }
+
+    // Local midnight after now, when the log file is rotated
+    static std::chrono::system_clock::time_point nextMidnight() {
+        std::time_t const now = std::time(nullptr);
+        std::tm tm{};
+        localtime_r(&now, &tm);
+        tm.tm_mday += 1;
+        tm.tm_hour = 0;
+        tm.tm_min = 0;
+        tm.tm_sec = 0;
+        tm.tm_isdst = -1;
+        return std::chrono::system_clock::from_time_t(std::mktime(&tm));
+    }
+
+    bool drain() {
+        {
+            std::lock_guard<std::mutex> lock(buffers_mutex_);
+            snapshot_.clear();
+            for (const auto& buffer : buffers_) {
+                snapshot_.push_back(buffer.get());
+            }
+        }
+
+        // Collect everything published so far and merge it by timestamp, so
+        // records from different threads come out in order
+        pending_.clear();
+        tails_.clear();
+        for (auto* buffer : snapshot_) {
+            auto head = buffer->head.load(std::memory_order_relaxed);
+            auto tail = buffer->tail.load(std::memory_order_acquire);
+            for (; head != tail; ++head) {
+                pending_.push_back({&buffer->slots[head & (ThreadBuffer::CAPACITY - 1)], buffer->thread_id});
+            }
+            tails_.emplace_back(buffer, tail);
+        }
+
+        if (pending_.empty()) {
+            releaseAbandoned();
+            return false;
+        }
+
+        std::stable_sort(pending_.begin(), pending_.end(), [](const auto& a, const auto& b) {
+            return a.first->time < b.first->time;
+        });
+        for (const auto& [slot, thread_id] : pending_) {
+            format(*slot, thread_id);
+        }
+
+        // Hand the slots back to their owners
+        for (const auto& [buffer, tail] : tails_) {
+            buffer->head.store(tail, std::memory_order_release);
+        }
+
+        write();
+        releaseAbandoned();
+        return true;
+    }
+
+    // Free buffers of exited threads once they are empty
+    void releaseAbandoned() {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        for (auto it = buffers_.begin(); it != buffers_.end();) {
+            auto& buffer = **it;
+            if (buffer.abandoned.load(std::memory_order_acquire) &&
+                buffer.head.load(std::memory_order_relaxed) == buffer.tail.load(std::memory_order_acquire)) {
+                retired_dropped_ += buffer.dropped.load(std::memory_order_relaxed);
+                it = buffers_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void format(const Slot& slot, long thread_id) {
+        static constexpr const char* LEVEL_NAMES[] = {
+            "trace", "debug", "info", "warning", "error", "fatal", "off"
+        };
+
+        // Timestamp, matching "%Y-%m-%d %H:%M:%S.%f"
+        auto since_epoch = slot.time.time_since_epoch();
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(since_epoch - seconds);
+        std::time_t time = seconds.count();
+        std::tm tm{};
+        localtime_r(&time, &tm);
+
+        char prefix[96];
+        auto prefix_size = std::strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &tm);
+        prefix_size += std::snprintf(prefix + prefix_size, sizeof(prefix) - prefix_size,
+                                     ".%06lld [%s] [%ld] ",
+                                     static_cast<long long>(micros.count()),
+                                     LEVEL_NAMES[static_cast<int>(slot.level)], thread_id);
+        line_.append(prefix, prefix_size);
+
+        const char* data = slot.payload;
+        const char* end = slot.payload + slot.size;
+        char number[32];
+        while (data < end) {
+            auto tag = static_cast<LogRecord::Tag>(*data++);
+            switch (tag) {
+            case LogRecord::Tag::string: {
+                std::uint16_t length;
+                std::memcpy(&length, data, sizeof(length));
+                data += sizeof(length);
+                line_.append(data, length);
+                data += length;
+                break;
+            }
+            case LogRecord::Tag::signed_int: {
+                std::int64_t value;
+                std::memcpy(&value, data, sizeof(value));
+                data += sizeof(value);
+                auto result = std::to_chars(number, number + sizeof(number), value);
+                line_.append(number, result.ptr);
+                break;
+            }
+            case LogRecord::Tag::unsigned_int: {
+                std::uint64_t value;
+                std::memcpy(&value, data, sizeof(value));
+                data += sizeof(value);
+                auto result = std::to_chars(number, number + sizeof(number), value);
+                line_.append(number, result.ptr);
+                break;
+            }
+            case LogRecord::Tag::floating: {
+                double value;
+                std::memcpy(&value, data, sizeof(value));
+                data += sizeof(value);
+                line_.append(number, std::snprintf(number, sizeof(number), "%g", value));
+                break;
+            }
+            case LogRecord::Tag::character:
+                line_.push_back(*data++);
+                break;
+            case LogRecord::Tag::boolean: {
+                bool value;
+                std::memcpy(&value, data, sizeof(value));
+                data += sizeof(value);
+                line_.push_back(value ? '1' : '0');
+                break;
+            }
+            case LogRecord::Tag::pointer: {
+                std::uintptr_t value;
+                std::memcpy(&value, data, sizeof(value));
+                data += sizeof(value);
+                line_.append(number, std::snprintf(number, sizeof(number), "0x%" PRIxPTR, value));
+                break;
+            }
+            }
+        }
+
+        if (slot.truncated) {
+            line_.append("...");
+        }
+        line_.push_back('\n');
+    }
+
+    void write() {
+        if (console_) {
+            std::fwrite(line_.data(), 1, line_.size(), stdout);
+            std::fflush(stdout);
+        }
+
+        if (file_) {
+            std::fwrite(line_.data(), 1, line_.size(), file_);
+            std::fflush(file_);
+            file_size_ += line_.size();
+            if (file_size_ >= Logger::ROTATION_SIZE || std::chrono::system_clock::now() >= rotate_at_) {
+                rotate();
+            }
+        }
+        line_.clear();
+    }
+
+    // Shift the previous files up by one, <file>.1 is the most recent
+    void rotate() {
+        std::fclose(file_);
+        auto rotated = [this](int index) {
+            auto path = path_;
+            path += "." + std::to_string(index);
+            return path;
+        };
+        std::error_code ec;
+        std::filesystem::remove(rotated(Logger::ROTATED_FILES), ec);
+        for (int index = Logger::ROTATED_FILES - 1; index > 0; --index) {
+            std::filesystem::rename(rotated(index), rotated(index + 1), ec);
+        }
+        std::filesystem::rename(path_, rotated(1), ec);
+        file_ = std::fopen(path_.c_str(), "w");
+        file_size_ = 0;
+        rotate_at_ = nextMidnight();
+    }
+
+    std::mutex control_mutex_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    std::atomic<LogOverflowPolicy> policy_{LogOverflowPolicy::drop};
+
+    std::mutex buffers_mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    std::uint64_t retired_dropped_{0};
+
+    std::mutex flush_mutex_;
+    std::condition_variable flush_cv_;
+    std::uint64_t passes_{0};
+    std::uint64_t flush_target_{0};  // Passes a flush() is waiting for
+
+    int wake_fd_{-1};  // eventfd the background thread sleeps on
+    std::atomic<bool> sleeping_{false};
+
+    // Only used by the background thread
+    std::filesystem::path path_;
+    std::FILE* file_{nullptr};
+    std::size_t file_size_{0};
+    std::chrono::system_clock::time_point rotate_at_;
+    bool console_{false};
+    std::string line_;
+    std::vector<ThreadBuffer*> snapshot_;
+    std::vector<std::pair<const Slot*, long>> pending_;
+    std::vector<std::pair<ThreadBuffer*, std::uint64_t>> tails_;
+};
+
+Backend& backend() {
+    static Backend instance;
+    return instance;
+}
+
+// Marks the thread's buffer as abandoned when the thread exits
+struct ThreadBufferHandle {
+    ThreadBuffer* buffer{nullptr};
+    bool in_record{false};
+
+    ~ThreadBufferHandle() {
+        if (buffer) {
+            buffer->abandoned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadBufferHandle thread_buffer;
+
+} // namespace
+
+void Logger::init(const std::string& log_file, LogOverflowPolicy policy, bool console) {
+    // Create logs directory if it doesn't exist
+    std::filesystem::create_directories("logs");
+
+    // Construct full log path
+    auto log_path = std::filesystem::path("logs") / log_file;
+
+    backend().start(log_path, policy, console);
+    setLevel(LogLevel::info);
+
+    LOG_INFO << "Logger initialized. Log file: " << log_path.string();
+}
+
+void Logger::flush() {
+    backend().flush();
+}
+
+void Logger::shutdown() {
+    setLevel(LogLevel::off);
+    backend().stop();
+}
+
+std::uint64_t Logger::droppedRecords() {
+    return backend().dropped();
+}
+
+LogRecord::LogRecord(LogLevel level) {
+    auto& handle = thread_buffer;
+
+    // A record logged while formatting another one on this thread would
+    // claim the same slot
+    if (handle.in_record) {
+        return;
+    }
+    if (!handle.buffer) {
+        handle.buffer = backend().registerThread();
+    }
+
+    auto& buffer = *handle.buffer;
+    auto tail = buffer.tail.load(std::memory_order_relaxed);
+    while (tail - buffer.head.load(std::memory_order_acquire) >= ThreadBuffer::CAPACITY) {
+        if (backend().policy() == LogOverflowPolicy::drop || !Logger::enabled(level)) {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    auto& slot = buffer.slots[tail & (ThreadBuffer::CAPACITY - 1)];
+    slot.time = std::chrono::system_clock::now();
+    slot.level = level;
+    slot.truncated = false;
+    slot_ = &slot;
+    data_ = slot.payload;
+    handle.in_record = true;
+}
+
+LogRecord::~LogRecord() {
+    if (!slot_) {
+        return;
+    }
+
+    auto& slot = *static_cast<Slot*>(slot_);
+    slot.size = static_cast<std::uint16_t>(used_);
+
+    auto& handle = thread_buffer;
+    handle.in_record = false;
+    // Sequentially consistent, so the sleeping check in wake() cannot be
+    // ordered before the record is published
+    handle.buffer->tail.store(handle.buffer->tail.load(std::memory_order_relaxed) + 1);
+    backend().wake();
+}
+
+void LogRecord::truncate() {
+    static_cast<Slot*>(slot_)->truncated = true;
+    data_ = nullptr;  // Ignore the remaining arguments
+}
+
+} // namespace core
@@ -1,73 +1,202 @@
 #pragma once
 
-#include <boost/log/trivial.hpp>
-#include <boost/log/sources/severity_logger.hpp>
-#include <boost/log/sources/record_ostream.hpp>
-#include <boost/log/utility/setup/file.hpp>
-#include <boost/log/utility/setup/common_attributes.hpp>
-#include <boost/log/expressions.hpp>
-#include <boost/log/support/date_time.hpp>
-#include <boost/log/attributes/current_thread_id.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace core {
 
-// Forward declare Logger to define macros
-class Logger;
+enum class LogLevel : std::uint8_t {
+    trace,
+    debug,
+    info,
+    warning,
+    error,
+    fatal,
+    off
+};
+
+// What a thread does when its log buffer is full
+enum class LogOverflowPolicy {
+    drop,   // Discard the record and count it
+    block   // Wait for the background thread to make room
+};
+
+// Forward declare LogRecord to define macros
+class LogRecord;
 
-// Convenience macros for logging
-#define LOG_TRACE   BOOST_LOG_SEV(core::Logger::get(), boost::log::trivial::trace)
-#define LOG_DEBUG   BOOST_LOG_SEV(core::Logger::get(), boost::log::trivial::debug)
-#define LOG_INFO    BOOST_LOG_SEV(core::Logger::get(), boost::log::trivial::info)
-#define LOG_WARNING BOOST_LOG_SEV(core::Logger::get(), boost::log::trivial::warning)
-#define LOG_ERROR   BOOST_LOG_SEV(core::Logger::get(), boost::log::trivial::error)
-#define LOG_FATAL   BOOST_LOG_SEV(core::Logger::get(), boost::log::trivial::fatal)
+// Convenience macros for logging. The level check happens before any
+// argument is evaluated, so disabled levels cost a single load. The loop
+// runs at most once and, unlike an if/else, cannot capture the else of an
+// unbraced if around the statement.
+#define CORE_LOG(level) \
+    for (bool core_log_once_ = core::Logger::enabled(level); core_log_once_; core_log_once_ = false) \
+        core::LogRecord(level)
 
+#define LOG_TRACE   CORE_LOG(core::LogLevel::trace)
+#define LOG_DEBUG   CORE_LOG(core::LogLevel::debug)
+#define LOG_INFO    CORE_LOG(core::LogLevel::info)
+#define LOG_WARNING CORE_LOG(core::LogLevel::warning)
+#define LOG_ERROR   CORE_LOG(core::LogLevel::error)
+#define LOG_FATAL   CORE_LOG(core::LogLevel::fatal)
+
+// Asynchronous logger.
+// Every thread writes records into its own lock-free ring buffer. Arguments
+// are stored in a compact binary form, and a background thread formats them
+// (timestamp, level, thread id, message) and writes them to the log file and
+// the console, so logging never formats text or does IO on the caller thread.
+// The background thread sleeps until a record is published to it.
+//
+// The log file is rotated at local midnight and when it reaches
+// ROTATION_SIZE. The previous files are kept as <file>.1 (the most recent)
+// to <file>.<ROTATED_FILES>.
 class Logger {
 public:
-    static void init(const std::string& log_file = "webserver.log") {
-        namespace logging = boost::log;
-        namespace keywords = boost::log::keywords;
-        namespace expr = boost::log::expressions;
-
-        // Create logs directory if it doesn't exist
-        std::filesystem::create_directories("logs");
-        
-        // Construct full log path
-        auto log_path = std::filesystem::path("logs") / log_file;
-
-        // Setup file sink
-        logging::add_file_log(
-            keywords::file_name = log_path.string(),
-            keywords::rotation_size = 10 * 1024 * 1024,  // 10MB
-            keywords::time_based_rotation = logging::sinks::file::rotation_at_time_point(0, 0, 0),
-            keywords::format = (
-                expr::stream
-                    << expr::format_date_time<boost::posix_time::ptime>("TimeStamp", "%Y-%m-%d %H:%M:%S.%f")
-                    << " [" << expr::attr<logging::trivial::severity_level>("Severity") << "]"
-                    << " [" << expr::attr<logging::attributes::current_thread_id::value_type>("ThreadID") << "]"
-                    << " " << expr::smessage
-            )
-        );
-
-        // Add common attributes
-        logging::add_common_attributes();
-        logging::core::get()->add_global_attribute("ThreadID", logging::attributes::current_thread_id());
-
-        // Set the minimum severity level
-        logging::core::get()->set_filter(
-            logging::trivial::severity >= logging::trivial::info
-        );
-
-        // Use direct logging instead of macro
-        BOOST_LOG_SEV(get(), boost::log::trivial::info) 
-            << "Logger initialized. Log file: " << log_path.string();
+    static constexpr std::size_t ROTATION_SIZE = 10 * 1024 * 1024;  // 10MB
+    static constexpr int ROTATED_FILES = 7;
+
+    // Open logs/<log_file> and start the background thread
+    static void init(const std::string& log_file = "webserver.log",
+                     LogOverflowPolicy policy = LogOverflowPolicy::drop,
+                     bool console = true);
+
+    // Wait until everything logged so far has been written
+    static void flush();
+
+    // Flush and stop the background thread, later records are discarded
+    static void shutdown();
+
+    static bool enabled(LogLevel level) {
+        return static_cast<int>(level) >= min_level_.load(std::memory_order_relaxed);
+    }
+
+    static void setLevel(LogLevel level) {
+        min_level_.store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+
+    // Records discarded because a thread's buffer was full
+    static std::uint64_t droppedRecords();
+
+private:
+    // Nothing is enabled until init() has started the background thread
+    static inline std::atomic<int> min_level_{static_cast<int>(LogLevel::off)};
+};
+
+// A single log record, written straight into the calling thread's buffer and
+// published when the statement ends.
+class LogRecord {
+public:
+    static constexpr std::size_t PAYLOAD_SIZE = 464;
+
+    // Argument tags of the binary payload
+    enum class Tag : char {
+        string,
+        signed_int,
+        unsigned_int,
+        floating,
+        character,
+        boolean,
+        pointer
+    };
+
+    explicit LogRecord(LogLevel level);
+    ~LogRecord();
+
+    LogRecord(const LogRecord&) = delete;
+    LogRecord& operator=(const LogRecord&) = delete;
+
+    template <typename T>
+    LogRecord& operator<<(const T& value) {
+        if (!data_) {
+            return *this;
+        }
+
+        if constexpr (std::is_same_v<T, bool>) {
+            putValue(Tag::boolean, value);
+        } else if constexpr (std::is_same_v<T, char>) {
+            putValue(Tag::character, value);
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            putValue(Tag::signed_int, static_cast<std::int64_t>(value));
+        } else if constexpr (std::is_integral_v<T>) {
+            putValue(Tag::unsigned_int, static_cast<std::uint64_t>(value));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            putValue(Tag::floating, static_cast<double>(value));
+        } else if constexpr (std::is_same_v<T, std::filesystem::path>) {
+            // Match the quoting of operator<< for paths
+            putString("\"");
+            putString(value.native());
+            putString("\"");
+        } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            if constexpr (std::is_pointer_v<T>) {
+                putString(value ? std::string_view(value) : std::string_view("(null)"));
+            } else {
+                putString(std::string_view(value));
+            }
+        } else if constexpr (HasCharData<T>::value) {
+            putString(std::string_view(value.data(), value.size()));
+        } else if constexpr (std::is_pointer_v<T>) {
+            putValue(Tag::pointer, reinterpret_cast<std::uintptr_t>(value));
+        } else if constexpr (std::is_enum_v<T>) {
+            putValue(Tag::signed_int, static_cast<std::int64_t>(value));
+        } else {
+            // Types without a compact encoding are formatted here
+            std::ostringstream stream;
+            stream << value;
+            putString(stream.str());
+        }
+        return *this;
     }
 
-    static boost::log::sources::severity_logger<boost::log::trivial::severity_level>& get() {
-        static boost::log::sources::severity_logger<boost::log::trivial::severity_level> logger;
-        return logger;
+private:
+    template <typename T, typename = void>
+    struct HasCharData : std::false_type {};
+
+    template <typename T>
+    struct HasCharData<T, std::void_t<decltype(std::declval<const T&>().data()),
+                                      decltype(std::declval<const T&>().size())>>
+        : std::is_same<std::decay_t<decltype(*std::declval<const T&>().data())>, char> {};
+
+    template <typename T>
+    void putValue(Tag tag, T value) {
+        if (used_ + 1 + sizeof(T) > PAYLOAD_SIZE) {
+            truncate();
+            return;
+        }
+        data_[used_++] = static_cast<char>(tag);
+        std::memcpy(data_ + used_, &value, sizeof(T));
+        used_ += sizeof(T);
     }
+
+    void putString(std::string_view text) {
+        constexpr std::size_t header = 1 + sizeof(std::uint16_t);
+        if (used_ + header >= PAYLOAD_SIZE) {
+            truncate();
+            return;
+        }
+        auto length = static_cast<std::uint16_t>(std::min(text.size(), PAYLOAD_SIZE - used_ - header));
+        data_[used_++] = static_cast<char>(Tag::string);
+        std::memcpy(data_ + used_, &length, sizeof(length));
+        used_ += sizeof(length);
+        std::memcpy(data_ + used_, text.data(), length);
+        used_ += length;
+        if (length < text.size()) {
+            truncate();
+        }
+    }
+
+    void truncate();
+
+    void* slot_{nullptr};
+    char* data_{nullptr};
+    std::size_t used_{0};
 };
 
-} // namespace core 
\ No newline at end of file
+} // namespace core
@@ -0,0 +1,198 @@
+#include "NativeEndpoint.hpp"
+#include <boost/beast/version.hpp>
+#include <stdexcept>
+#include <utility>
+
+using plugins::endpoint::EndpointPlugin;
+using plugins::endpoint::RouteParams;
+
+// The opaque types of EndpointAbi.h, views of the request being handled
+struct endpoint_request {
+    const EndpointPlugin::Request* req;
+    const RouteParams* params;
+};
+
+struct endpoint_response {
+    EndpointPlugin::Response* res;
+    bool failed;  // A host call could not be completed
+};
+
+namespace core {
+
+namespace {
+
+endpoint_string toEndpointString(std::string_view value) {
+    return {value.data(), value.size()};
+}
+
+endpoint_string toEndpointString(boost::beast::string_view value) {
+    return {value.data(), value.size()};
+}
+
+boost::beast::string_view toView(endpoint_string value) {
+    return {value.data ? value.data : "", value.size};
+}
+
+// Host functions. They are called from plugin code that may be C, so an
+// exception must not leave them.
+
+endpoint_string hostMethod(const endpoint_request* req) {
+    return toEndpointString(req->req->method_string());
+}
+
+endpoint_string hostTarget(const endpoint_request* req) {
+    return toEndpointString(req->req->target());
+}
+
+endpoint_string hostHeader(const endpoint_request* req, endpoint_string name) {
+    auto it = req->req->find(toView(name));
+    if (it == req->req->end()) {
+        return {nullptr, 0};
+    }
+    return toEndpointString(it->value());
+}
+
+endpoint_string hostBody(const endpoint_request* req) {
+    return toEndpointString(std::string_view(req->req->body()));
+}
+
+endpoint_string hostParam(const endpoint_request* req, endpoint_string name) {
+    return toEndpointString(req->params->get(std::string_view(name.data ? name.data : "", name.size)));
+}
+
+endpoint_string hostQuery(const endpoint_request* req) {
+    return toEndpointString(req->params->query());
+}
+
+void hostSetStatus(endpoint_response* res, unsigned status) {
+    if (status < 100 || status > 999) {
+        res->failed = true;
+        return;
+    }
+    res->res->result(status);
+}
+
+void hostSetHeader(endpoint_response* res, endpoint_string name, endpoint_string value) {
+    try {
+        res->res->set(toView(name), toView(value));
+    } catch (const std::exception&) {
+        res->failed = true;
+    }
+}
+
+void hostAppendBody(endpoint_response* res, endpoint_string data) {
+    try {
+        res->res->body().text().append(data.data ? data.data : "", data.size);
+    } catch (const std::exception&) {
+        res->failed = true;
+    }
+}
+
+const endpoint_host_v1 HOST = {
+    ENDPOINT_ABI_VERSION,
+    hostMethod,
+    hostTarget,
+    hostHeader,
+    hostBody,
+    hostParam,
+    hostQuery,
+    hostSetStatus,
+    hostSetHeader,
+    hostAppendBody,
+};
+
+} // namespace
+
+const endpoint_host_v1& endpointHost() {
+    return HOST;
+}
+
+EndpointPlugin::Response callNative(const endpoint_route_v1& route,
+                                    const EndpointPlugin::Request& req,
+                                    const RouteParams& params) {
+    endpoint_request request{&req, &params};
+    EndpointPlugin::Response res{http::status::ok, req.version()};
+    res.keep_alive(req.keep_alive());
+    endpoint_response response{&res, false};
+
+    if (route.handler(route.context, &request, &response) != 0 || response.failed) {
+        res = EndpointPlugin::Response{http::status::internal_server_error, req.version()};
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::content_type, "text/html");
+        res.keep_alive(req.keep_alive());
+        res.body() = "Internal server error";
+    }
+    res.prepare_payload();
+    return res;
+}
+
+NativeEndpoint::NativeEndpoint(const endpoint_route_v1& route)
+    : route_(route)
+    , method_(route.method)
+    , path_(route.path) {
+}
+
+NativeEndpoint::CachePolicy NativeEndpoint::getCachePolicy() const {
+    return {std::chrono::milliseconds(route_.cache_ttl_ms), {}};
+}
+
+std::vector<NativeEndpoint::WarmupRequest> NativeEndpoint::getWarmupRequests() const {
+    if (!route_.warmup_target) {
+        return {};
+    }
+    return {{route_.warmup_target}};
+}
+
+NativeEndpoint::RouteHandler NativeEndpoint::createRouteHandler() const {
+    return [route = route_](const Request& req, const RouteParams& params) {
+        return callNative(route, req, params);
+    };
+}
+
+std::shared_ptr<NativeEndpoints> NativeEndpoints::create(const endpoint_table_v1* table) {
+    if (!table) {
+        throw std::runtime_error("Plugin returned no endpoint table");
+    }
+    if (table->abi_version != ENDPOINT_ABI_VERSION) {
+        throw std::runtime_error("Endpoint table has version " + std::to_string(table->abi_version) +
+                                 ", the server reads " + std::to_string(ENDPOINT_ABI_VERSION));
+    }
+    if (!table->name || table->route_count == 0 || !table->routes) {
+        throw std::runtime_error("Endpoint table lacks a name or routes");
+    }
+
+    std::vector<std::shared_ptr<EndpointPlugin>> endpoints;
+    endpoints.reserve(table->route_count);
+    for (std::size_t i = 0; i < table->route_count; ++i) {
+        const auto& route = table->routes[i];
+        if (!route.method || !route.path || !route.handler) {
+            throw std::runtime_error("Route " + std::to_string(i) + " of the endpoint table lacks a method, "
+                                     "path or handler");
+        }
+        endpoints.push_back(std::make_shared<NativeEndpoint>(route));
+    }
+    return std::shared_ptr<NativeEndpoints>(new NativeEndpoints(*table, std::move(endpoints)));
+}
+
+NativeEndpoints::NativeEndpoints(const endpoint_table_v1& table,
+                                 std::vector<std::shared_ptr<EndpointPlugin>> endpoints)
+    : EndpointSet(table.name, std::move(endpoints))
+    , table_(table) {
+}
+
+void NativeEndpoints::initialize() {
+    if (table_.initialize) {
+        if (int result = table_.initialize(); result != 0) {
+            throw std::runtime_error("Endpoint table initialize() returned " + std::to_string(result));
+        }
+    }
+}
+
+void NativeEndpoints::cleanup() {
+    EndpointSet::cleanup();
+    if (table_.cleanup) {
+        table_.cleanup();
+    }
+}
+
+} // namespace core
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "EndpointAbi.h"
+#include "../plugins/endpoints/EndpointPlugin.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace core {
+
+// A route of a plugin that exports a C endpoint table (EndpointAbi.h). It
+// looks like any other endpoint to the plugin manager, and the route table
+// calls its handler pointer directly instead of going through a
+// std::function.
+class NativeEndpoint : public plugins::endpoint::EndpointPlugin {
+public:
+    explicit NativeEndpoint(const endpoint_route_v1& route);
+
+    std::string getName() const override { return method_ + " " + path_; }
+    void initialize() override {}
+
+    std::string getPath() const override { return path_; }
+    std::string getMethod() const override { return method_; }
+    CachePolicy getCachePolicy() const override;
+    std::vector<WarmupRequest> getWarmupRequests() const override;
+    bool isBlocking() const override { return route_.blocking != 0; }
+
+    const endpoint_route_v1& route() const { return route_; }
+
+protected:
+    RouteHandler createRouteHandler() const override;
+
+private:
+    endpoint_route_v1 route_;
+    std::string method_;
+    std::string path_;
+};
+
+// The routes of a library exporting a C endpoint table, loaded and replaced
+// together like an EndpointSet
+class NativeEndpoints : public plugins::endpoint::EndpointSet {
+public:
+    // Throws std::runtime_error if the table is not one the server reads
+    static std::shared_ptr<NativeEndpoints> create(const endpoint_table_v1* table);
+
+    void initialize() override;
+    void cleanup() override;
+
+private:
+    NativeEndpoints(const endpoint_table_v1& table,
+                    std::vector<std::shared_ptr<plugins::endpoint::EndpointPlugin>> endpoints);
+
+    const endpoint_table_v1& table_;
+};
+
+// Functions of the server handed to a plugin's endpoint table entry point
+const endpoint_host_v1& endpointHost();
+
+// Call the handler of a C endpoint route and build its response
+plugins::endpoint::EndpointPlugin::Response callNative(const endpoint_route_v1& route,
+                                                       const plugins::endpoint::EndpointPlugin::Request& req,
+                                                       const plugins::endpoint::RouteParams& params);
+
+} // namespace core
@@ -0,0 +1,133 @@
+#include "Payload.hpp"
+#include <boost/asio/error.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <linux/openat2.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace core {
+
+namespace {
+
+std::string descriptorPath(int fd) {
+    char link[64];
+    std::snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    char target[4096];
+    auto size = ::readlink(link, target, sizeof(target));
+    return size > 0 ? std::string(target, static_cast<std::size_t>(size)) : std::string();
+}
+
+// Whether the file behind fd lies inside the directory behind directory
+bool isBeneath(int directory, int fd) {
+    auto root = descriptorPath(directory);
+    auto path = descriptorPath(fd);
+    if (root.empty() || path.empty()) {
+        return false;
+    }
+    if (root.back() != '/') {
+        root.push_back('/');
+    }
+    return path.compare(0, root.size(), root) == 0;
+}
+
+} // namespace
+
+std::shared_ptr<const File> File::open(const char* path, std::error_code& ec) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ec.assign(errno, std::generic_category());
+        return nullptr;
+    }
+    return adopt(fd, ec);
+}
+
+std::shared_ptr<const File> File::openBeneath(int directory, const char* path, std::error_code& ec) {
+    open_how how{};
+    how.flags = O_RDONLY | O_CLOEXEC;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+    int fd = static_cast<int>(::syscall(SYS_openat2, directory, path, &how, sizeof(how)));
+    if (fd < 0 && errno == ENOSYS) {
+        // Kernels before 5.6: check where the opened descriptor points
+        fd = ::openat(directory, path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0 && !isBeneath(directory, fd)) {
+            ::close(fd);
+            fd = -1;
+            errno = EXDEV;
+        }
+    }
+    if (fd < 0) {
+        ec.assign(errno, std::generic_category());
+        return nullptr;
+    }
+    return adopt(fd, ec);
+}
+
+std::shared_ptr<const File> File::adopt(int fd, std::error_code& ec) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ec.assign(errno, std::generic_category());
+        ::close(fd);
+        return nullptr;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        ec = std::make_error_code(S_ISDIR(st.st_mode) ? std::errc::is_a_directory
+                                                      : std::errc::invalid_argument);
+        ::close(fd);
+        return nullptr;
+    }
+
+    ec.clear();
+    return std::shared_ptr<const File>(new File(fd, static_cast<std::uint64_t>(st.st_size), st.st_mtime));
+}
+
+File::~File() {
+    ::close(fd_);
+}
+
+boost::optional<std::pair<PayloadBody::const_buffers_type, bool>>
+PayloadBody::writer::get(boost::beast::error_code& ec) {
+    ec = {};
+
+    if (!body_.isFile()) {
+        if (done_ || body_.size() == 0) {
+            return boost::none;
+        }
+        done_ = true;
+        return std::make_pair(
+            const_buffers_type(boost::asio::buffer(body_.text()), body_.buffersBegin(), body_.buffersEnd()),
+            false);
+    }
+
+    // Fallback for writers that cannot use sendfile()
+    const auto& region = body_.file();
+    if (file_sent_ == region.length) {
+        return boost::none;
+    }
+    if (!chunk_) {
+        chunk_.reset(new char[FILE_CHUNK_SIZE]);
+    }
+
+    auto wanted = static_cast<std::size_t>(std::min<std::uint64_t>(FILE_CHUNK_SIZE, region.length - file_sent_));
+    ssize_t n = ::pread(region.file->fd(), chunk_.get(), wanted,
+                        static_cast<off_t>(region.offset + file_sent_));
+    if (n < 0) {
+        ec.assign(errno, boost::system::system_category());
+        return boost::none;
+    }
+    if (n == 0) {
+        // The file shrank after the response was built
+        ec = boost::asio::error::eof;
+        return boost::none;
+    }
+
+    file_sent_ += static_cast<std::uint64_t>(n);
+    current_ = boost::asio::const_buffer(chunk_.get(), static_cast<std::size_t>(n));
+    return std::make_pair(const_buffers_type(current_, nullptr, nullptr), file_sent_ < region.length);
+}
+
+} // namespace core
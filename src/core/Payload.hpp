@@ -0,0 +1,252 @@
+#pragma once
+
+#include "Arena.hpp"
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace core {
+
+// A file opened once and shared by every response that sends part of it.
+// The descriptor is closed when the last reference goes away.
+class File {
+public:
+    static std::shared_ptr<const File> open(const char* path, std::error_code& ec);
+    static std::shared_ptr<const File> open(const std::filesystem::path& path, std::error_code& ec) {
+        return open(path.c_str(), ec);
+    }
+
+    // Open path relative to the directory descriptor. Fails with EXDEV if
+    // the path resolves outside of the directory, through ".." or a symlink.
+    static std::shared_ptr<const File> openBeneath(int directory, const char* path, std::error_code& ec);
+
+    ~File();
+
+    // Prevent copying
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    int fd() const { return fd_; }
+    std::uint64_t size() const { return size_; }
+    std::time_t modifiedTime() const { return modified_; }
+
+private:
+    File(int fd, std::uint64_t size, std::time_t modified)
+        : fd_(fd), size_(size), modified_(modified) {}
+
+    // Take over an open descriptor, closes it on failure
+    static std::shared_ptr<const File> adopt(int fd, std::error_code& ec);
+
+    int fd_;
+    std::uint64_t size_;
+    std::time_t modified_;
+};
+
+// Part of a file sent with sendfile()
+struct FileRegion {
+    std::shared_ptr<const File> file;
+    std::uint64_t offset{0};
+    std::uint64_t length{0};
+};
+
+// Response body that is sent without being copied into the response.
+// A payload holds one of:
+//   - owned text, what a plain std::string body used to be
+//   - owned text followed by immutable buffers shared with other responses
+//   - a file region, which the server sends with sendfile()
+// Shared buffers are kept alive by an owner pointer until the write is done.
+// A session pins the plugins it routed a request to until the response has
+// been written, so an owner created by a plugin is released while the
+// plugin's library is still loaded.
+class Payload {
+public:
+    Payload() = default;
+    Payload(std::string text) : text_(std::move(text)) {}
+    Payload(const char* text) : text_(text) {}
+
+    Payload& operator=(std::string text) {
+        clear();
+        text_ = std::move(text);
+        return *this;
+    }
+
+    Payload& operator=(const char* text) {
+        return *this = std::string(text);
+    }
+
+    // Owned text, sent before any shared buffers
+    std::string& text() { return text_; }
+    const std::string& text() const { return text_; }
+
+    // Append an immutable buffer without copying it
+    void append(std::shared_ptr<const std::string> buffer) {
+        auto data = boost::asio::buffer(*buffer);
+        append(data, std::move(buffer));
+    }
+
+    void append(boost::asio::const_buffer data, std::shared_ptr<const void> owner) {
+        file_.file.reset();
+        buffers_.push_back(data);
+        owners_.push_back(std::move(owner));
+    }
+
+    // Send a region of an open file instead of memory
+    void setFile(std::shared_ptr<const File> file, std::uint64_t offset, std::uint64_t length) {
+        clear();
+        file_ = FileRegion{std::move(file), offset, length};
+    }
+
+    // Send a whole file
+    void setFile(std::shared_ptr<const File> file) {
+        auto size = file->size();
+        setFile(std::move(file), 0, size);
+    }
+
+    bool isFile() const { return file_.file != nullptr; }
+    const FileRegion& file() const { return file_; }
+
+    const boost::asio::const_buffer* buffersBegin() const { return buffers_.data(); }
+    const boost::asio::const_buffer* buffersEnd() const { return buffers_.data() + buffers_.size(); }
+
+    std::uint64_t size() const {
+        if (isFile()) {
+            return file_.length;
+        }
+        auto total = static_cast<std::uint64_t>(text_.size());
+        for (const auto& buffer : buffers_) {
+            total += buffer.size();
+        }
+        return total;
+    }
+
+    void clear() {
+        text_.clear();
+        buffers_.clear();
+        owners_.clear();
+        file_ = FileRegion{};
+    }
+
+private:
+    std::string text_;
+    // Allocated from the current arena like the header fields
+    std::vector<boost::asio::const_buffer, ArenaAllocator<boost::asio::const_buffer>> buffers_;
+    std::vector<std::shared_ptr<const void>, ArenaAllocator<std::shared_ptr<const void>>> owners_;
+    FileRegion file_;
+};
+
+// Beast body type for Payload
+struct PayloadBody {
+    using value_type = Payload;
+
+    static std::uint64_t size(const value_type& body) { return body.size(); }
+
+    // The text followed by a run of contiguous const_buffers, so both go out
+    // in one write. A header written alone ahead of the body would wait on
+    // Nagle for the peer's delayed ACK.
+    class const_buffers_type {
+    public:
+        using value_type = boost::asio::const_buffer;
+
+        class const_iterator {
+        public:
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = boost::asio::const_buffer;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type*;
+            using reference = value_type;
+
+            const_iterator() = default;
+            // Self-contained, Beast copies sequences and keeps their iterators
+            const_iterator(value_type head, bool at_head, const value_type* begin, const value_type* at)
+                : head_(head), at_head_(at_head), begin_(begin), at_(at) {}
+
+            reference operator*() const { return at_head_ ? head_ : *at_; }
+            const_iterator& operator++() {
+                if (at_head_) {
+                    at_head_ = false;
+                } else {
+                    ++at_;
+                }
+                return *this;
+            }
+            const_iterator operator++(int) {
+                auto old = *this;
+                ++*this;
+                return old;
+            }
+            const_iterator& operator--() {
+                if (at_ == begin_) {
+                    at_head_ = true;
+                } else {
+                    --at_;
+                }
+                return *this;
+            }
+            const_iterator operator--(int) {
+                auto old = *this;
+                --*this;
+                return old;
+            }
+            bool operator==(const const_iterator& other) const {
+                return at_head_ == other.at_head_ && at_ == other.at_;
+            }
+            bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+        private:
+            value_type head_;
+            bool at_head_ = false;
+            const value_type* begin_ = nullptr;
+            const value_type* at_ = nullptr;
+        };
+
+        // An empty head is skipped
+        const_buffers_type(value_type head, const value_type* begin, const value_type* end)
+            : head_(head), begin_(begin), end_(end) {}
+
+        const_iterator begin() const { return {head_, head_.size() != 0, begin_, begin_}; }
+        const_iterator end() const { return {head_, false, begin_, end_}; }
+
+    private:
+        value_type head_;
+        const value_type* begin_;
+        const value_type* end_;
+    };
+
+    // Produces the buffers to write. The server sends file regions with
+    // sendfile() and never asks the writer for them, other writers (for
+    // example a synchronous http::write) get the file in chunks.
+    class writer {
+    public:
+        using const_buffers_type = PayloadBody::const_buffers_type;
+
+        static constexpr std::size_t FILE_CHUNK_SIZE = 64 * 1024;
+
+        template <bool isRequest, class Fields>
+        writer(const boost::beast::http::header<isRequest, Fields>&, const value_type& body)
+            : body_(body) {}
+
+        void init(boost::beast::error_code& ec) { ec = {}; }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(boost::beast::error_code& ec);
+
+    private:
+        const value_type& body_;
+        boost::asio::const_buffer current_;
+        bool done_{false};
+        std::uint64_t file_sent_{0};
+        std::unique_ptr<char[]> chunk_;
+    };
+};
+
+} // namespace core
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "EndpointAbi.h"
 #include <string>
 #include <memory>
 
@@ -25,8 +26,34 @@ using CreatePluginFunc = std::shared_ptr<Plugin>(*)();
 
 } // namespace core
 
+// Version of the interface between the server and its plugins. Bump it with
+// every change to the classes plugins derive from or the types they share.
+#define PLUGIN_ABI_VERSION 3
+
+// Describe the plugin in a section of its own, so the server can read it
+// from the file without loading the library:
+//   PLUGIN_MANIFEST("HelloEndpoint", "endpoint", PLUGIN_ROUTE("GET", "/hello"))
+// The routes must match what the plugin reports once it is loaded.
+#define PLUGIN_MANIFEST(name, type, routes) \
+    extern "C" __attribute__((used, section(PLUGIN_MANIFEST_SECTION))) \
+    const char webserverPluginManifest[] = \
+        "abi=" PLUGIN_STRINGIZE(PLUGIN_ABI_VERSION) "\n" \
+        "name=" name "\n" \
+        "type=" type "\n" \
+        routes;
+
 // Macro to export plugin creation function
 #define EXPORT_PLUGIN(PluginClass) \
     extern "C" std::shared_ptr<core::Plugin> createPlugin() { \
         return std::make_shared<PluginClass>(); \
     }
+
+// Export several endpoint classes from one library, served and replaced
+// together (see plugins::endpoint::EndpointSet). The manifest lists the
+// routes of all of them:
+//   PLUGIN_MANIFEST("Users", "endpoint", PLUGIN_ROUTE("GET", "/users") PLUGIN_ROUTE("POST", "/users"))
+//   EXPORT_ENDPOINTS("Users", ListUsers, CreateUser)
+#define EXPORT_ENDPOINTS(name, ...) \
+    extern "C" std::shared_ptr<core::Plugin> createPlugin() { \
+        return plugins::endpoint::makeEndpointSet<__VA_ARGS__>(name); \
+    }
@@ -1,20 +1,113 @@
 #include "PluginManager.hpp"
 #include "../plugins/endpoints/EndpointPlugin.hpp"
-#include <iostream>
+#include "Arena.hpp"
+#include "Logger.hpp"
+#include "PluginManifest.hpp"
+#include "WorkerPool.hpp"
 #include <chrono>
 #include <thread>
-#include <future>
 #include <algorithm>
+#include <functional>
+#include <iterator>
 #include <map>
 #include <fstream>
+#include <optional>
+#include <cstring>
+#include <link.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include <utility>
 
 using namespace plugins::endpoint;
 
 namespace core {
 
+namespace {
+
+// SHA-256 of a file as lowercase hex, empty if it cannot be read
+std::string sha256Hex(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return {};
+    }
+
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+    if (!ctx || EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr) != 1) {
+        return {};
+    }
+
+    std::vector<char> buffer(64 * 1024);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        if (file.gcount() > 0) {
+            EVP_DigestUpdate(ctx.get(), buffer.data(), static_cast<std::size_t>(file.gcount()));
+        }
+    }
+    if (file.bad()) {
+        return {};
+    }
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx.get(), digest, &length);
+
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(length * 2);
+    for (unsigned int i = 0; i < length; ++i) {
+        result.push_back(hex[digest[i] >> 4]);
+        result.push_back(hex[digest[i] & 0xf]);
+    }
+    return result;
+}
+
+// The routes ("METHOD path") a plugin serves, sorted
+std::vector<std::string> routesOf(const std::shared_ptr<Plugin>& plugin) {
+    std::vector<std::string> routes;
+    for (const auto& endpoint : endpointsOf(plugin)) {
+        routes.push_back(endpoint->getMethod() + " " + endpoint->getPath());
+    }
+    std::sort(routes.begin(), routes.end());
+    return routes;
+}
+
+// Whether two sorted lists of routes share one
+bool overlaps(const std::vector<std::string>& a, const std::vector<std::string>& b) {
+    for (auto i = a.begin(), j = b.begin(); i != a.end() && j != b.end();) {
+        if (*i == *j) {
+            return true;
+        }
+        *i < *j ? ++i : ++j;
+    }
+    return false;
+}
+
+// Name of a set of sorted routes in the backup store: the route itself for
+// a single one, otherwise all of them separated by ", "
+std::string routeKey(const std::vector<std::string>& routes) {
+    std::string key;
+    for (const auto& route : routes) {
+        if (!key.empty()) {
+            key += ", ";
+        }
+        key += route;
+    }
+    return key;
+}
+
+// Routes for a log line, counted once there are several
+std::string describeRoutes(const std::vector<std::string>& routes) {
+    return routes.size() == 1 ? routes.front() : std::to_string(routes.size()) + " routes";
+}
+
+} // namespace
+
 PluginManager::PluginManager()
     : loader_(std::make_shared<DynamicLoader>())
-    , monitor_(std::make_shared<FileMonitor>()) {
+    , monitor_(std::make_shared<FileMonitor>())
+    , scheduler_(std::make_shared<ReloadScheduler>()) {
+    std::lock_guard<std::mutex> lock(plugins_mutex_);
+    publishRoutes();
 }
 
 PluginManager::~PluginManager() {
@@ -24,66 +117,392 @@ PluginManager::~PluginManager() {
 
 void PluginManager::cleanupPlugins() {
     std::lock_guard<std::mutex> lock(plugins_mutex_);
+    for (const auto& [live_path, shadow] : shadows_) {
+        shadow->stop();
+    }
+    shadows_.clear();
     plugins_.clear(); // This will trigger plugin cleanup through shared_ptr
+    publishRoutes();
 }
 
-void PluginManager::initialize(const std::filesystem::path& pluginDir) {
-    plugin_directory_ = std::filesystem::absolute(pluginDir);
-    
-    if (!std::filesystem::exists(plugin_directory_)) {
-        std::filesystem::create_directories(plugin_directory_);
-    }
-
-    // Set up file monitoring for .so files
-    monitor_->addWatch(
-        plugin_directory_,
-        ".*\\.so$",
-        [this](const std::filesystem::path& path) { 
-            std::cout << "New file detected: " << path << std::endl;
-            onPluginWriteComplete(path); 
-        },
-        [this](const std::filesystem::path& path) { 
-            std::cout << "File modified: " << path << std::endl;
-            onPluginWriteComplete(path); 
-        },
-        [this](const std::filesystem::path& path) { onDeletedPlugin(path); },
-        [this](const std::filesystem::path& path) { onPluginWriteComplete(path); }
-    );
+void PluginManager::publishRoutes() {
+    std::vector<RouteTable::Route> routes;
+    routes.reserve(plugins_.size());
+
+    // Endpoints that stay loaded keep their response cache, a new version
+    // of an endpoint starts with an empty one
+    std::unordered_map<const EndpointPlugin*, const RouteTable::Route*> cached;
+    if (const auto* current = route_table_.load(std::memory_order_relaxed)) {
+        for (const auto& route : current->routes()) {
+            if (route.cache) {
+                cached.emplace(route.plugin.get(), &route);
+            }
+        }
+    }
+
+    for (const auto& [path, plugin] : plugins_) {
+        for (const auto& endpoint : endpointsOf(plugin)) {
+            auto method = http::string_to_verb(endpoint->getMethod());
+            if (method == http::verb::unknown) {
+                LOG_ERROR << "Skipping endpoint with unsupported method " << endpoint->getMethod()
+                          << ": " << path;
+                continue;
+            }
+
+            auto pattern = endpoint->getPath();
+            try {
+                RouteTable::validatePattern(pattern);
+            } catch (const std::invalid_argument& e) {
+                LOG_ERROR << "Skipping endpoint with invalid route: " << e.what();
+                continue;
+            }
+
+            // Resolve the handlers now so the request path never builds them lazily
+            auto route = RouteTable::routeFor(method, std::move(pattern), endpoint);
+            if (!route.async_handler && !route.handler) {
+                LOG_ERROR << "Skipping endpoint without a handler " << endpoint->getMethod() << " "
+                          << route.path << ": " << path;
+                continue;
+            }
+
+            if (auto it = cached.find(endpoint.get()); it != cached.end()) {
+                route.cache = it->second->cache;
+                cached.erase(it);
+            } else if (auto policy = endpoint->getCachePolicy(); policy.ttl.count() > 0) {
+                route.cache = std::make_shared<ResponseCache>(std::move(policy));
+            }
+            if (auto it = shadows_.find(path); it != shadows_.end()) {
+                route.shadow = it->second;
+            }
+            routes.push_back(std::move(route));
+        }
+    }
+
+    // Whatever is left belonged to endpoints that were replaced or unloaded
+    for (const auto& [plugin, route] : cached) {
+        LOG_INFO << "Flushing response cache of route " << route->path;
+        route->cache->retire();
+    }
+
+    auto table = std::make_shared<const RouteTable>(std::move(routes));
+    for (const auto& conflict : table->conflicts()) {
+        LOG_ERROR << "Not serving " << http::to_string(conflict.route->method) << " "
+                  << conflict.route->path << ": " << conflict.reason;
+    }
+    route_table_.store(table.get(), std::memory_order_release);
+    if (current_table_) {
+        Epoch::retire([retired = std::move(current_table_)]() mutable { retired.reset(); });
+    }
+    current_table_ = std::move(table);
+}
+
+void PluginManager::initialize(const std::vector<std::filesystem::path>& pluginDirs) {
+    for (const auto& dir : pluginDirs) {
+        auto const abs_dir = std::filesystem::absolute(dir).lexically_normal();
+        if (!std::filesystem::exists(abs_dir)) {
+            std::filesystem::create_directories(abs_dir);
+        }
+        // A directory inside another one is already part of its tree,
+        // whichever of the two was given first
+        auto const inside = [](const std::filesystem::path& dir, const std::filesystem::path& root) {
+            auto const rel = dir.lexically_relative(root);
+            return !rel.empty() && *rel.begin() != "..";
+        };
+        auto const nested = std::find_if(plugin_directories_.begin(), plugin_directories_.end(),
+            [&](const std::filesystem::path& root) { return inside(abs_dir, root); });
+        if (nested != plugin_directories_.end()) {
+            LOG_WARNING << "Plugin directory " << abs_dir << " is already watched as part of " << *nested;
+            continue;
+        }
+
+        // The new directory takes the place of the first one it contains,
+        // so the backups stay in the first tree
+        bool placed = false;
+        for (auto it = plugin_directories_.begin(); it != plugin_directories_.end();) {
+            if (!inside(*it, abs_dir)) {
+                ++it;
+                continue;
+            }
+            LOG_WARNING << "Plugin directory " << *it << " is watched as part of " << abs_dir;
+            if (!placed) {
+                *it++ = abs_dir;
+                placed = true;
+            } else {
+                it = plugin_directories_.erase(it);
+            }
+        }
+        if (!placed) {
+            plugin_directories_.push_back(abs_dir);
+        }
+    }
+    if (plugin_directories_.empty()) {
+        throw std::invalid_argument("No plugin directory");
+    }
+
+    // Set up file monitoring for .so files and their checksum sidecars. The
+    // monitor reports a plugin once it is closed after writing or renamed
+    // into place, and not at all if its contents did not change. Hidden
+    // directories hold the backups, and maybe a version control checkout.
+    WatchOptions options;
+    options.fingerprint = true;
+    options.recursive = true;
+    options.skipHidden = true;
+    for (const auto& root : plugin_directories_) {
+        LOG_INFO << "Watching plugins in " << root;
+        monitor_->addWatch(
+            root,
+            ".*\\.so(\\.sha256)?$",
+            [this](const std::filesystem::path& path, FileEvent event) {
+                if (event == FileEvent::removed) {
+                    onDeletedPlugin(path);
+                } else {
+                    onPluginWriteComplete(path);
+                }
+            },
+            options
+        );
+    }
+
+    // Versions of older releases go into the store first, so the ones
+    // loaded now are recorded as the newest
+    backups_ = std::make_shared<BackupStore>(plugin_directories_.front() / BACKUP_DIRECTORY);
+    importLegacyBackups();
 
     // Load any existing plugins
-    cleanupOldBackups(); // Clean up old backups before loading
-    
-    // Find the newest .so file
-    std::filesystem::path newest_plugin;
-    std::filesystem::file_time_type newest_time;
-    
-    for (const auto& entry : std::filesystem::directory_iterator(plugin_directory_)) {
-        if (isPluginFile(entry.path())) {
-            auto mod_time = std::filesystem::last_write_time(entry.path());
-            if (newest_plugin.empty() || mod_time > newest_time) {
-                newest_plugin = entry.path();
-                newest_time = mod_time;
+    loadExistingPlugins();
+}
+
+void PluginManager::loadExistingPlugins() {
+    auto const start_time = std::chrono::steady_clock::now();
+
+    struct Candidate {
+        std::filesystem::path path;
+        std::filesystem::file_time_type modified;
+        std::vector<std::string> routes;
+    };
+    std::vector<Candidate> candidates;
+    std::size_t found = 0;
+
+    for (const auto& path : listPluginFiles()) {
+        ++found;
+
+        std::string why;
+        if (!isPluginReady(path, why)) {
+            LOG_INFO << "Plugin not ready: " << path << ": " << why;
+            continue;
+        }
+
+        std::optional<PluginManifest> manifest;
+        std::vector<std::string> routes;
+        if (!inspectRoutes(path, manifest, routes)) {
+            continue;
+        }
+
+        std::error_code ec;
+        auto modified = std::filesystem::last_write_time(path, ec);
+        if (ec) {
+            continue;
+        }
+        candidates.push_back({path, modified, std::move(routes)});
+    }
+
+    // The newest file takes every route it serves, an older one serving any
+    // of them is left out as a whole
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate& a, const Candidate& b) { return a.modified > b.modified; });
+    std::vector<Candidate> newest;
+    std::set<std::string> claimed;
+    for (auto& candidate : candidates) {
+        bool const older = std::any_of(candidate.routes.begin(), candidate.routes.end(),
+                                       [&claimed](const std::string& route) { return claimed.count(route); });
+        if (older) {
+            LOG_INFO << "Ignoring older plugin for " << describeRoutes(candidate.routes) << ": " << candidate.path;
+            // Plugins without a manifest were loaded to be inspected
+            loader_->unloadPlugin(candidate.path.string());
+            continue;
+        }
+        claimed.insert(candidate.routes.begin(), candidate.routes.end());
+        newest.push_back(std::move(candidate));
+    }
+
+    if (newest.empty()) {
+        LOG_INFO << "No plugins to load";
+        return;
+    }
+
+    // Libraries are opened one at a time by the dynamic linker, but the
+    // plugins' initialize() runs concurrently, and it is often waiting on
+    // I/O rather than using a core
+    auto const threads = std::min<std::size_t>(
+        newest.size(), std::max<std::size_t>(STARTUP_LOAD_THREADS, std::thread::hardware_concurrency()));
+    std::vector<std::pair<std::filesystem::path, std::shared_ptr<Plugin>>> loaded;
+    loaded.reserve(newest.size());
+    std::mutex loaded_mutex;
+    {
+        WorkerPool pool(threads, newest.size());
+        for (const auto& candidate : newest) {
+            pool.trySubmit([this, route = routeKey(candidate.routes), path = candidate.path, &loaded,
+                            &loaded_mutex] {
+                LOG_INFO << "Attempting to load plugin: " << path;
+                std::shared_ptr<Plugin> plugin;
+                try {
+                    plugin = loadAndInitialize(path);
+                } catch (const std::exception& e) {
+                    LOG_ERROR << "Error loading plugin " << path << ": " << e.what();
+                }
+                if (!plugin) {
+                    loader_->unloadPlugin(path.string());
+                    return;
+                }
+                backups_->add(route, path, deployedName(path));
+                std::lock_guard<std::mutex> lock(loaded_mutex);
+                loaded.emplace_back(path, std::move(plugin));
+            });
+        }
+        pool.stop();
+    }
+
+    // Publish every plugin in one route table, before the server accepts
+    // connections
+    std::size_t routes = 0;
+    {
+        std::lock_guard<std::mutex> lock(plugins_mutex_);
+        for (auto& [path, plugin] : loaded) {
+            routes += endpointsOf(plugin).size();
+            plugins_[path.string()] = std::move(plugin);
+        }
+        publishRoutes();
+    }
+    {
+        std::lock_guard<std::mutex> lock(seen_versions_mutex_);
+        for (const auto& [path, plugin] : loaded) {
+            seen_versions_[path.string()] = fileVersion(path);
+        }
+    }
+
+    auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    LOG_INFO << "Loaded " << loaded.size() << " of " << newest.size() << " plugins serving " << routes
+             << " routes (" << found << " plugin files) with " << threads << " threads in "
+             << elapsed.count() / 1000.0 << " ms";
+}
+
+std::vector<std::filesystem::path> PluginManager::listPluginFiles() const {
+    std::vector<std::filesystem::path> files;
+    for (const auto& root : plugin_directories_) {
+        std::error_code ec;
+        std::filesystem::recursive_directory_iterator it(root, ec), end;
+        for (; it != end; it.increment(ec)) {
+            auto const& path = it->path();
+            if (it->is_directory(ec)) {
+                if (path.filename().native().front() == '.') {
+                    it.disable_recursion_pending();
+                }
+            } else if (isPluginFile(path)) {
+                files.push_back(path);
             }
         }
+        if (ec) {
+            LOG_ERROR << "Error scanning " << root << ": " << ec.message();
+        }
     }
-    
-    // Load the newest plugin if found
-    if (!newest_plugin.empty()) {
-        std::cout << "Loading newest plugin: " << newest_plugin << std::endl;
-        onPluginWriteComplete(newest_plugin);
+    return files;
+}
+
+std::string PluginManager::deployedName(const std::filesystem::path& path) const {
+    auto const rel = path.lexically_relative(plugin_directories_.front());
+    if (rel.empty() || *rel.begin() == "..") {
+        return path.string();
     }
+    return rel.string();
 }
 
 bool PluginManager::isPluginFile(const std::filesystem::path& path) const {
     return path.extension() == ".so";
 }
 
+PluginManager::FileVersion PluginManager::fileVersion(const std::filesystem::path& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return {};
+    }
+    FileVersion version;
+    version.size = static_cast<std::uintmax_t>(st.st_size);
+    version.modified_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    version.inode = st.st_ino;
+    return version;
+}
+
+bool PluginManager::isPluginReady(const std::filesystem::path& path, std::string& why) const {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        why = "cannot open file";
+        return false;
+    }
+
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    ElfW(Ehdr) header;
+    if (ec || size < sizeof(header)) {
+        why = "file is smaller than an ELF header";
+        return false;
+    }
+
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0) {
+        why = "not an ELF file";
+        return false;
+    }
+
+    // Must be a shared object built for this process
+    const unsigned char native_class = sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32;
+    const unsigned char native_data =
+        __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? ELFDATA2LSB : ELFDATA2MSB;
+    if (header.e_ident[EI_CLASS] != native_class ||
+        header.e_ident[EI_DATA] != native_data ||
+        header.e_type != ET_DYN) {
+        why = "not a shared object for this platform";
+        return false;
+    }
+
+    // The linker writes the section header table last, a file that does not
+    // contain both tables yet is still being written
+    auto table_end = [](std::uintmax_t offset, std::uintmax_t count, std::uintmax_t entry_size) {
+        return offset + count * entry_size;
+    };
+    if (table_end(header.e_phoff, header.e_phnum, header.e_phentsize) > size ||
+        table_end(header.e_shoff, header.e_shnum, header.e_shentsize) > size) {
+        why = "file is truncated";
+        return false;
+    }
+
+    // The sidecar holds the hex digest, optionally followed by the file name
+    // as written by sha256sum
+    auto sidecar = path;
+    sidecar += ".sha256";
+    if (std::filesystem::exists(sidecar, ec)) {
+        std::ifstream sums(sidecar);
+        std::string expected;
+        sums >> expected;
+        std::transform(expected.begin(), expected.end(), expected.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (expected.empty() || sha256Hex(path) != expected) {
+            why = "checksum does not match " + sidecar.filename().string();
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void PluginManager::start() {
+    scheduler_->start();
     monitor_->start();
 }
 
 void PluginManager::stop() {
     monitor_->stop();
+    scheduler_->stop();
 }
 
 std::shared_ptr<Plugin> PluginManager::getPlugin(const std::string& pluginPath) const {
@@ -97,13 +516,13 @@ std::vector<std::shared_ptr<Plugin>> PluginManager::getPluginsByType(PluginType
     std::vector<std::shared_ptr<Plugin>> result;
     std::lock_guard<std::mutex> lock(plugins_mutex_);
     
-    std::cout << "Looking for plugins of type " << static_cast<int>(type) 
-              << ", total plugins loaded: " << plugins_.size() << std::endl;
+    LOG_TRACE << "Looking for plugins of type " << static_cast<int>(type)
+              << ", total plugins loaded: " << plugins_.size();
     
     for (const auto& [path, plugin] : plugins_) {
-        std::cout << "Checking plugin at path: " << path << std::endl;
+        LOG_TRACE << "Checking plugin at path: " << path;
         if (plugin->getType() == type) {
-            std::cout << "Found matching plugin of requested type" << std::endl;
+            LOG_TRACE << "Found matching plugin of requested type";
             result.push_back(plugin);
         }
     }
@@ -111,465 +530,380 @@ std::vector<std::shared_ptr<Plugin>> PluginManager::getPluginsByType(PluginType
     return result;
 }
 
-bool PluginManager::loadPluginWithTimeout(const std::filesystem::path& path, bool is_restore) {
-    if (!std::filesystem::exists(path)) {
-        std::cerr << "Plugin file does not exist: " << path << std::endl;
-        return false;
+std::shared_ptr<Plugin> PluginManager::loadAndInitialize(const std::filesystem::path& path) {
+    auto plugin = loader_->loadPlugin(path);
+    if (!plugin) {
+        LOG_ERROR << "Failed to load plugin (null pointer returned)";
+        return nullptr;
     }
 
-    // Check if file is valid before attempting to load
-    try {
-        auto file_size = std::filesystem::file_size(path);
-        if (file_size < 64) {  // Minimum size for a valid .so file
-            std::cerr << "Plugin file is too small to be valid: " << path << std::endl;
-            return false;
+    // A plugin must serve exactly the routes its manifest promised
+    if (auto manifest = PluginManifest::read(path)) {
+        std::vector<std::string> listed;
+        for (const auto& route : manifest->routes) {
+            listed.push_back(route.method + " " + route.path);
         }
-        
-        // For restored plugins, verify file integrity
-        if (is_restore) {
-            std::ifstream file(path, std::ios::binary);
-            if (!file.good()) {
-                std::cerr << "Cannot open restored plugin file: " << path << std::endl;
-                return false;
+        std::sort(listed.begin(), listed.end());
+        auto const served = routesOf(plugin);
+        if (served.empty() || served != listed) {
+            LOG_ERROR << "Plugin does not match its manifest: " << path;
+            std::vector<std::string> unlisted;
+            std::vector<std::string> missing;
+            std::set_difference(served.begin(), served.end(), listed.begin(), listed.end(),
+                                std::back_inserter(unlisted));
+            std::set_difference(listed.begin(), listed.end(), served.begin(), served.end(),
+                                std::back_inserter(missing));
+            if (!unlisted.empty()) {
+                LOG_ERROR << "It serves " << routeKey(unlisted) << ", which the manifest does not list";
             }
-            
-            // Read first few bytes to verify it's a valid ELF file
-            char magic[4];
-            file.read(magic, 4);
-            if (!file || magic[0] != 0x7f || magic[1] != 'E' || magic[2] != 'L' || magic[3] != 'F') {
-                std::cerr << "Restored file is not a valid ELF file: " << path << std::endl;
-                return false;
+            if (!missing.empty()) {
+                LOG_ERROR << "It does not serve " << routeKey(missing);
             }
+            return nullptr;
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error checking plugin file: " << e.what() << std::endl;
-        return false;
     }
 
-    // Use a shorter timeout for restored plugins since we've already verified the file
-    const auto timeout = is_restore ? std::chrono::seconds(5) : std::chrono::seconds(5);
-    
-    // Use a promise to signal completion
-    std::promise<bool> loading_promise;
-    auto loading_future = loading_promise.get_future();
-    
-    // Create a flag to signal the worker thread to stop
-    std::atomic<bool> should_stop{false};
-    
-    // Launch the worker thread
-    std::thread worker([this, path, &loading_promise, &should_stop]() {
-        try {
-            // First try to load the plugin
-            std::cout << "Attempting to load plugin: " << path << std::endl;
-            
-            // Add a small delay before loading to ensure file system operations are complete
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            
-            if (should_stop) {
-                loading_promise.set_value(false);
-                return;
-            }
-            
-            auto plugin = loader_->loadPlugin(path);
-            if (!plugin) {
-                std::cerr << "Failed to load plugin (null pointer returned)" << std::endl;
-                loading_promise.set_value(false);
-                return;
-            }
-
-            if (should_stop) {
-                loading_promise.set_value(false);
-                return;
-            }
-
-            try {
-                // Initialize the plugin before storing it
-                std::cout << "Initializing plugin..." << std::endl;
-                plugin->initialize();
-                
-                if (should_stop) {
-                    loading_promise.set_value(false);
-                    return;
-                }
-                
-                {
-                    std::lock_guard<std::mutex> lock(plugins_mutex_);
-                    plugins_[path.string()] = plugin;
-                }
-                std::cout << "Successfully loaded and initialized plugin: " << path << std::endl;
-                loading_promise.set_value(true);
-            } catch (const std::exception& e) {
-                std::cerr << "Error initializing plugin: " << e.what() << std::endl;
-                loading_promise.set_value(false);
-            }
-        } catch (const std::exception& e) {
-            std::cerr << "Error loading plugin: " << e.what() << std::endl;
-            try {
-                loading_promise.set_value(false);
-            } catch (...) {}
-        }
-    });
-
-    // Wait for completion or timeout
-    bool success = false;
     try {
-        auto status = loading_future.wait_for(timeout);
-        if (status == std::future_status::timeout) {
-            std::cerr << "Plugin loading timed out after " << timeout.count() 
-                     << " seconds: " << path << std::endl;
-            // Signal the worker thread to stop
-            should_stop = true;
-        } else {
-            success = loading_future.get();
-            if (!success) {
-                std::cerr << "Plugin loading failed: " << path << std::endl;
+        // Initialize the plugin before storing it
+        LOG_INFO << "Initializing plugin...";
+        plugin->initialize();
+
+        // Every request of an endpoint without a handler would fail
+        for (const auto& endpoint : endpointsOf(plugin)) {
+            if (!endpoint->getAsyncHandler() && !endpoint->getRouteHandler()) {
+                LOG_ERROR << "Plugin endpoint " << endpoint->getMethod() << " " << endpoint->getPath()
+                          << " has no handler, not loading " << path;
+                return nullptr;
             }
         }
     } catch (const std::exception& e) {
-        std::cerr << "Exception during plugin loading: " << e.what() << std::endl;
-        should_stop = true;
+        LOG_ERROR << "Error initializing plugin: " << e.what();
+        return nullptr;
     }
 
-    // Clean up the worker thread
-    if (worker.joinable()) {
-        if (should_stop) {
-            // Give the thread a moment to clean up
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        }
-        worker.join();
+    if (!warmUp(path, plugin)) {
+        return nullptr;
     }
+    return plugin;
+}
 
-    // If loading failed or timed out, try to clean up
-    if (!success) {
-        try {
-            std::lock_guard<std::mutex> lock(plugins_mutex_);
-            plugins_.erase(path.string());
-            loader_->unloadPlugin(path.string());
-        } catch (const std::exception& e) {
-            std::cerr << "Error cleaning up failed plugin load: " << e.what() << std::endl;
-        }
-    }
+bool PluginManager::warmUp(const std::filesystem::path& path, const std::shared_ptr<Plugin>& plugin) {
+    auto const start_time = std::chrono::steady_clock::now();
+    auto const prefaulted = loader_->prefault(path);
 
-    return success;
-}
+    std::size_t handled = 0;
+    for (const auto& endpoint : endpointsOf(plugin)) {
+        auto const method = http::string_to_verb(endpoint->getMethod());
+        if (method == http::verb::unknown) {
+            continue;
+        }
+        auto const requests = endpoint->getWarmupRequests();
+        if (requests.empty()) {
+            continue;
+        }
 
-bool PluginManager::unloadPluginWithTimeout(const std::string& path) {
-    auto future = std::async(std::launch::async, [this, path]() {
         try {
-            std::lock_guard<std::mutex> lock(plugins_mutex_);
-            plugins_.erase(path);
-            loader_->unloadPlugin(path);
-            return true;
+            // Route the requests like the server will, so path parameters
+            // and the query reach the handler
+            std::vector<RouteTable::Route> routes;
+            routes.push_back(RouteTable::routeFor(method, endpoint->getPath(), endpoint));
+            const RouteTable table(std::move(routes));
+            const auto& warm = table.routes().front();
+
+            // Responses allocate from an arena, as on a connection
+            Arena arena;
+            for (const auto& request : requests) {
+                RouteParams params;
+                if (!table.find(method, request.target, params)) {
+                    LOG_ERROR << "Warm-up request " << request.target << " does not match route "
+                              << warm.path << " of " << path;
+                    return false;
+                }
+                for (std::size_t i = 0; i < WARMUP_ITERATIONS; ++i) {
+                    {
+                        Arena::Scope scope(arena);
+                        EndpointPlugin::Request req{method, request.target, 11};
+                        for (const auto& [name, value] : request.headers) {
+                            req.set(name, value);
+                        }
+                        req.body() = request.body;
+                        req.prepare_payload();
+
+                        auto res = invokeRoute(warm, req, params);
+                        if (i == 0 && res.result_int() >= 500) {
+                            LOG_WARNING << "Warm-up request " << request.target << " answered "
+                                        << res.result_int() << ": " << path;
+                        }
+                    }
+                    arena.reset();
+                    ++handled;
+                }
+            }
         } catch (const std::exception& e) {
-            std::cerr << "Error unloading plugin: " << e.what() << std::endl;
+            LOG_ERROR << "Warm-up of plugin failed, not swapping it in: " << path << ": " << e.what();
             return false;
         }
-    });
-
-    if (future.wait_for(PLUGIN_OPERATION_TIMEOUT) == std::future_status::timeout) {
-        std::cerr << "Plugin unloading timed out: " << path << std::endl;
-        return false;
     }
 
-    return future.get();
+    auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    LOG_INFO << "Warmed up " << path.filename() << ": prefaulted " << prefaulted / 1024 << " KB, handled "
+             << handled << " requests in " << elapsed.count() / 1000.0 << " ms";
+    return true;
 }
 
-void PluginManager::manageBackups(const std::filesystem::path& newFile) {
-    std::lock_guard<std::mutex> lock(backup_mutex_);
-    
-    // Create backup of the new file
-    auto backup = createBackup(newFile);
-    if (!backup.empty()) {
-        // Get the base name without timestamp
-        std::string base_name = newFile.stem().string();
-        base_name = base_name.substr(0, base_name.find_last_of('_'));
-        
-        // Remove any existing backups of this plugin type
-        backup_files_.erase(
-            std::remove_if(backup_files_.begin(), backup_files_.end(),
-                [&base_name](const auto& path) {
-                    std::string existing_base = path.stem().string();
-                    existing_base = existing_base.substr(0, existing_base.find_last_of('_'));
-                    return existing_base == base_name;
-                }),
-            backup_files_.end()
-        );
-        
-        // Add new backup
-        backup_files_.push_front(backup);
-        std::cout << "Created backup: " << backup << std::endl;
-        
-        // Keep only the most recent MAX_BACKUP_FILES backups across all plugin types
-        while (backup_files_.size() > MAX_BACKUP_FILES) {
-            auto oldest = backup_files_.back();
-            if (std::filesystem::exists(oldest)) {
-                std::filesystem::remove(oldest);
-                std::cout << "Removed old backup: " << oldest << std::endl;
-            }
-            backup_files_.pop_back();
-        }
+std::shared_ptr<Plugin> PluginManager::loadWithinTimeout(const std::filesystem::path& path) {
+    if (!std::filesystem::exists(path)) {
+        LOG_ERROR << "Plugin file does not exist: " << path;
+        return nullptr;
     }
-}
 
-std::filesystem::path PluginManager::createBackup(const std::filesystem::path& pluginFile) {
+    // Check if file is valid before attempting to load
     try {
-        auto backup_path = pluginFile;
-        backup_path += ".backup";
-        std::filesystem::copy_file(pluginFile, backup_path, 
-                                 std::filesystem::copy_options::overwrite_existing);
-        return backup_path;
-    } catch (const std::exception& e) {
-        std::cerr << "Error creating backup: " << e.what() << std::endl;
-        return {};
-    }
-}
-
-void PluginManager::cleanupOldBackups() {
-    std::lock_guard<std::mutex> lock(backup_mutex_);
-    
-    // Find all backup files
-    std::vector<std::filesystem::path> backups;
-    for (const auto& entry : std::filesystem::directory_iterator(plugin_directory_)) {
-        if (entry.path().extension() == ".backup") {
-            backups.push_back(entry.path());
-        }
-    }
-
-    // Group backups by plugin type
-    std::map<std::string, std::vector<std::filesystem::path>> grouped_backups;
-    for (const auto& backup : backups) {
-        std::string base_name = backup.stem().string();
-        base_name = base_name.substr(0, base_name.find_last_of('_'));
-        grouped_backups[base_name].push_back(backup);
-    }
-
-    // Keep only the most recent backups for each plugin type
-    backup_files_.clear();
-    for (auto& [base_name, type_backups] : grouped_backups) {
-        // Sort by modification time (newest first)
-        std::sort(type_backups.begin(), type_backups.end(),
-                 [](const auto& a, const auto& b) {
-                     return std::filesystem::last_write_time(a) > std::filesystem::last_write_time(b);
-                 });
-        
-        // Keep the newest backup for this plugin type
-        if (!type_backups.empty()) {
-            backup_files_.push_back(type_backups.front());
-            
-            // Remove any excess backups for this plugin type
-            for (size_t i = 1; i < type_backups.size(); ++i) {
-                if (std::filesystem::exists(type_backups[i])) {
-                    std::filesystem::remove(type_backups[i]);
-                    std::cout << "Removed old backup during cleanup: " << type_backups[i] << std::endl;
-                }
-            }
+        auto file_size = std::filesystem::file_size(path);
+        if (file_size < 64) {  // Minimum size for a valid .so file
+            LOG_ERROR << "Plugin file is too small to be valid: " << path;
+            return nullptr;
         }
+
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Error checking plugin file: " << e.what();
+        return nullptr;
     }
-}
 
-void PluginManager::restoreFromBackup() {
-    std::lock_guard<std::mutex> lock(backup_mutex_);
-    
-    // Find all .so and .so.backup files in the directory
-    std::vector<std::filesystem::path> candidates;
+    // A hung dlopen() or initialize() cannot be interrupted, so a load runs
+    // to completion on the scheduler thread and is rejected if it took too
+    // long. The plugin never serves, as with the old watchdog thread, which
+    // had to wait for the load to finish as well.
+    std::shared_ptr<Plugin> plugin;
+    auto const start_time = std::chrono::steady_clock::now();
+    LOG_INFO << "Attempting to load plugin: " << path;
     try {
-        for (const auto& entry : std::filesystem::directory_iterator(plugin_directory_)) {
-            if (entry.path().extension() == ".so" || 
-                (entry.path().extension() == ".backup" && entry.path().stem().extension() == ".so")) {
-                candidates.push_back(entry.path());
-            }
+        plugin = loadAndInitialize(path);
+        auto const elapsed = std::chrono::steady_clock::now() - start_time;
+        if (plugin && elapsed > PLUGIN_OPERATION_TIMEOUT) {
+            LOG_ERROR << "Plugin loading timed out after "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+                      << " ms: " << path;
+            plugin.reset();
+        } else if (!plugin) {
+            LOG_ERROR << "Plugin loading failed: " << path;
         }
-    } catch (const std::filesystem::filesystem_error& e) {
-        std::cerr << "Error scanning directory for candidates: " << e.what() << std::endl;
-        return;
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Error loading plugin: " << e.what();
     }
 
-    if (candidates.empty()) {
-        std::cerr << "No .so or .so.backup files found in directory" << std::endl;
-        return;
+    if (!plugin) {
+        loader_->unloadPlugin(path.string());
+        return nullptr;
     }
 
-    // Sort by modification time (newest first)
-    std::sort(candidates.begin(), candidates.end(),
-            [](const auto& a, const auto& b) {
-                try {
-                    return std::filesystem::last_write_time(a) > std::filesystem::last_write_time(b);
-                } catch (const std::filesystem::filesystem_error&) {
-                    return false;
-                }
-            });
+    // Events for this version, such as a restored copy being closed, must
+    // not load it a second time
+    {
+        std::lock_guard<std::mutex> lock(seen_versions_mutex_);
+        seen_versions_[path.string()] = fileVersion(path);
+    }
+    return plugin;
+}
 
-    // Set the restoration flag
-    is_restoring_ = true;
+bool PluginManager::loadPluginWithTimeout(const std::filesystem::path& path) {
+    auto plugin = loadWithinTimeout(path);
+    if (!plugin) {
+        return false;
+    }
 
-    // Try each file in order until one works
-    for (const auto& candidate : candidates) {
-        std::cout << "Attempting to restore using: " << candidate << std::endl;
-        
-        try {
-            std::filesystem::path target_path;
-            if (candidate.extension() == ".backup") {
-                // If it's a backup file, we need to restore it to a .so file
-                target_path = candidate;
-                target_path.replace_extension("");  // Remove .backup extension
-            } else {
-                // If it's already a .so file, just try to load it directly
-                target_path = candidate;
+    // The versions it replaces served its routes until now, they all change
+    // in one route table so no request finds a route missing
+    auto const routes = routesOf(plugin);
+    std::vector<std::string> replaced;
+    std::vector<std::shared_ptr<Shadow>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(plugins_mutex_);
+        for (const auto& [existing_path, existing] : plugins_) {
+            if (existing_path != path.string() && overlaps(routesOf(existing), routes)) {
+                replaced.push_back(existing_path);
             }
-
-            if (candidate.extension() == ".backup") {
-                // Only need to copy if it's a backup file
-                try {
-                    std::filesystem::copy_file(candidate, target_path, 
-                                             std::filesystem::copy_options::overwrite_existing);
-                    std::cout << "Copied backup file to: " << target_path << std::endl;
-                } catch (const std::filesystem::filesystem_error& e) {
-                    std::cerr << "Error copying backup file: " << e.what() << std::endl;
-                    continue;
-                }
+        }
+        // A version on trial against a replaced one is dropped with it, as
+        // is one on trial against the version this file replaced in place
+        auto drop_shadow = [this, &dropped](const std::string& live_path) {
+            if (auto it = shadows_.find(live_path); it != shadows_.end()) {
+                dropped.push_back(std::move(it->second));
+                shadows_.erase(it);
             }
+        };
+        for (const auto& existing_path : replaced) {
+            plugins_.erase(existing_path);
+            drop_shadow(existing_path);
+        }
+        drop_shadow(path.string());
+        plugins_[path.string()] = plugin;
+        publishRoutes();
+    }
+    for (const auto& shadow : dropped) {
+        shadow->stop();
+        loader_->unloadPlugin(shadow->path().string());
+    }
+    for (const auto& existing_path : replaced) {
+        loader_->unloadPlugin(existing_path);
+    }
+    LOG_INFO << "Successfully loaded and initialized plugin: " << path;
+    return true;
+}
 
-            // Give the file system a moment to settle
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+void PluginManager::unloadPlugin(const std::string& path) {
+    // The route table stops referring to the plugin here, its library is
+    // closed later, once no request can still be using it
+    std::lock_guard<std::mutex> lock(plugins_mutex_);
+    if (plugins_.erase(path) > 0) {
+        publishRoutes();
+    }
+    loader_->unloadPlugin(path);
+}
 
-            // Try to load the plugin
-            if (loadPluginWithTimeout(target_path, true)) {
-                std::cout << "Successfully restored and loaded plugin from: " << candidate << std::endl;
-                is_restoring_ = false;
-                return;
-            } else {
-                std::cerr << "Failed to load plugin from: " << candidate << std::endl;
-                // If we copied a backup and it failed to load, clean it up
-                if (candidate.extension() == ".backup" && std::filesystem::exists(target_path)) {
-                    try {
-                        std::filesystem::remove(target_path);
-                    } catch (...) {}
+void PluginManager::importLegacyBackups() {
+    for (const auto& entry : std::filesystem::directory_iterator(plugin_directories_.front())) {
+        auto const& backup = entry.path();
+        if (backup.extension() != ".backup" || backup.stem().extension() != ".so") {
+            continue;
+        }
+        try {
+            auto manifest = PluginManifest::read(backup);
+            if (manifest && !manifest->routes.empty()) {
+                std::vector<std::string> routes;
+                for (const auto& route : manifest->routes) {
+                    routes.push_back(route.method + " " + route.path);
                 }
+                std::sort(routes.begin(), routes.end());
+                backups_->add(routeKey(routes), backup, backup.stem().string());
             }
         } catch (const std::exception& e) {
-            std::cerr << "Error processing candidate " << candidate << ": " << e.what() << std::endl;
+            LOG_WARNING << "Cannot import backup " << backup << ": " << e.what();
         }
+        std::error_code ec;
+        std::filesystem::remove(backup, ec);
+        LOG_INFO << "Removed legacy backup: " << backup;
     }
-
-    std::cerr << "Failed to restore from any available files" << std::endl;
-    is_restoring_ = false;
 }
 
-void PluginManager::onNewPlugin(const std::filesystem::path& path) {
-    // Ignore events if we're currently restoring
-    if (is_restoring_) {
-        return;
+std::map<std::string, PluginManager::RouteHistory> PluginManager::versions() const {
+    std::map<std::string, RouteHistory> histories;
+    for (auto& [route, versions] : backups_->routes()) {
+        histories[route].versions = std::move(versions);
     }
 
-    auto abs_path = std::filesystem::absolute(path);
-    std::cout << "New plugin detected: " << path << std::endl;
-    
-    // Add a small delay to ensure the file is fully written
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    
-    // Try to load the plugin first to check its type and path
-    auto temp_plugin = loader_->loadPlugin(abs_path);
-    if (!temp_plugin) {
-        std::cout << "Failed to load plugin for inspection" << std::endl;
-        return;
+    // A route serves a file of the plugin directory, the newest version
+    // deployed under its name, or a version loaded from the store
+    std::lock_guard<std::mutex> lock(plugins_mutex_);
+    for (const auto& [path, plugin] : plugins_) {
+        auto it = histories.find(routeKey(routesOf(plugin)));
+        if (it == histories.end()) {
+            continue;
+        }
+        std::filesystem::path const file(path);
+        bool const stored = backups_->contains(file);
+        for (const auto& version : it->second.versions) {
+            if (stored ? version.id == file.stem().string() : version.file == deployedName(file)) {
+                it->second.live = version.id;
+                break;
+            }
+        }
     }
+    return histories;
+}
 
-    // Check if it's an endpoint plugin
-    auto endpoint_plugin = std::dynamic_pointer_cast<plugins::endpoint::EndpointPlugin>(temp_plugin);
-    if (!endpoint_plugin) {
-        std::cout << "Plugin is not an endpoint plugin" << std::endl;
-        return;
-    }
+void PluginManager::rollback(const std::string& id, std::function<void(bool)> done) {
+    // Reports failure if the action is destroyed without running: replaced
+    // by a second request for the same version, or dropped by stop()
+    struct Completion {
+        std::function<void(bool)> done;
+        void operator()(bool result) { std::exchange(done, nullptr)(result); }
+        ~Completion() {
+            if (done) {
+                done(false);
+            }
+        }
+    };
+    auto completion = std::make_shared<Completion>();
+    completion->done = std::move(done);
+    scheduler_->schedule("rollback " + id, std::chrono::steady_clock::duration::zero(),
+                         [this, id, completion] { (*completion)(rollbackTo(id)); });
+}
 
-    // Check if we already have a plugin with this path and method
-    {
-        std::lock_guard<std::mutex> lock(plugins_mutex_);
-        for (const auto& [existing_path, existing_plugin] : plugins_) {
-            auto existing_endpoint = std::dynamic_pointer_cast<plugins::endpoint::EndpointPlugin>(existing_plugin);
-            if (existing_endpoint && 
-                existing_endpoint->getPath() == endpoint_plugin->getPath() &&
-                existing_endpoint->getMethod() == endpoint_plugin->getMethod()) {
-                std::cout << "Ignoring new plugin as an endpoint with path " << endpoint_plugin->getPath() 
-                         << " and method " << endpoint_plugin->getMethod() << " is already loaded" << std::endl;
-                return;
+bool PluginManager::rollbackTo(const std::string& id) {
+    std::string route;
+    for (const auto& [candidate, versions] : backups_->routes()) {
+        for (const auto& version : versions) {
+            if (version.id == id) {
+                route = candidate;
             }
         }
     }
-
-    // If we get here, this is a new unique endpoint
-    if (loadPluginWithTimeout(abs_path, false)) {
-        manageBackups(abs_path);
+    auto const stored = route.empty() ? std::filesystem::path() : backups_->file(id);
+    if (stored.empty()) {
+        LOG_ERROR << "Cannot roll back to unknown version " << id;
+        return false;
     }
-}
 
-void PluginManager::onModifiedPlugin(const std::filesystem::path& path) {
-    // Ignore events if we're currently restoring
-    if (is_restoring_) {
-        return;
+    {
+        std::lock_guard<std::mutex> lock(plugins_mutex_);
+        if (plugins_.count(stored.string())) {
+            LOG_INFO << route << " already serves " << id;
+            return true;
+        }
     }
 
-    auto abs_path = std::filesystem::absolute(path);
-    std::cout << "Plugin modified: " << path << std::endl;
-    
-    // Create backup before modification
-    manageBackups(abs_path);
-
-    // Unload existing plugin
-    if (unloadPluginWithTimeout(abs_path.string())) {
-        // Small delay to ensure file is fully written
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        
-        // Load new version
-        if (!loadPluginWithTimeout(abs_path)) {
-            std::cout << "Failed to load modified plugin, attempting restore from backup..." << std::endl;
-            restoreFromBackup();
-        }
+    // The stored file is never written to again, so it is loaded in place.
+    // It replaces whatever serves its routes, and a version on trial
+    // against that is dropped, the rollback decides what serves.
+    if (!loadPluginWithTimeout(stored)) {
+        LOG_ERROR << "Failed to roll back " << route << " to " << id;
+        return false;
     }
+    LOG_INFO << "Rolled back " << route << " to " << id;
+    return true;
 }
 
 std::string PluginManager::getBaseName(const std::filesystem::path& path) const {
     std::string base_name = path.stem().string();
-    if (path.extension() == ".backup") {
-        base_name = base_name.substr(0, base_name.find_last_of('.'));  // Remove .so
-    }
-    return base_name.substr(0, base_name.find_last_of('_'));  // Remove timestamp
+    base_name = base_name.substr(0, base_name.find_last_of('_'));  // Remove timestamp
+    return (path.parent_path() / base_name).string();
 }
 
-void PluginManager::processPendingDelete(const std::string& base_name, const PendingDelete& pending) {
-    std::cout << "Processing deletion for base name: " << base_name << std::endl;
+void PluginManager::processPendingDelete(const std::string& base_name,
+                                         const std::set<std::filesystem::path>& deleted) {
+    LOG_INFO << "Processing deletion for base name: " << base_name;
     
     // Get all viable files for this plugin type
     std::vector<std::filesystem::path> so_files;
-    std::vector<std::filesystem::path> backup_files;
     
+    // Versions of a plugin are kept side by side in its directory, which
+    // may have been removed along with them
+    auto const directory = std::filesystem::path(base_name).parent_path();
     try {
-        for (const auto& entry : std::filesystem::directory_iterator(plugin_directory_)) {
-            if (entry.path() != pending.so_path && entry.path() != pending.backup_path) {
-                std::string entry_base = getBaseName(entry.path());
-                if (entry_base == base_name) {
-                    // Verify file exists and is readable
-                    try {
-                        if (std::filesystem::exists(entry.path()) && 
-                            std::filesystem::file_size(entry.path()) > 0) {
-                            if (entry.path().extension() == ".so") {
-                                so_files.push_back(entry.path());
-                            } else if (entry.path().extension() == ".backup" && 
-                                     entry.path().stem().extension() == ".so") {
-                                backup_files.push_back(entry.path());
-                            }
-                        }
-                    } catch (const std::filesystem::filesystem_error& e) {
-                        std::cerr << "Error checking file " << entry.path() 
-                                 << ": " << e.what() << std::endl;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (!deleted.count(entry.path()) && entry.path().extension() == ".so" &&
+                getBaseName(entry.path()) == base_name) {
+                // Verify file exists and is readable
+                try {
+                    if (std::filesystem::exists(entry.path()) &&
+                        std::filesystem::file_size(entry.path()) > 0) {
+                        so_files.push_back(entry.path());
                     }
+                } catch (const std::filesystem::filesystem_error& e) {
+                    LOG_ERROR << "Error checking file " << entry.path()
+                              << ": " << e.what();
                 }
             }
         }
     } catch (const std::filesystem::filesystem_error& e) {
-        std::cerr << "Error scanning directory: " << e.what() << std::endl;
+        if (e.code() != std::errc::no_such_file_or_directory) {
+            LOG_ERROR << "Error scanning directory: " << e.what();
+        }
     }
 
-    // Sort both vectors by modification time (newest first)
+    // Sort by modification time (newest first)
     auto sort_by_time = [](const auto& a, const auto& b) {
         try {
             return std::filesystem::last_write_time(a) > std::filesystem::last_write_time(b);
@@ -579,313 +913,488 @@ void PluginManager::processPendingDelete(const std::string& base_name, const Pen
     };
     
     std::sort(so_files.begin(), so_files.end(), sort_by_time);
-    std::sort(backup_files.begin(), backup_files.end(), sort_by_time);
 
-    // Try restoration in this order:
-    // 1. Previous .so file (if exists) - load it directly
-    // 2. Current .so.backup (if exists)
-    // 3. Previous .so.backup converted to .so
-    
-    // First try: load previous .so file directly
-    if (!so_files.empty()) {
-        std::cout << "Loading previous .so: " << so_files.front() << std::endl;
-        if (loadPluginWithTimeout(so_files.front())) {
-            std::cout << "Successfully loaded previous .so" << std::endl;
+    // First try: load previous .so files directly, another one may be
+    // deleted by the same burst before it is loaded
+    for (const auto& so_file : so_files) {
+        LOG_INFO << "Loading previous .so: " << so_file;
+        if (loadPluginWithTimeout(so_file)) {
+            LOG_INFO << "Successfully loaded previous .so";
             return;
         }
-        std::cerr << "Failed to load previous .so" << std::endl;
+        LOG_ERROR << "Failed to load previous .so";
     }
 
-    // Second try: restore from any available backup
-    for (const auto& backup : backup_files) {
-        std::cout << "Attempting to restore from backup: " << backup << std::endl;
-        try {
-            // Get the original .so path by removing .backup extension
-            std::filesystem::path restore_path = backup;
-            restore_path.replace_extension("");  // Remove .backup extension
-            
-            // Copy the file
-            std::filesystem::copy_file(backup, restore_path,
-                                     std::filesystem::copy_options::overwrite_existing);
-                
-            std::cout << "Successfully restored to: " << restore_path << std::endl;
-            
-            // Add a delay to ensure file operations are complete
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-            
-            if (loadPluginWithTimeout(restore_path)) {
-                std::cout << "Successfully loaded restored plugin" << std::endl;
-                return;
+    // Second try: the newest retained version of this plugin that was not
+    // deleted just now, loaded straight from the backup store
+    std::vector<BackupStore::Version> retained;
+    for (const auto& [route, versions] : backups_->routes()) {
+        for (const auto& version : versions) {
+            auto const file = plugin_directories_.front() / version.file;
+            if (getBaseName(file) == base_name && !deleted.count(file)) {
+                retained.push_back(version);
             }
-            
-            std::cerr << "Failed to load restored plugin" << std::endl;
-            try {
-                std::filesystem::remove(restore_path);
-            } catch (...) {}
-            
-        } catch (const std::filesystem::filesystem_error& e) {
-            std::cerr << "Error restoring from backup: " << e.what() << std::endl;
-            continue;
         }
     }
+    std::stable_sort(retained.begin(), retained.end(),
+                     [](const auto& a, const auto& b) { return a.deployed > b.deployed; });
+
+    for (const auto& version : retained) {
+        LOG_INFO << "Rolling back to " << version.file << " (" << version.id << ")";
+        auto stored = backups_->file(version.id);
+        if (!stored.empty() && loadPluginWithTimeout(stored)) {
+            LOG_INFO << "Successfully rolled back to " << version.id;
+            return;
+        }
+        LOG_ERROR << "Failed to roll back to " << version.id;
+    }
     
-    std::cerr << "Failed to restore from any available files" << std::endl;
+    LOG_ERROR << "Failed to restore from any available files";
 }
 
-void PluginManager::handleBatchedDeletions(const std::string& base_name) {
-    std::lock_guard<std::mutex> lock(pending_deletes_mutex_);
-    
-    auto it = pending_deletes_.find(base_name);
-    if (it == pending_deletes_.end()) {
-        return;
+void PluginManager::queueReload(const std::filesystem::path& abs_path, bool deleted) {
+    auto const now = std::chrono::steady_clock::now();
+    auto base_name = getBaseName(abs_path);
+    {
+        std::lock_guard<std::mutex> lock(pending_reloads_mutex_);
+        auto& pending = pending_reloads_[base_name];
+        // The last event for a path decides whether it is there to load
+        if (deleted) {
+            pending.written.erase(abs_path);
+            pending.deleted.insert(abs_path);
+        } else {
+            pending.written.try_emplace(abs_path, now);
+            pending.deleted.erase(abs_path);
+        }
     }
-    
-    const auto& pending = it->second;
-    auto elapsed = std::chrono::steady_clock::now() - pending.timestamp;
-    
-    // If not enough time has elapsed, schedule another check
-    if (elapsed < DELETION_BATCH_TIMEOUT) {
-        std::thread([this, base_name]() {
-            std::this_thread::sleep_for(DELETION_BATCH_TIMEOUT);
-            handleBatchedDeletions(base_name);
-        }).detach();
-        return;
+
+    // Scheduling a base name again folds the event into the pending reload
+    scheduler_->schedule(base_name,
+                         deleted ? std::chrono::steady_clock::duration(DELETION_BATCH_TIMEOUT)
+                                 : std::chrono::steady_clock::duration::zero(),
+                         [this, base_name] { processPendingReload(base_name); });
+}
+
+void PluginManager::processPendingReload(const std::string& base_name) {
+    PendingReload pending;
+    {
+        std::lock_guard<std::mutex> lock(pending_reloads_mutex_);
+        auto it = pending_reloads_.find(base_name);
+        if (it == pending_reloads_.end()) {
+            return;
+        }
+        pending = std::move(it->second);
+        pending_reloads_.erase(it);
+    }
+
+    // Only the newest ready version is worth loading, older ones written in
+    // the same burst were replaced before they could serve
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> written;
+    for (const auto& [path, ready_time] : pending.written) {
+        std::error_code ec;
+        auto modified = std::filesystem::last_write_time(path, ec);
+        if (!ec) {
+            written.emplace_back(modified, path);
+        }
+    }
+    std::sort(written.begin(), written.end(), std::greater<>());
+
+    bool serving = false;
+    bool handled = false;
+    for (const auto& [modified, path] : written) {
+        if (handled) {
+            LOG_INFO << "Skipping superseded plugin: " << path;
+            continue;
+        }
+        std::string why;
+        if (!isPluginReady(path, why)) {
+            LOG_INFO << "Plugin not ready: " << path << ": " << why;
+            continue;
+        }
+        handled = true;
+        serving = reloadPlugin(path, pending.written[path]);
+    }
+
+    // A deleted plugin that is still loaded was not replaced above. Unload
+    // it and fall back to an older version of it.
+    bool lost = false;
+    for (const auto& path : pending.deleted) {
+        bool was_loaded = false;
+        bool shadowed = false;
+        {
+            std::lock_guard<std::mutex> lock(plugins_mutex_);
+            was_loaded = plugins_.find(path.string()) != plugins_.end();
+            shadowed = shadows_.find(path.string()) != shadows_.end();
+        }
+        if (shadowed) {
+            // Decided by the shadow's evaluation, a rollback restores the file
+            LOG_INFO << "Deleted plugin serves until its successor is evaluated: " << path;
+        } else if (was_loaded) {
+            unloadPlugin(path.string());
+            LOG_INFO << "Successfully unloaded deleted plugin";
+            lost = true;
+        }
+    }
+    if (lost && !serving) {
+        processPendingDelete(base_name, pending.deleted);
     }
-    
-    // Process the deletion batch
-    processPendingDelete(base_name, pending);
-    
-    // Clean up
-    pending_deletes_.erase(it);
 }
 
 void PluginManager::onDeletedPlugin(const std::filesystem::path& path) {
-    // Ignore events if we're currently restoring
-    if (is_restoring_) {
+    // Removing a checksum sidecar does not affect the loaded plugin
+    if (path.extension() == ".sha256") {
         return;
     }
 
     auto abs_path = std::filesystem::absolute(path);
-    std::cout << "Plugin deleted: " << path << std::endl;
-    
-    std::string base_name = getBaseName(abs_path);
-    bool is_backup = abs_path.extension() == ".backup";
-    
-    // Update or create pending delete entry
+    LOG_INFO << "Plugin deleted: " << path;
+
     {
-        std::lock_guard<std::mutex> lock(pending_deletes_mutex_);
-        auto& pending = pending_deletes_[base_name];
-        
-        // If this is the first delete for this base name
-        if (pending.timestamp == std::chrono::steady_clock::time_point()) {
-            pending.timestamp = std::chrono::steady_clock::now();
-            pending.so_path = abs_path;
-            if (is_backup) {
-                pending.so_path.replace_extension("");  // Remove .backup
+        std::lock_guard<std::mutex> lock(seen_versions_mutex_);
+        seen_versions_.erase(abs_path.string());
+    }
+
+    queueReload(abs_path, true);
+}
+
+bool PluginManager::inspectRoutes(const std::filesystem::path& abs_path,
+                                  std::optional<PluginManifest>& manifest,
+                                  std::vector<std::string>& routes) {
+    try {
+        manifest = PluginManifest::read(abs_path);
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Rejecting plugin " << abs_path << ": " << e.what();
+        return false;
+    }
+
+    if (manifest) {
+        if (manifest->c_abi_version != 0) {
+            if (manifest->c_abi_version != ENDPOINT_ABI_VERSION) {
+                LOG_ERROR << "Rejecting plugin " << abs_path << ": built for endpoint table version "
+                          << manifest->c_abi_version << ", the server reads " << ENDPOINT_ABI_VERSION;
+                return false;
             }
-            pending.backup_path = pending.so_path;
-            pending.backup_path += ".backup";
+        } else if (manifest->abi_version != PLUGIN_ABI_VERSION) {
+            LOG_ERROR << "Rejecting plugin " << abs_path << ": built for plugin ABI "
+                      << manifest->abi_version << ", the server uses " << PLUGIN_ABI_VERSION;
+            return false;
         }
-        
-        // Mark which file was deleted
-        if (is_backup) {
-            pending.backup_deleted = true;
-        } else {
-            pending.so_deleted = true;
-        }
-        
-        // Unload the plugin if it was loaded
-        if (!is_backup) {
-            bool was_loaded = false;
-            {
-                std::lock_guard<std::mutex> plugins_lock(plugins_mutex_);
-                was_loaded = plugins_.find(abs_path.string()) != plugins_.end();
+        if (manifest->type != "endpoint") {
+            LOG_INFO << "Plugin is not an endpoint plugin";
+            return false;
+        }
+        for (const auto& route : manifest->routes) {
+            routes.push_back(route.method + " " + route.path);
+        }
+        std::sort(routes.begin(), routes.end());
+        if (routes.empty()) {
+            LOG_ERROR << "Rejecting plugin " << abs_path << ": its manifest lists no route";
+            return false;
+        }
+        if (std::adjacent_find(routes.begin(), routes.end()) != routes.end()) {
+            LOG_ERROR << "Rejecting plugin " << abs_path << ": its manifest lists a route twice";
+            return false;
+        }
+    } else {
+        // Plugins built without a manifest have to be loaded to be inspected
+        LOG_WARNING << "Plugin has no manifest, loading it for inspection: " << abs_path;
+        std::shared_ptr<Plugin> temp_plugin;
+        try {
+            temp_plugin = loader_->loadPlugin(abs_path);
+            if (!temp_plugin) {
+                LOG_WARNING << "Failed to load plugin for inspection";
+                return false;
             }
-            
-            if (was_loaded && unloadPluginWithTimeout(abs_path.string())) {
-                std::cout << "Successfully unloaded deleted plugin" << std::endl;
+        } catch (const std::exception& e) {
+            // Only log non-permission errors
+            if (std::string(e.what()).find("Permission denied") == std::string::npos) {
+                LOG_ERROR << "Error loading plugin for inspection: " << e.what();
             }
+            return false;
+        }
+
+        routes = routesOf(temp_plugin);
+        if (routes.empty()) {
+            LOG_INFO << "Plugin is not an endpoint plugin";
+            return false;
+        }
+        if (std::adjacent_find(routes.begin(), routes.end()) != routes.end()) {
+            LOG_ERROR << "Rejecting plugin " << abs_path << ": it serves a route twice";
+            return false;
         }
     }
-    
-    // Start the batched deletion handler
-    std::thread([this, base_name]() {
-        handleBatchedDeletions(base_name);
-    }).detach();
+    return true;
 }
 
 void PluginManager::onPluginWriteComplete(const std::filesystem::path& path) {
-    // Ignore events if we're currently restoring
-    if (is_restoring_) {
-        return;
-    }
-
+    // A checksum sidecar arriving may complete the plugin it belongs to
     auto abs_path = std::filesystem::absolute(path);
-    
-    // Use a static map to track last modification times
-    static std::map<std::filesystem::path, std::chrono::steady_clock::time_point> last_mod_times;
-    static std::mutex mod_times_mutex;
-    
-    // Implement debouncing with a longer timeout and track operation type
-    {
-        std::lock_guard<std::mutex> lock(mod_times_mutex);
-        auto now = std::chrono::steady_clock::now();
-        auto& last_time = last_mod_times[abs_path];
-        
-        if (last_time != std::chrono::steady_clock::time_point() &&
-            (now - last_time) < std::chrono::milliseconds(10000)) {  // Increased to 10 seconds
-            // Event occurred too soon after the last one, ignore it
-            std::cout << "Debouncing: ignoring event for " << path << std::endl;
+    if (abs_path.extension() == ".sha256") {
+        abs_path.replace_extension("");
+        if (!std::filesystem::exists(abs_path)) {
             return;
         }
-        last_time = now;
-        
-        // Clean up old modification time entries while we have the lock
-        auto cleanup_time = now - std::chrono::seconds(60);
-        for (auto it = last_mod_times.begin(); it != last_mod_times.end();) {
-            if (it->second < cleanup_time) {
-                it = last_mod_times.erase(it);
-            } else {
-                ++it;
-            }
-        }
     }
 
-    // Add a flag to track if this is a restored file
-    bool is_restored = false;
-    {
-        std::lock_guard<std::mutex> lock(backup_mutex_);
-        // Check both the restoration flag and if this is a recently restored file
-        is_restored = is_restoring_ || 
-                     (std::find_if(backup_files_.begin(), backup_files_.end(),
-                         [&abs_path](const auto& backup) {
-                             return backup.stem() == abs_path.filename();
-                         }) != backup_files_.end());
-        
-        if (is_restored) {
-            std::cout << "Ignoring write event for restored file: " << path << std::endl;
-            return;
-        }
-    }
+    queueReload(abs_path, false);
+}
 
-    // Add a longer delay before attempting to load
-    std::this_thread::sleep_for(std::chrono::milliseconds(2000));
-    
-    // Only do basic existence check before attempting to load
-    if (!std::filesystem::exists(abs_path)) {
-        std::cerr << "Plugin file does not exist: " << abs_path << std::endl;
-        return;
-    }
-    
-    // Try to load the plugin first to check its type and path
-    std::shared_ptr<Plugin> temp_plugin;
-    try {
-        temp_plugin = loader_->loadPlugin(abs_path);
-        if (!temp_plugin) {
-            std::cout << "Failed to load plugin for inspection" << std::endl;
-            return;
-        }
-    } catch (const std::exception& e) {
-        // Only log non-permission errors
-        if (std::string(e.what()).find("Permission denied") == std::string::npos) {
-            std::cerr << "Error loading plugin for inspection: " << e.what() << std::endl;
+bool PluginManager::reloadPlugin(const std::filesystem::path& abs_path,
+                                 std::chrono::steady_clock::time_point ready_time) {
+    // Several events can report the same write, handle each version once
+    {
+        std::lock_guard<std::mutex> lock(seen_versions_mutex_);
+        auto version = fileVersion(abs_path);
+        auto& seen = seen_versions_[abs_path.string()];
+        if (seen == version) {
+            LOG_DEBUG << "Already handled this version of " << abs_path;
+            return false;
         }
-        return;
+        seen = version;
     }
 
-    // Check if it's an endpoint plugin
-    auto endpoint_plugin = std::dynamic_pointer_cast<plugins::endpoint::EndpointPlugin>(temp_plugin);
-    if (!endpoint_plugin) {
-        std::cout << "Plugin is not an endpoint plugin" << std::endl;
-        return;
+    // Learn what the plugin serves from its manifest, so bad, duplicate and
+    // older plugins are turned away before any of their code runs
+    std::optional<PluginManifest> manifest;
+    std::vector<std::string> routes;
+    if (!inspectRoutes(abs_path, manifest, routes)) {
+        return false;
     }
+    auto const route_key = routeKey(routes);
 
-    // Check if we already have a plugin with this path and method
-    bool should_replace = false;
-    std::string existing_path;
+    // The new version takes over every route it serves, from each plugin
+    // serving any of them. It has to be newer than all of those.
+    std::vector<std::string> existing_paths;
+    std::vector<std::string> existing_routes;  // Of the only plugin it replaces
     {
         std::lock_guard<std::mutex> lock(plugins_mutex_);
         for (const auto& [existing_path_str, existing_plugin] : plugins_) {
-            auto existing_endpoint = std::dynamic_pointer_cast<plugins::endpoint::EndpointPlugin>(existing_plugin);
-            if (existing_endpoint && 
-                existing_endpoint->getPath() == endpoint_plugin->getPath() &&
-                existing_endpoint->getMethod() == endpoint_plugin->getMethod()) {
-                
-                // Compare timestamps with higher precision
+            auto served = routesOf(existing_plugin);
+            if (!overlaps(served, routes)) {
+                continue;
+            }
+
+            existing_paths.push_back(existing_path_str);
+            existing_routes = std::move(served);
+
+            // A new file under the name of the loaded one replaces it. Events
+            // that did not change its contents were already dropped.
+            if (existing_path_str == abs_path.string()) {
+                LOG_INFO << "Plugin " << abs_path << " was replaced in place";
+                continue;
+            }
+
+            // The same build under another name is not a new version
+            if (manifest && !manifest->build_id.empty()) {
                 try {
-                    auto new_time = std::filesystem::last_write_time(abs_path);
-                    auto existing_time = std::filesystem::last_write_time(existing_path_str);
-                    
-                    // Convert to duration since epoch for more precise comparison
-                    auto new_duration = new_time.time_since_epoch();
-                    auto existing_duration = existing_time.time_since_epoch();
-                    
-                    if (new_duration > existing_duration) {
-                        should_replace = true;
-                        existing_path = existing_path_str;
-                        std::cout << "New plugin is newer than existing plugin" << std::endl;
-                    } else {
-                        std::cout << "Ignoring older or same age plugin" << std::endl;
-                        return;
+                    auto existing_manifest = PluginManifest::read(existing_path_str);
+                    if (existing_manifest && existing_manifest->build_id == manifest->build_id) {
+                        LOG_INFO << "Ignoring duplicate of " << existing_path_str << ": " << abs_path;
+                        return false;
                     }
-                } catch (const std::filesystem::filesystem_error& e) {
-                    std::cerr << "Error comparing plugin timestamps: " << e.what() << std::endl;
-                    return;
+                } catch (const std::exception&) {
+                    // The loaded file is gone or unreadable, compare by age
                 }
-                break;
+            }
+
+            // A loaded plugin whose file was deleted in the same burst
+            // is replaced by whatever arrived, without a gap in between
+            if (!std::filesystem::exists(existing_path_str)) {
+                LOG_INFO << "Replacing deleted plugin " << existing_path_str;
+                continue;
+            }
+
+            // Compare timestamps with higher precision
+            try {
+                auto new_time = std::filesystem::last_write_time(abs_path);
+                auto existing_time = std::filesystem::last_write_time(existing_path_str);
+
+                // Convert to duration since epoch for more precise comparison
+                auto new_duration = new_time.time_since_epoch();
+                auto existing_duration = existing_time.time_since_epoch();
+
+                if (new_duration > existing_duration) {
+                    LOG_INFO << "New plugin is newer than existing plugin " << existing_path_str;
+                } else {
+                    LOG_INFO << "Ignoring older or same age plugin";
+                    return false;
+                }
+            } catch (const std::filesystem::filesystem_error& e) {
+                LOG_ERROR << "Error comparing plugin timestamps: " << e.what();
+                return false;
             }
         }
     }
 
-    if (should_replace) {
-        std::cout << "Replacing existing plugin with newer version for path " << endpoint_plugin->getPath() 
-                 << " and method " << endpoint_plugin->getMethod() << std::endl;
-        
-        // Create backup before unloading the old plugin
-        if (!is_restored) {
-            manageBackups(abs_path);
-        }
-        
-        // Unload the old plugin first
-        if (!unloadPluginWithTimeout(existing_path)) {
-            std::cerr << "Failed to unload existing plugin" << std::endl;
-            return;
+    if (!existing_paths.empty()) {
+        LOG_INFO << "Replacing existing plugin with newer version for " << describeRoutes(routes);
+
+        // In a staged rollout the new version first shadows the old one.
+        // Only copies of GET and HEAD requests are safe to handle twice, and
+        // both versions have to be loaded side by side. A set of routes is
+        // replaced as a whole, it does not take part.
+        auto const& existing_path = existing_paths.front();
+        if (rollout_.sample_rate > 0 && existing_path != abs_path.string()) {
+            auto const method = routes.front().substr(0, routes.front().find(' '));
+            if (existing_paths.size() == 1 && existing_routes == routes && routes.size() == 1 &&
+                (method == "GET" || method == "HEAD")) {
+                return startShadow(abs_path, existing_path);
+            }
+            LOG_INFO << "Not shadowing " << describeRoutes(routes) << ", replacing it directly";
         }
-        
-        // Load the new plugin
+
+        // The old versions keep serving while the new one is loaded and
+        // warmed up, and fail over to nothing if the new one is bad
         if (!loadPluginWithTimeout(abs_path)) {
-            std::cout << "Failed to load new plugin version, attempting restore from backup..." << std::endl;
-            restoreFromBackup();
+            LOG_WARNING << "Failed to load new plugin version, keeping " << existing_path
+                        << (existing_paths.size() > 1 ? " and the others serving its routes" : "");
+            return false;
         }
-    } else if (!existing_path.empty()) {
-        std::cout << "Keeping existing plugin as it is newer" << std::endl;
-    } else {
+    } else if (!loadPluginWithTimeout(abs_path)) {
         // This is a new unique endpoint
-        if (loadPluginWithTimeout(abs_path)) {
-            // Create backup for new plugins
-            if (!is_restored) {
-                manageBackups(abs_path);
-            }
+        return false;
+    }
+    backups_->add(route_key, abs_path, deployedName(abs_path));
+
+    auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - ready_time);
+    LOG_INFO << "Plugin " << abs_path.filename() << " serving " << elapsed.count() / 1000.0
+             << " ms after it became ready";
+    return true;
+}
+
+bool PluginManager::startShadow(const std::filesystem::path& abs_path, const std::string& live_path) {
+    auto plugin = loadWithinTimeout(abs_path);
+    auto endpoints = plugin ? endpointsOf(plugin) : std::vector<std::shared_ptr<EndpointPlugin>>{};
+    if (endpoints.size() != 1) {
+        loader_->unloadPlugin(abs_path.string());
+        LOG_WARNING << "Failed to load new plugin version, keeping " << std::filesystem::path(live_path);
+        return false;
+    }
+
+    auto shadow = std::make_shared<Shadow>(endpoints.front(), abs_path, rollout_.sample_rate);
+    std::shared_ptr<Shadow> superseded;
+    {
+        std::lock_guard<std::mutex> lock(plugins_mutex_);
+        superseded = std::exchange(shadows_[live_path], shadow);
+        publishRoutes();
+    }
+    if (superseded) {
+        LOG_INFO << "Dropping " << superseded->path().filename() << ", superseded by " << abs_path.filename();
+        superseded->stop();
+        loader_->unloadPlugin(superseded->path().string());
+    }
+
+    LOG_INFO << "Shadowing " << std::filesystem::path(live_path) << " with " << abs_path << ", copying "
+             << rollout_.sample_rate * 100 << "% of its GET and HEAD requests";
+    auto const started = std::chrono::steady_clock::now();
+    scheduler_->schedule("shadow " + live_path, SHADOW_CHECK_INTERVAL,
+                         [this, live_path, shadow, started] { evaluateShadow(live_path, shadow, started); });
+    return true;
+}
+
+void PluginManager::evaluateShadow(const std::string& live_path, const std::shared_ptr<Shadow>& shadow,
+                                   std::chrono::steady_clock::time_point started) {
+    {
+        std::lock_guard<std::mutex> lock(plugins_mutex_);
+        auto it = shadows_.find(live_path);
+        if (it == shadows_.end() || it->second != shadow) {
+            return;  // Superseded
         }
     }
-    
-    // Clean up old modification time entries
+
+    auto const live = shadow->live();
+    auto const candidate = shadow->candidate();
+    bool const comparable = candidate.samples >= SHADOW_MIN_SAMPLES && live.samples >= SHADOW_MIN_SAMPLES;
+    bool const waiting = std::chrono::steady_clock::now() - started < rollout_.timeout ||
+                         (!comparable && rollout_.low_traffic == LowTraffic::wait);
+    // Below SHADOW_MIN_SAMPLES the sample target alone does not end the wait,
+    // the versions could not be compared yet
+    bool const enough = candidate.samples >= rollout_.samples && comparable;
+    if (!enough && waiting && std::filesystem::exists(shadow->path())) {
+        scheduler_->schedule("shadow " + live_path, SHADOW_CHECK_INTERVAL,
+                             [this, live_path, shadow, started] { evaluateShadow(live_path, shadow, started); });
+        return;
+    }
+
+    // Handler times are compared with a relative margin plus a small
+    // absolute slack, microsecond handlers differ by scheduling noise alone
+    bool promote = true;
+    std::string reason;
+    auto error_rate = [](const Shadow::Summary& summary) {
+        return static_cast<double>(summary.errors) / static_cast<double>(summary.samples);
+    };
+    if (!std::filesystem::exists(shadow->path())) {
+        promote = false;
+        reason = "its file was deleted";
+    } else if (!comparable) {
+        promote = rollout_.low_traffic == LowTraffic::promote;
+        reason = "too little traffic to compare";
+    } else if (error_rate(candidate) > error_rate(live) + SHADOW_ERROR_TOLERANCE) {
+        promote = false;
+        reason = "it fails more often";
+    } else if (candidate.p50 > live.p50 * (1 + rollout_.margin) + SHADOW_LATENCY_SLACK_US) {
+        promote = false;
+        reason = "its median is slower";
+    } else if (candidate.p99 > live.p99 * (1 + rollout_.margin) + SHADOW_LATENCY_SLACK_US) {
+        promote = false;
+        reason = "its p99 is slower";
+    }
+
+    LOG_INFO << (!promote ? "Rolling back " : comparable ? "Promoting " : "Promoted without comparison: ")
+             << shadow->path().filename()
+             << (reason.empty() ? "" : ", " + reason) << ". Live: " << live.samples << " samples, p50 "
+             << live.p50 << " us, p99 " << live.p99 << " us, " << live.errors << " errors. New: "
+             << candidate.samples << " samples, p50 " << candidate.p50 << " us, p99 " << candidate.p99
+             << " us, " << candidate.errors << " errors";
+
+    shadow->stop();
+    auto const candidate_path = shadow->path().string();
+    auto const route = shadow->plugin()->getMethod() + " " + shadow->plugin()->getPath();
+    if (promote) {
+        {
+            std::lock_guard<std::mutex> lock(plugins_mutex_);
+            shadows_.erase(live_path);
+            plugins_.erase(live_path);
+            plugins_[candidate_path] = shadow->plugin();
+            publishRoutes();
+        }
+        loader_->unloadPlugin(live_path);
+        backups_->add(route, shadow->path(), deployedName(shadow->path()));
+        return;
+    }
+
     {
-        std::lock_guard<std::mutex> lock(mod_times_mutex);
-        auto now = std::chrono::steady_clock::now();
-        for (auto it = last_mod_times.begin(); it != last_mod_times.end();) {
-            if (now - it->second > std::chrono::seconds(60)) {
-                it = last_mod_times.erase(it);
-            } else {
-                ++it;
+        std::lock_guard<std::mutex> lock(plugins_mutex_);
+        shadows_.erase(live_path);
+        publishRoutes();
+    }
+    loader_->unloadPlugin(candidate_path);
+
+    // Set the rejected file aside, so it is not loaded as the newest version
+    // at the next start
+    std::error_code ec;
+    auto rejected = shadow->path();
+    rejected += ".rejected";
+    std::filesystem::rename(shadow->path(), rejected, ec);
+
+    // A deployment that removed the live file gets it back from the store,
+    // as a link to the stored version rather than a copy
+    if (!std::filesystem::exists(live_path)) {
+        auto const live_file = deployedName(live_path);
+        bool restored = false;
+        for (const auto& version : backups_->history(route)) {
+            if (version.file == live_file) {
+                restored = backups_->restore(version.id, live_path);
+                break;
             }
         }
+        if (restored) {
+            LOG_INFO << "Restored " << live_path << " from its backup";
+        } else {
+            LOG_WARNING << "No backup of " << live_path << ", it serves until the next start";
+        }
     }
 }
 
-std::vector<std::filesystem::path> PluginManager::getBackupFiles() const {
-    std::lock_guard<std::mutex> lock(backup_mutex_);
-    return std::vector<std::filesystem::path>(backup_files_.begin(), backup_files_.end());
-}
-
 } // namespace core 
\ No newline at end of file
@@ -1,24 +1,40 @@
 #pragma once
 
 #include "Plugin.hpp"
+#include "BackupStore.hpp"
 #include "DynamicLoader.hpp"
+#include "Epoch.hpp"
 #include "FileMonitor.hpp"
+#include "PluginManifest.hpp"
+#include "ReloadScheduler.hpp"
+#include "RouteTable.hpp"
+#include "Shadow.hpp"
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <mutex>
 #include <filesystem>
 #include <chrono>
-#include <deque>
 #include <atomic>
 #include <map>
+#include <optional>
+#include <set>
+#include <vector>
+#include <cstdint>
+#include <sys/types.h>
 
 namespace core {
 
 class PluginManager {
 public:
-    static constexpr size_t MAX_BACKUP_FILES = 2;
     static constexpr auto PLUGIN_OPERATION_TIMEOUT = std::chrono::seconds(5);
+    static constexpr size_t STARTUP_LOAD_THREADS = 4;  // At least, more on bigger machines
+    static constexpr size_t WARMUP_ITERATIONS = 8;  // Per warm-up request
+    static constexpr auto SHADOW_CHECK_INTERVAL = std::chrono::milliseconds(250);
+    static constexpr size_t SHADOW_MIN_SAMPLES = 20;  // Per version, fewer cannot be compared
+    static constexpr double SHADOW_LATENCY_SLACK_US = 50;
+    static constexpr double SHADOW_ERROR_TOLERANCE = 0.01;  // Extra error rate allowed
 
     PluginManager();
     ~PluginManager();
@@ -27,8 +43,15 @@ public:
     PluginManager(const PluginManager&) = delete;
     PluginManager& operator=(const PluginManager&) = delete;
 
-    // Initialize the plugin manager with a directory to monitor
-    void initialize(const std::filesystem::path& pluginDir);
+    // How new versions of endpoints replace the live ones, set before
+    // initialize. By default they take over as soon as they are warmed up.
+    void setRolloutPolicy(const RolloutPolicy& policy) { rollout_ = policy; }
+
+    // Initialize the plugin manager with the directories to monitor, each
+    // with its subdirectories except hidden ones. Loads the newest plugin for
+    // every route found there before returning. Backups are kept in the
+    // first directory.
+    void initialize(const std::vector<std::filesystem::path>& pluginDirs);
 
     // Start monitoring for plugin changes
     void start();
@@ -42,53 +65,161 @@ public:
     // Get all plugins of a specific type
     std::vector<std::shared_ptr<Plugin>> getPluginsByType(PluginType type) const;
 
+    // Get the current route snapshot. Wait-free and safe to call from any
+    // thread registered with core::Epoch. The reference, and the plugins the
+    // routes point to, stay valid until the thread's next quiescent state,
+    // or for as long as an Epoch::Pin held since then.
+    const RouteTable& getRouteTable() const {
+        Epoch::online();
+        return *route_table_.load(std::memory_order_acquire);
+    }
+
+    // Retained versions of a route and the one serving it
+    struct RouteHistory {
+        std::vector<BackupStore::Version> versions;  // Newest first
+        std::string live;  // Id of the serving version, empty if it is not retained
+    };
+
+    // History of every route ("METHOD path") with retained versions. The
+    // routes of a plugin exporting several are listed together, separated
+    // by ", ".
+    std::map<std::string, RouteHistory> versions() const;
+
+    // Serve a retained version of its route again, loaded straight from the
+    // backup store. Runs on the reload thread and returns at once; done is
+    // called there with false if the version is unknown, damaged, fails to
+    // load or the rollback is dropped. The route keeps the version until a
+    // newer one is deployed or the server restarts.
+    void rollback(const std::string& id, std::function<void(bool)> done);
+
 private:
-    // Callback handlers for file monitoring
-    void onNewPlugin(const std::filesystem::path& path);
-    void onModifiedPlugin(const std::filesystem::path& path);
+    // Callback handlers for file monitoring. They only record the event and
+    // schedule its plugin's base name, the reload runs on scheduler_.
     void onDeletedPlugin(const std::filesystem::path& path);
     void onPluginWriteComplete(const std::filesystem::path& path);
 
-    // Backup management
-    void manageBackups(const std::filesystem::path& newFile);
-    void cleanupOldBackups();
-    std::filesystem::path createBackup(const std::filesystem::path& pluginFile);
-    void restoreFromBackup();
-
-    // Plugin operations with timeout
-    bool loadPluginWithTimeout(const std::filesystem::path& path, bool is_restore = false);
-    bool unloadPluginWithTimeout(const std::string& path);
+    // Readiness protocol. A plugin is picked up once it is complete: closed
+    // after writing or renamed into the directory, with a well formed ELF
+    // header that fits in the file, and matching its "<file>.sha256" sidecar
+    // if there is one. Returns false, with the reason in why, otherwise.
+    bool isPluginReady(const std::filesystem::path& path, std::string& why) const;
+
+    // Find the routes ("METHOD path", sorted) a plugin serves, from its
+    // manifest or, without one, by loading it. Logs and returns false for
+    // plugins that cannot be served.
+    bool inspectRoutes(const std::filesystem::path& abs_path,
+                       std::optional<PluginManifest>& manifest,
+                       std::vector<std::string>& routes);
+
+    // Load all plugins already in the directories concurrently and publish
+    // them in one route table
+    void loadExistingPlugins();
+
+    // The plugin files in every plugin directory tree
+    std::vector<std::filesystem::path> listPluginFiles() const;
+
+    // Name a plugin file is recorded under in the backup store: relative to
+    // the first plugin directory when it is inside it, absolute otherwise
+    std::string deployedName(const std::filesystem::path& path) const;
+
+    // Move "<file>.so.backup" copies of older releases into the backup store
+    void importLegacyBackups();
+
+    bool rollbackTo(const std::string& id);
+
+    // Load a plugin, check it against its manifest, initialize and warm it
+    // up. Returns nullptr, after logging why, if any step fails.
+    std::shared_ptr<Plugin> loadAndInitialize(const std::filesystem::path& path);
+
+    // Prefault the plugin's library and send the warm-up requests of each
+    // of its endpoints through them, WARMUP_ITERATIONS times each. Returns
+    // false if a request throws.
+    bool warmUp(const std::filesystem::path& path, const std::shared_ptr<Plugin>& plugin);
+
+    // Plugin operations, run on the reload scheduler. A load that takes
+    // longer than PLUGIN_OPERATION_TIMEOUT is rejected once it returns. The
+    // plugins serving any of its routes serve until the new one does, and
+    // are unloaded then.
+    bool loadPluginWithTimeout(const std::filesystem::path& path);
+    void unloadPlugin(const std::string& path);
+
+    // Load, initialize and warm up a plugin within PLUGIN_OPERATION_TIMEOUT
+    // without publishing it. Returns nullptr, unloaded again, on failure.
+    std::shared_ptr<Plugin> loadWithinTimeout(const std::filesystem::path& path);
+
+    // Staged rollout. The new version shadows the live one until enough
+    // copied requests were compared, then it is promoted or rolled back:
+    // unloaded, renamed to "<file>.rejected", and the live file restored from
+    // its backup if a deployment removed it.
+    bool startShadow(const std::filesystem::path& abs_path, const std::string& live_path);
+    void evaluateShadow(const std::string& live_path, const std::shared_ptr<Shadow>& shadow,
+                        std::chrono::steady_clock::time_point started);
 
     // Helper functions
-    std::vector<std::filesystem::path> getBackupFiles() const;
     bool isPluginFile(const std::filesystem::path& path) const;
     void cleanupPlugins();
 
-    struct PendingDelete {
-        std::filesystem::path so_path;
-        std::filesystem::path backup_path;
-        std::chrono::steady_clock::time_point timestamp;
-        bool so_deleted{false};
-        bool backup_deleted{false};
+    // Rebuild the route table from plugins_ and publish it (plugins_mutex_ must be held)
+    void publishRoutes();
+
+    // File events for one plugin base name, collected until the scheduler
+    // acts on all of them at once
+    struct PendingReload {
+        std::map<std::filesystem::path, std::chrono::steady_clock::time_point> written;  // -> ready time
+        std::set<std::filesystem::path> deleted;
     };
 
-    std::mutex pending_deletes_mutex_;
-    std::map<std::string, PendingDelete> pending_deletes_;  // base_name -> PendingDelete
-    
-    void handleBatchedDeletions(const std::string& base_name);
+    std::mutex pending_reloads_mutex_;
+    std::map<std::string, PendingReload> pending_reloads_;  // base_name -> PendingReload
+
+    void queueReload(const std::filesystem::path& abs_path, bool deleted);
+    void processPendingReload(const std::string& base_name);
+    // Returns true if the plugin serves its routes afterwards
+    bool reloadPlugin(const std::filesystem::path& abs_path, std::chrono::steady_clock::time_point ready_time);
+    // The plugin a file is a version of: its directory and the part of its
+    // name before the last "_"
     std::string getBaseName(const std::filesystem::path& path) const;
-    void processPendingDelete(const std::string& base_name, const PendingDelete& pending);
+    void processPendingDelete(const std::string& base_name, const std::set<std::filesystem::path>& deleted);
     
+    // A deletion waits this long for a replacement before falling back to
+    // an older version, completed writes are acted on at once
     static constexpr auto DELETION_BATCH_TIMEOUT = std::chrono::milliseconds(200);
 
+    static constexpr const char* BACKUP_DIRECTORY = ".backups";
+
+    // Identifies one version of a file. Several events report the same
+    // write, and a rename keeps the inode, so only a change here is a new
+    // version worth loading.
+    struct FileVersion {
+        std::uintmax_t size{0};
+        std::int64_t modified_ns{0};
+        ino_t inode{0};
+
+        bool operator==(const FileVersion& other) const {
+            return size == other.size && modified_ns == other.modified_ns && inode == other.inode;
+        }
+    };
+
+    static FileVersion fileVersion(const std::filesystem::path& path);
+
+    std::mutex seen_versions_mutex_;
+    std::unordered_map<std::string, FileVersion> seen_versions_;  // Last version handled per path
+
     std::shared_ptr<DynamicLoader> loader_;
     std::shared_ptr<FileMonitor> monitor_;
+    std::shared_ptr<ReloadScheduler> scheduler_;
     std::unordered_map<std::string, std::shared_ptr<Plugin>> plugins_;
+    std::map<std::string, std::shared_ptr<Shadow>> shadows_;  // Live path -> shadow, under plugins_mutex_
+    RolloutPolicy rollout_;
     mutable std::mutex plugins_mutex_;
-    std::filesystem::path plugin_directory_;
-    std::deque<std::filesystem::path> backup_files_;
-    mutable std::mutex backup_mutex_;
-    std::atomic<bool> is_restoring_{false};  // Flag to track restoration in progress
+    std::vector<std::filesystem::path> plugin_directories_;
+    std::shared_ptr<BackupStore> backups_;  // In BACKUP_DIRECTORY of the first plugin directory
+
+    // Published route snapshot. Readers hold no reference, a replaced table
+    // is retired through core::Epoch and destroyed after a grace period,
+    // which also releases the plugins only it still refers to.
+    std::atomic<const RouteTable*> route_table_{nullptr};
+    std::shared_ptr<const RouteTable> current_table_;
 };
 
 } // namespace core 
\ No newline at end of file
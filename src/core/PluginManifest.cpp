@@ -0,0 +1,206 @@
+#include "PluginManifest.hpp"
+#include "Plugin.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace core {
+
+namespace {
+
+// A file read with pread(). Not mapped: a plugin truncated by a deploy
+// while it is inspected would fault on the mapping, a read just comes up
+// short.
+class ElfFile {
+public:
+    explicit ElfFile(const std::filesystem::path& path)
+        : path_(path) {
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ == -1) {
+            throw std::runtime_error("cannot open " + path.string() + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || st.st_size <= 0) {
+            ::close(fd_);
+            throw std::runtime_error("cannot read " + path.string());
+        }
+        size_ = static_cast<std::uint64_t>(st.st_size);
+    }
+
+    ~ElfFile() {
+        ::close(fd_);
+    }
+
+    ElfFile(const ElfFile&) = delete;
+    ElfFile& operator=(const ElfFile&) = delete;
+
+    // Read bytes [offset, offset + length) into out, throws if they are not
+    // all in the file
+    void read(std::uint64_t offset, void* out, std::uint64_t length) const {
+        if (offset > size_ || length > size_ - offset) {
+            throw std::runtime_error("ELF structure points past the end of the file");
+        }
+        auto* data = static_cast<char*>(out);
+        std::uint64_t done = 0;
+        while (done < length) {
+            ssize_t n = ::pread(fd_, data + done, static_cast<std::size_t>(length - done),
+                                static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw std::runtime_error("cannot read " + path_.string() + ", it changed while it was read");
+            }
+            done += static_cast<std::uint64_t>(n);
+        }
+    }
+
+    std::string range(std::uint64_t offset, std::uint64_t length) const {
+        if (offset > size_ || length > size_ - offset) {
+            throw std::runtime_error("ELF structure points past the end of the file");
+        }
+        std::string bytes(static_cast<std::size_t>(length), '\0');
+        read(offset, bytes.data(), length);
+        return bytes;
+    }
+
+private:
+    std::filesystem::path path_;
+    int fd_ = -1;
+    std::uint64_t size_ = 0;
+};
+
+template<class T>
+T readAt(const ElfFile& file, std::uint64_t offset) {
+    T value;
+    file.read(offset, &value, sizeof(T));
+    return value;
+}
+
+PluginManifest parseManifest(std::string_view text) {
+    // Lines of key=value up to the terminating NUL
+    text = text.substr(0, text.find('\0'));
+
+    PluginManifest manifest;
+    while (!text.empty()) {
+        auto line = text.substr(0, text.find('\n'));
+        text.remove_prefix(std::min(text.size(), line.size() + 1));
+        if (line.empty()) {
+            continue;
+        }
+
+        auto eq = line.find('=');
+        if (eq == std::string_view::npos) {
+            throw std::runtime_error("malformed manifest line: " + std::string(line));
+        }
+        auto key = line.substr(0, eq);
+        auto value = line.substr(eq + 1);
+        if (key == "abi") {
+            manifest.abi_version = std::atoi(std::string(value).c_str());
+        } else if (key == "c_abi") {
+            manifest.c_abi_version = std::atoi(std::string(value).c_str());
+        } else if (key == "name") {
+            manifest.name = value;
+        } else if (key == "type") {
+            manifest.type = value;
+        } else if (key == "route") {
+            auto space = value.find(' ');
+            if (space == std::string_view::npos || space == 0 || space + 1 == value.size()) {
+                throw std::runtime_error("malformed manifest route: " + std::string(value));
+            }
+            manifest.routes.push_back({std::string(value.substr(0, space)), std::string(value.substr(space + 1))});
+        }
+        // Unknown keys are left for newer servers
+    }
+
+    if ((manifest.abi_version <= 0 && manifest.c_abi_version <= 0) || manifest.name.empty() ||
+        manifest.type.empty()) {
+        throw std::runtime_error("manifest lacks abi, name or type");
+    }
+    return manifest;
+}
+
+} // namespace
+
+std::string buildIdFromNote(std::string_view note) {
+    // Notes are a header, the owner name and the descriptor, each 4-aligned
+    auto align = [](std::uint64_t n) { return (n + 3) & ~std::uint64_t{3}; };
+    while (note.size() >= sizeof(ElfW(Nhdr))) {
+        ElfW(Nhdr) header;
+        std::memcpy(&header, note.data(), sizeof(header));
+        std::uint64_t name_at = sizeof(header);
+        std::uint64_t desc_at = name_at + align(header.n_namesz);
+        std::uint64_t next = desc_at + align(header.n_descsz);
+        if (desc_at + header.n_descsz > note.size()) {
+            break;
+        }
+        if (header.n_type == NT_GNU_BUILD_ID &&
+            note.substr(name_at, header.n_namesz) == std::string_view("GNU", 4)) {
+            static constexpr char hex[] = "0123456789abcdef";
+            std::string id;
+            for (auto c : note.substr(desc_at, header.n_descsz)) {
+                auto byte = static_cast<unsigned char>(c);
+                id.push_back(hex[byte >> 4]);
+                id.push_back(hex[byte & 0xf]);
+            }
+            return id;
+        }
+        if (next >= note.size()) {
+            break;
+        }
+        note.remove_prefix(next);
+    }
+    return {};
+}
+
+std::optional<PluginManifest> PluginManifest::read(const std::filesystem::path& path) {
+    ElfFile file(path);
+
+    auto header = readAt<ElfW(Ehdr)>(file, 0);
+    if (std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0) {
+        throw std::runtime_error("not an ELF file");
+    }
+    if (header.e_shentsize != sizeof(ElfW(Shdr)) || header.e_shstrndx >= header.e_shnum) {
+        throw std::runtime_error("unexpected section header layout");
+    }
+
+    // The section headers in one read, then only the sections looked at
+    std::vector<ElfW(Shdr)> sections(header.e_shnum);
+    file.read(header.e_shoff, sections.data(), sections.size() * sizeof(ElfW(Shdr)));
+    auto const& names = sections[header.e_shstrndx];
+    auto const names_bytes = file.range(names.sh_offset, names.sh_size);
+    std::string_view name_table = names_bytes;
+
+    std::optional<PluginManifest> manifest;
+    std::string build_id;
+    for (const auto& shdr : sections) {
+        if (shdr.sh_name >= name_table.size() || shdr.sh_type == SHT_NOBITS) {
+            continue;
+        }
+        auto name = name_table.substr(shdr.sh_name);
+        name = name.substr(0, name.find('\0'));
+
+        if (name == PLUGIN_MANIFEST_SECTION) {
+            manifest = parseManifest(file.range(shdr.sh_offset, shdr.sh_size));
+        } else if (name == ".note.gnu.build-id") {
+            build_id = buildIdFromNote(file.range(shdr.sh_offset, shdr.sh_size));
+        }
+    }
+
+    if (manifest) {
+        manifest->build_id = std::move(build_id);
+    }
+    return manifest;
+}
+
+} // namespace core
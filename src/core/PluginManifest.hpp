@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace core {
+
+// Metadata a plugin embeds with PLUGIN_MANIFEST. It is read straight from
+// the ELF file, so a plugin can be inspected, and rejected, before any of
+// its code is loaded or run.
+struct PluginManifest {
+    struct Route {
+        std::string method;
+        std::string path;
+    };
+
+    int abi_version = 0;  // PLUGIN_ABI_VERSION of a C++ plugin
+    int c_abi_version = 0;  // ENDPOINT_ABI_VERSION of a plugin exporting a C endpoint table
+    std::string name;
+    std::string type;  // "endpoint"
+    std::vector<Route> routes;
+    std::string build_id;  // Hex GNU build id, empty if the linker added none
+
+    // Read the manifest of a plugin file. Returns nullopt if the file has no
+    // manifest section, throws std::runtime_error if the file or the
+    // manifest is malformed.
+    static std::optional<PluginManifest> read(const std::filesystem::path& path);
+};
+
+// Hex GNU build id among the notes of an ELF note section or PT_NOTE
+// segment, empty if they hold none
+std::string buildIdFromNote(std::string_view note);
+
+} // namespace core
@@ -0,0 +1,79 @@
+#include "ReloadScheduler.hpp"
+#include "Logger.hpp"
+#include <boost/asio/post.hpp>
+
+namespace core {
+
+ReloadScheduler::ReloadScheduler() : work_(boost::asio::make_work_guard(context_)) {}
+
+ReloadScheduler::~ReloadScheduler() {
+    stop();
+}
+
+void ReloadScheduler::schedule(const std::string& key, std::chrono::steady_clock::duration delay,
+                               Action action) {
+    // Timers are only touched on the scheduler thread
+    auto deadline = std::chrono::steady_clock::now() + delay;
+    boost::asio::post(context_, [this, key, deadline, action = std::move(action)]() mutable {
+        arm(key, deadline, std::move(action));
+    });
+}
+
+void ReloadScheduler::arm(const std::string& key, std::chrono::steady_clock::time_point deadline,
+                          Action action) {
+    auto& pending = pending_[key];
+    if (!pending) {
+        pending = std::make_unique<Pending>(context_);
+    } else if (pending->timer.expiry() <= deadline) {
+        // The wait already armed fires first and runs the new action
+        pending->action = std::move(action);
+        return;
+    }
+
+    // Moving the expiry cancels a wait already armed
+    pending->action = std::move(action);
+    pending->generation = ++generation_;
+    pending->timer.expires_at(deadline);
+    pending->timer.async_wait([this, key, generation = pending->generation](boost::system::error_code ec) {
+        if (!ec) {
+            run(key, generation);
+        }
+    });
+}
+
+void ReloadScheduler::run(const std::string& key, std::uint64_t generation) {
+    auto it = pending_.find(key);
+    if (it == pending_.end() || it->second->generation != generation) {
+        return;
+    }
+    auto action = std::move(it->second->action);
+    pending_.erase(it);
+
+    try {
+        action();
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Reload of " << key << " failed: " << e.what();
+    }
+}
+
+void ReloadScheduler::start() {
+    if (!running_.exchange(true)) {
+        context_.restart();
+        thread_ = std::thread([this] { context_.run(); });
+    }
+}
+
+void ReloadScheduler::stop() {
+    if (running_.exchange(false)) {
+        // Drop pending work on the scheduler thread, then let run() return
+        boost::asio::post(context_, [this] {
+            pending_.clear();
+            context_.stop();
+        });
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+}
+
+} // namespace core
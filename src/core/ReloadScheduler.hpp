@@ -0,0 +1,63 @@
+#pragma once
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace core {
+
+// Runs reload work one action at a time on a thread of its own. Work is
+// keyed, by plugin base name for the plugin manager: scheduling a key that
+// already has an action pending replaces it instead of queueing another, so
+// a burst of file events costs one action per plugin. Delays are timers on
+// the scheduler's io_context, no thread sleeps or is spawned to wait.
+class ReloadScheduler {
+public:
+    using Action = std::function<void()>;
+
+    ReloadScheduler();
+    ~ReloadScheduler();
+
+    // Prevent copying
+    ReloadScheduler(const ReloadScheduler&) = delete;
+    ReloadScheduler& operator=(const ReloadScheduler&) = delete;
+
+    // Run action once delay has passed. An action already pending for key is
+    // replaced, and the new one runs at the earlier of the two deadlines.
+    // Safe to call from any thread, including from an action.
+    void schedule(const std::string& key, std::chrono::steady_clock::duration delay, Action action);
+
+    void start();
+
+    // Stop after the running action, if any. Pending actions are dropped.
+    void stop();
+
+private:
+    struct Pending {
+        explicit Pending(boost::asio::io_context& context) : timer(context) {}
+
+        boost::asio::steady_timer timer;
+        Action action;
+        std::uint64_t generation{0};  // Tells a stale timer completion apart
+    };
+
+    void arm(const std::string& key, std::chrono::steady_clock::time_point deadline, Action action);
+    void run(const std::string& key, std::uint64_t generation);
+
+    boost::asio::io_context context_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    std::map<std::string, std::unique_ptr<Pending>> pending_;  // Only used on thread_
+    std::uint64_t generation_{0};
+};
+
+} // namespace core
@@ -0,0 +1,186 @@
+#include "ResponseCache.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+
+namespace core {
+
+namespace {
+
+boost::beast::string_view view(std::string_view value) {
+    return boost::beast::string_view(value.data(), value.size());
+}
+
+std::string makeEtag(const std::string& body) {
+    std::uint64_t hash = 14695981039346656037ULL;  // FNV-1a
+    for (char c : body) {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+    char etag[24];
+    std::snprintf(etag, sizeof(etag), "\"%016llx\"", static_cast<unsigned long long>(hash));
+    return etag;
+}
+
+bool matchesEtag(const ResponseCache::Request& req, std::string_view etag) {
+    auto it = req.find(http::field::if_none_match);
+    if (it == req.end()) {
+        return false;
+    }
+    std::string_view value(it->value().data(), it->value().size());
+    return value == "*" || value.find(etag) != std::string_view::npos;
+}
+
+// Headers that describe the connection or the framing rather than the content
+bool isHopHeader(http::field name) {
+    return name == http::field::connection ||
+           name == http::field::keep_alive ||
+           name == http::field::content_length ||
+           name == http::field::transfer_encoding;
+}
+
+} // namespace
+
+ResponseCache::ResponseCache(CachePolicy policy)
+    : policy_(std::move(policy)) {
+    for (const auto& name : policy_.vary) {
+        if (!vary_header_.empty()) {
+            vary_header_ += ", ";
+        }
+        vary_header_ += name;
+    }
+}
+
+ResponseCache::Shard& ResponseCache::shardFor(std::string_view key) {
+    return shards_[std::hash<std::string_view>()(key) % SHARD_COUNT];
+}
+
+std::optional<ResponseCache::Response> ResponseCache::lookup(const Request& req) {
+    if (retired_.load(std::memory_order_relaxed) || req.method() != http::verb::get) {
+        return std::nullopt;
+    }
+
+    // Build the key in the connection's arena
+    ArenaString key(req.target().data(), req.target().size());
+    for (const auto& name : policy_.vary) {
+        auto value = req[view(name)];
+        key.push_back('\0');
+        key.append(value.data(), value.size());
+    }
+
+    EntryPtr entry;
+    {
+        std::string_view lookup_key(key.data(), key.size());
+        auto& shard = shardFor(lookup_key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(lookup_key);
+        if (it == shard.entries.end()) {
+            return std::nullopt;
+        }
+        if (it->second->expires <= Clock::now()) {
+            shard.entries.erase(it);
+            return std::nullopt;
+        }
+        entry = it->second;
+    }
+
+    Response res{entry->status, req.version()};
+    for (const auto& [name, value] : entry->headers) {
+        res.set(view(name), view(value));
+    }
+    res.keep_alive(req.keep_alive());
+
+    // A 304 carries no body and no Content-Length
+    if (matchesEtag(req, entry->etag)) {
+        res.result(http::status::not_modified);
+        return res;
+    }
+    res.body().append(entry->body);
+    res.prepare_payload();
+    return res;
+}
+
+void ResponseCache::store(const Request& req, Response& res) {
+    if (retired_.load(std::memory_order_relaxed) ||
+        req.method() != http::verb::get ||
+        res.result() != http::status::ok ||
+        res.body().isFile()) {
+        return;
+    }
+
+    // Flatten the body into one buffer shared by every later hit
+    std::string flat = std::move(res.body().text());
+    for (auto it = res.body().buffersBegin(); it != res.body().buffersEnd(); ++it) {
+        flat.append(static_cast<const char*>(it->data()), it->size());
+    }
+    auto body = std::make_shared<const std::string>(std::move(flat));
+
+    auto entry = std::make_shared<Entry>();
+    entry->key.assign(req.target().data(), req.target().size());
+    for (const auto& name : policy_.vary) {
+        auto value = req[view(name)];
+        entry->key.push_back('\0');
+        entry->key.append(value.data(), value.size());
+    }
+    entry->expires = Clock::now() + policy_.ttl;
+    entry->status = res.result();
+    entry->body = body;
+    entry->etag = makeEtag(*body);
+
+    res.set(http::field::etag, view(entry->etag));
+    if (!vary_header_.empty()) {
+        res.set(http::field::vary, view(vary_header_));
+    }
+    for (const auto& field : res) {
+        if (!isHopHeader(field.name())) {
+            entry->headers.emplace_back(std::string(field.name_string()), std::string(field.value()));
+        }
+    }
+
+    res.body().clear();
+    if (matchesEtag(req, entry->etag)) {
+        res.result(http::status::not_modified);
+        res.erase(http::field::content_length);
+    } else {
+        res.body().append(body);
+        res.prepare_payload();
+    }
+
+    auto& shard = shardFor(entry->key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // retire() sets the flag before it clears this shard under the same
+    // lock, so either the flag is seen here or the entry is cleared
+    if (retired_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    shard.entries.erase(entry->key);
+    if (shard.entries.size() >= MAX_ENTRIES_PER_SHARD) {
+        auto now = Clock::now();
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            if (it->second->expires <= now) {
+                it = shard.entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (shard.entries.size() >= MAX_ENTRIES_PER_SHARD) {
+            shard.entries.erase(shard.entries.begin());
+        }
+    }
+    std::string_view key = entry->key;
+    shard.entries.emplace(key, std::move(entry));
+}
+
+void ResponseCache::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.entries.clear();
+    }
+}
+
+void ResponseCache::retire() {
+    retired_.store(true, std::memory_order_relaxed);
+    clear();
+}
+
+} // namespace core
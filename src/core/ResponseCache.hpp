@@ -0,0 +1,86 @@
+#pragma once
+
+#include "../plugins/endpoints/EndpointPlugin.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace core {
+
+// Responses of one route, kept for the TTL of the route's cache policy.
+// Entries are spread over independently locked shards so concurrent
+// requests rarely contend. Every cached response gets an ETag derived from
+// its body, and a request whose If-None-Match matches a fresh entry is
+// answered with 304 without touching the plugin.
+//
+// A cache belongs to one plugin instance. PluginManager hands it over to the
+// next route table while the same instance stays loaded and clears it when
+// the endpoint is replaced or unloaded.
+class ResponseCache {
+public:
+    using Request = plugins::endpoint::EndpointPlugin::Request;
+    using Response = plugins::endpoint::EndpointPlugin::Response;
+    using CachePolicy = plugins::endpoint::EndpointPlugin::CachePolicy;
+
+    static constexpr std::size_t SHARD_COUNT = 16;
+    static constexpr std::size_t MAX_ENTRIES_PER_SHARD = 1024;
+
+    explicit ResponseCache(CachePolicy policy);
+
+    // Prevent copying
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    const CachePolicy& policy() const { return policy_; }
+
+    // Response for a fresh entry, or nullopt if the handler has to run
+    std::optional<Response> lookup(const Request& req);
+
+    // Remember a response the handler produced for req. Adds the ETag and
+    // turns the response into a 304 when the client already has this body.
+    void store(const Request& req, Response& res);
+
+    // Drop every entry
+    void clear();
+
+    // Drop every entry and stop storing or serving entries. Requests that
+    // still use an older route table then fall through to the plugin.
+    void retire();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string key;
+        Clock::time_point expires;
+        http::status status;
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::shared_ptr<const std::string> body;
+        std::string etag;
+    };
+
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string_view, EntryPtr> entries;  // Keys view Entry::key
+    };
+
+    Shard& shardFor(std::string_view key);
+
+    CachePolicy policy_;
+    std::string vary_header_;  // Vary value sent with cached responses
+    std::atomic<bool> retired_{false};
+    std::array<Shard, SHARD_COUNT> shards_;
+};
+
+} // namespace core
@@ -0,0 +1,295 @@
+#include "RouteTable.hpp"
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/io_context.hpp>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+namespace core {
+
+namespace {
+
+enum class SegmentKind {
+    LITERAL,
+    INT_PARAM,
+    STR_PARAM,
+    WILDCARD
+};
+
+struct Segment {
+    SegmentKind kind;
+    std::string_view text;  // Literal text or parameter name
+};
+
+// Split a route pattern into segments. Every pattern has at least one
+// segment, "/" is a single empty literal.
+std::vector<Segment> parsePattern(std::string_view pattern) {
+    if (pattern.empty() || pattern.front() != '/') {
+        throw std::invalid_argument("Route pattern must start with '/': " + std::string(pattern));
+    }
+
+    std::vector<Segment> segments;
+    std::string_view rest = pattern.substr(1);
+    while (true) {
+        auto slash = rest.find('/');
+        auto text = rest.substr(0, slash);
+
+        if (!segments.empty() && segments.back().kind == SegmentKind::WILDCARD) {
+            throw std::invalid_argument("Wildcard must be the last segment: " + std::string(pattern));
+        }
+
+        if (text == "*") {
+            segments.push_back({SegmentKind::WILDCARD, text});
+        } else if (!text.empty() && text.front() == '{') {
+            if (text.back() != '}' || text.size() < 3) {
+                throw std::invalid_argument("Malformed parameter in route pattern: " + std::string(pattern));
+            }
+            auto inner = text.substr(1, text.size() - 2);
+            auto colon = inner.find(':');
+            auto name = inner.substr(0, colon);
+            auto type = (colon == std::string_view::npos) ? std::string_view{} : inner.substr(colon + 1);
+
+            if (type.empty() && name.back() == '*') {
+                name.remove_suffix(1);
+                segments.push_back({SegmentKind::WILDCARD, name});
+            } else if (type.empty() || type == "str") {
+                segments.push_back({SegmentKind::STR_PARAM, name});
+            } else if (type == "int") {
+                segments.push_back({SegmentKind::INT_PARAM, name});
+            } else {
+                throw std::invalid_argument("Unknown parameter type '" + std::string(type) +
+                                            "' in route pattern: " + std::string(pattern));
+            }
+
+            if (name.empty()) {
+                throw std::invalid_argument("Unnamed parameter in route pattern: " + std::string(pattern));
+            }
+        } else if (text.find_first_of("{}") != std::string_view::npos) {
+            throw std::invalid_argument("Malformed segment in route pattern: " + std::string(pattern));
+        } else {
+            segments.push_back({SegmentKind::LITERAL, text});
+        }
+
+        if (slash == std::string_view::npos) {
+            break;
+        }
+        rest = rest.substr(slash + 1);
+    }
+    return segments;
+}
+
+bool isInteger(std::string_view text) {
+    if (!text.empty() && text.front() == '-') {
+        text.remove_prefix(1);
+    }
+    if (text.empty()) {
+        return false;
+    }
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+struct RouteTable::Node {
+    struct ParamEdge {
+        SegmentKind kind;
+        std::string_view name;
+        std::unique_ptr<Node> child;
+    };
+
+    std::unordered_map<std::string_view, std::unique_ptr<Node>> literals;
+    std::vector<ParamEdge> params;  // Int parameters before string parameters
+    const Route* route = nullptr;
+    const Route* wildcard = nullptr;
+    std::string_view wildcardName;
+};
+
+namespace {
+
+using Node = RouteTable::Node;
+
+// Match the remaining path (starting at the current segment) below node.
+// Parameters pushed on a branch that fails are popped again.
+bool matchNode(const Node& node, std::string_view rest,
+               plugins::endpoint::RouteParams& params, const RouteTable::Route*& result) {
+    auto slash = rest.find('/');
+    auto segment = rest.substr(0, slash);
+    bool last = slash == std::string_view::npos;
+    auto tail = last ? std::string_view{} : rest.substr(slash + 1);
+
+    auto descend = [&](const Node& child) {
+        if (last) {
+            result = child.route;
+            return result != nullptr;
+        }
+        return matchNode(child, tail, params, result);
+    };
+
+    auto literal = node.literals.find(segment);
+    if (literal != node.literals.end() && descend(*literal->second)) {
+        return true;
+    }
+
+    if (!segment.empty()) {
+        for (const auto& edge : node.params) {
+            if (edge.kind == SegmentKind::INT_PARAM && !isInteger(segment)) {
+                continue;
+            }
+            if (!params.push(edge.name, segment)) {
+                break;
+            }
+            if (descend(*edge.child)) {
+                return true;
+            }
+            params.pop();
+        }
+    }
+
+    if (node.wildcard && params.push(node.wildcardName, rest)) {
+        result = node.wildcard;
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+RouteTable::RouteTable() = default;
+
+RouteTable::RouteTable(std::vector<Route> routes)
+    : routes_(std::move(routes)) {
+    for (const auto& route : routes_) {
+        try {
+            insert(route);
+        } catch (const std::invalid_argument& e) {
+            conflicts_.push_back({&route, e.what()});
+        }
+    }
+}
+
+RouteTable::~RouteTable() = default;
+
+void RouteTable::validatePattern(std::string_view pattern) {
+    parsePattern(pattern);
+}
+
+RouteTable::Route RouteTable::routeFor(http::verb method, std::string pattern,
+                                       std::shared_ptr<plugins::endpoint::EndpointPlugin> endpoint) {
+    Route route{method, std::move(pattern), std::move(endpoint)};
+    route.async_handler = route.plugin->getAsyncHandler();
+    if (!route.async_handler) {
+        route.handler = route.plugin->getRouteHandler();
+        route.blocking = route.plugin->isBlocking();
+    }
+    if (auto native = dynamic_cast<const NativeEndpoint*>(route.plugin.get())) {
+        route.native = &native->route();
+    }
+    return route;
+}
+
+void RouteTable::insert(const Route& route) {
+    auto segments = parsePattern(route.path);
+
+    auto& root = roots_[route.method];
+    if (!root) {
+        root = std::make_unique<Node>();
+    }
+
+    // First route wins. A later one that could never be matched is rejected
+    // rather than silently shadowed.
+    Node* node = root.get();
+    for (const auto& segment : segments) {
+        switch (segment.kind) {
+        case SegmentKind::LITERAL: {
+            auto& child = node->literals[segment.text];
+            if (!child) {
+                child = std::make_unique<Node>();
+            }
+            node = child.get();
+            break;
+        }
+        case SegmentKind::INT_PARAM:
+        case SegmentKind::STR_PARAM: {
+            // One edge per parameter type, a second name for the same
+            // segment would be unreachable behind the first
+            auto it = std::find_if(node->params.begin(), node->params.end(),
+                [&segment](const auto& edge) { return edge.kind == segment.kind; });
+            if (it == node->params.end()) {
+                // Keep int parameters ahead of string parameters
+                auto pos = (segment.kind == SegmentKind::INT_PARAM)
+                    ? std::find_if(node->params.begin(), node->params.end(),
+                          [](const auto& edge) { return edge.kind == SegmentKind::STR_PARAM; })
+                    : node->params.end();
+                it = node->params.insert(pos, {segment.kind, segment.text, std::make_unique<Node>()});
+            } else if (it->name != segment.text) {
+                throw std::invalid_argument("Parameter {" + std::string(segment.text) + "} of " + route.path +
+                                            " is already named {" + std::string(it->name) +
+                                            "} by another route");
+            }
+            node = it->child.get();
+            break;
+        }
+        case SegmentKind::WILDCARD:
+            if (node->wildcard) {
+                throw std::invalid_argument("Wildcard of " + route.path + " is already served by " +
+                                            node->wildcard->path);
+            }
+            node->wildcard = &route;
+            node->wildcardName = segment.text;
+            return;
+        }
+    }
+
+    if (node->route) {
+        throw std::invalid_argument(route.path + " is already served by " + node->route->path);
+    }
+    node->route = &route;
+}
+
+const RouteTable::Route* RouteTable::find(http::verb method, std::string_view target,
+                                          RouteParams& params) const {
+    auto root = roots_.find(method);
+    if (root == roots_.end() || target.empty() || target.front() != '/') {
+        return nullptr;
+    }
+
+    auto question = target.find('?');
+    auto path = target.substr(0, question);
+    if (question != std::string_view::npos) {
+        params.setQuery(target.substr(question + 1));
+    }
+
+    const Route* result = nullptr;
+    matchNode(*root->second, path.substr(1), params, result);
+    return result;
+}
+
+plugins::endpoint::EndpointPlugin::Response invokeRoute(const RouteTable::Route& route,
+                                                        const plugins::endpoint::EndpointPlugin::Request& req,
+                                                        const RouteTable::RouteParams& params) {
+    using Response = plugins::endpoint::EndpointPlugin::Response;
+    if (!route.async_handler) {
+        return callRoute(route, req, params);
+    }
+
+    boost::asio::io_context context;
+    std::exception_ptr error;
+    Response res;
+    boost::asio::co_spawn(context, route.async_handler(req, params),
+        [&error, &res](std::exception_ptr e, Response result) {
+            error = e;
+            res = std::move(result);
+        });
+    context.run();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return res;
+}
+
+} // namespace core
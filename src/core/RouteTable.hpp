@@ -0,0 +1,111 @@
+#pragma once
+
+#include "NativeEndpoint.hpp"
+#include "ResponseCache.hpp"
+#include "../plugins/endpoints/EndpointPlugin.hpp"
+#include <boost/beast/http/verb.hpp>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace core {
+
+class Shadow;
+
+// Immutable, pre-compiled snapshot of every endpoint route.
+// Built by PluginManager whenever the plugin set changes and then published
+// as a whole, so readers never need a lock or a refcount to use it.
+//
+// Route patterns are compiled into one prefix tree per method, with one edge
+// per path segment. Literal segments are hashed, so a lookup costs one probe
+// per segment of the request path no matter how many routes are loaded.
+// Supported segments:
+//   literal     "/users"
+//   parameter   "/{id}" or "/{id:str}" (any non-empty segment), "/{id:int}"
+//   wildcard    "/{rest*}" or "/*" (last segment only, captures the remainder)
+// Literal segments are tried first, then int parameters, then string
+// parameters and finally the wildcard. Routes that share a parameter segment
+// must give it the same name, a route that conflicts with an earlier one is
+// listed in conflicts() instead of being served.
+class RouteTable {
+public:
+    using RouteParams = plugins::endpoint::RouteParams;
+
+    struct Route {
+        http::verb method = http::verb::unknown;
+        std::string path{};  // Route pattern
+        std::shared_ptr<plugins::endpoint::EndpointPlugin> plugin{};
+        plugins::endpoint::EndpointPlugin::RouteHandler handler{};
+        const endpoint_route_v1* native = nullptr;  // Called directly instead of handler when set
+        plugins::endpoint::EndpointPlugin::AsyncHandler async_handler{};  // Used instead of handler when set
+        std::shared_ptr<ResponseCache> cache{};  // Null unless the endpoint opted in
+        std::shared_ptr<Shadow> shadow{};  // New version trying out copies of sampled requests
+        bool blocking = false;  // Run handler on the worker pool
+    };
+
+    RouteTable();
+    explicit RouteTable(std::vector<Route> routes);
+    ~RouteTable();
+
+    // Prevent copying, the tree points into routes_
+    RouteTable(const RouteTable&) = delete;
+    RouteTable& operator=(const RouteTable&) = delete;
+
+    // Find the route for a method and request target. The query string is
+    // split off and, like the path parameters, stored in params.
+    // Returns nullptr if there is no matching route.
+    const Route* find(http::verb method, std::string_view target, RouteParams& params) const;
+
+    // A route that was left out because an earlier one already takes its
+    // requests, such as /users/{uid} after /users/{id}
+    struct Conflict {
+        const Route* route;
+        std::string reason;
+    };
+
+    std::size_t size() const { return routes_.size(); }
+    const std::vector<Route>& routes() const { return routes_; }
+    const std::vector<Conflict>& conflicts() const { return conflicts_; }
+
+    // Check that a route pattern compiles, throws std::invalid_argument if not
+    static void validatePattern(std::string_view pattern);
+
+    // Route serving an endpoint: its async handler, else its route handler
+    // and whether that blocks, and the direct call of a native endpoint.
+    // Neither handler is set if the endpoint has none.
+    static Route routeFor(http::verb method, std::string pattern,
+                          std::shared_ptr<plugins::endpoint::EndpointPlugin> endpoint);
+
+    // Compiled tree node, defined in RouteTable.cpp
+    struct Node;
+
+private:
+    // Throws std::invalid_argument if the route could never be matched
+    void insert(const Route& route);
+
+    std::vector<Route> routes_;
+    std::vector<Conflict> conflicts_;
+    std::unordered_map<http::verb, std::unique_ptr<Node>> roots_;
+};
+
+// Run a route's synchronous handler
+inline plugins::endpoint::EndpointPlugin::Response callRoute(const RouteTable::Route& route,
+                                                             const plugins::endpoint::EndpointPlugin::Request& req,
+                                                             const RouteTable::RouteParams& params) {
+    if (route.native) {
+        return callNative(*route.native, req, params);
+    }
+    return route.handler(req, params);
+}
+
+// Run a route's handler to completion on the calling thread, a coroutine
+// handler on an io_context of its own. For requests the server makes up
+// off the IO threads, such as warm-up and shadow requests.
+plugins::endpoint::EndpointPlugin::Response invokeRoute(const RouteTable::Route& route,
+                                                        const plugins::endpoint::EndpointPlugin::Request& req,
+                                                        const RouteTable::RouteParams& params);
+
+} // namespace core
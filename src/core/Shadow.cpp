@@ -0,0 +1,106 @@
+#include "Shadow.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace core {
+
+Shadow::Shadow(std::shared_ptr<EndpointPlugin> candidate, std::filesystem::path path, double sample_rate)
+    : candidate_(std::move(candidate))
+    , path_(std::move(path))
+    , every_(sample_rate > 0 ? static_cast<std::uint64_t>(std::max(1.0, std::round(1.0 / sample_rate))) : 0)
+    , pool_(1, QUEUE_CAPACITY) {
+    // Copies are routed like the live requests, so path parameters and the
+    // query reach the new version's handler
+    std::vector<RouteTable::Route> routes;
+    routes.push_back(RouteTable::routeFor(http::string_to_verb(candidate_->getMethod()), candidate_->getPath(),
+                                          candidate_));
+    table_ = std::make_unique<RouteTable>(std::move(routes));
+}
+
+Shadow::~Shadow() {
+    stop();
+}
+
+void Shadow::recordLive(std::chrono::steady_clock::duration elapsed, bool error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (live_us_.size() < MAX_SAMPLES) {
+        live_us_.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        live_errors_ += error;
+    }
+}
+
+void Shadow::mirror(const Request& req) {
+    if (req.method() != http::verb::get && req.method() != http::verb::head) {
+        return;
+    }
+    // Copies of arena-backed fields go to the heap, this one outlives the
+    // connection's request
+    pool_.trySubmit([this, copy = Request(req)] { handle(copy); });
+}
+
+void Shadow::handle(const Request& req) {
+    if (every_.load(std::memory_order_relaxed) == 0) {
+        return;  // Stopped, draining the queue
+    }
+
+    plugins::endpoint::RouteParams params;
+    auto const target = req.target();
+    auto const* route = table_->find(req.method(), std::string_view(target.data(), target.size()), params);
+    if (!route) {
+        return;
+    }
+
+    bool error = false;
+    auto const start = std::chrono::steady_clock::now();
+    try {
+        Arena::Scope scope(arena_);
+        auto res = invokeRoute(*route, req, params);
+        error = res.result_int() >= 500;
+    } catch (const std::exception& e) {
+        LOG_DEBUG << "Shadow request to " << path_.filename() << " failed: " << e.what();
+        error = true;
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    arena_.reset();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (candidate_us_.size() < MAX_SAMPLES) {
+        candidate_us_.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        candidate_errors_ += error;
+    }
+}
+
+void Shadow::stop() {
+    every_.store(0, std::memory_order_relaxed);
+    pool_.stop();
+}
+
+Shadow::Summary Shadow::live() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return summarize(live_us_, live_errors_);
+}
+
+Shadow::Summary Shadow::candidate() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return summarize(candidate_us_, candidate_errors_);
+}
+
+Shadow::Summary Shadow::summarize(std::vector<double> samples, std::size_t errors) {
+    Summary summary;
+    summary.samples = samples.size();
+    summary.errors = errors;
+    if (samples.empty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double q) {
+        return samples[std::min(samples.size() - 1, static_cast<std::size_t>(q * samples.size()))];
+    };
+    summary.p50 = at(0.50);
+    summary.p99 = at(0.99);
+    return summary;
+}
+
+} // namespace core
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "Arena.hpp"
+#include "RouteTable.hpp"
+#include "WorkerPool.hpp"
+#include "../plugins/endpoints/EndpointPlugin.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace core {
+
+// What a staged rollout does when it times out with too few samples of
+// either version to compare them
+enum class LowTraffic {
+    promote,  // Promote the new version without a comparison
+    wait,     // Keep shadowing until both versions have enough samples
+    keep      // Keep the live version and set the new one aside
+};
+
+// How a new version of an endpoint replaces the live one. With a zero
+// sample rate it takes over as soon as it is warmed up. Otherwise it shadows
+// the live version first and is only promoted if it keeps up with it.
+struct RolloutPolicy {
+    double sample_rate{0};             // Fraction of live requests copied to the new version
+    double margin{0.10};               // Allowed slowdown of the median and p99 handler time
+    std::size_t samples{200};          // Copied requests needed for a decision
+    std::chrono::seconds timeout{60};  // Decide with the samples there are after this long
+    LowTraffic low_traffic{LowTraffic::promote};  // At the timeout, with too few samples to compare
+};
+
+// A new version of an endpoint trying out copies of a sample of the live
+// route's requests. The copies are handled on a thread of the shadow's own,
+// off the IO threads and the worker pool, and their responses are dropped.
+// Handler time and errors of both versions are recorded for the comparison
+// that decides whether the new version is promoted.
+//
+// The two times are not taken under the same conditions: the live version
+// runs on a loaded IO or worker thread, the new version on an idle thread
+// of its own. The new version tends to look faster than it will be once it
+// is live, which --shadow-margin has to allow for.
+//
+// Only GET and HEAD requests are copied, handling another method twice
+// could repeat its side effects.
+class Shadow {
+public:
+    using EndpointPlugin = plugins::endpoint::EndpointPlugin;
+    using Request = EndpointPlugin::Request;
+
+    static constexpr std::size_t QUEUE_CAPACITY = 64;  // Copies waiting, more are dropped
+    static constexpr std::size_t MAX_SAMPLES = 10000;  // Per version
+
+    // Handler time percentiles, in microseconds
+    struct Summary {
+        std::size_t samples{0};
+        std::size_t errors{0};  // Exceptions and 5xx responses
+        double p50{0};
+        double p99{0};
+    };
+
+    Shadow(std::shared_ptr<EndpointPlugin> candidate, std::filesystem::path path, double sample_rate);
+    ~Shadow();
+
+    // Prevent copying
+    Shadow(const Shadow&) = delete;
+    Shadow& operator=(const Shadow&) = delete;
+
+    // Whether to copy this request of the live route. Wait-free, called on
+    // the IO threads.
+    bool sample() {
+        auto const every = every_.load(std::memory_order_relaxed);
+        return every != 0 && counter_.fetch_add(1, std::memory_order_relaxed) % every == 0;
+    }
+
+    // Handler time and outcome of the live version for a sampled request
+    void recordLive(std::chrono::steady_clock::duration elapsed, bool error);
+
+    // Queue a copy of a sampled request for the new version. The copy is
+    // dropped if the new version falls behind.
+    void mirror(const Request& req);
+
+    // Stop taking copies and drop the queued ones, waits for the one being
+    // handled
+    void stop();
+
+    Summary live() const;
+    Summary candidate() const;
+
+    const std::shared_ptr<EndpointPlugin>& plugin() const { return candidate_; }
+    const std::filesystem::path& path() const { return path_; }
+
+private:
+    void handle(const Request& req);
+    static Summary summarize(std::vector<double> samples, std::size_t errors);
+
+    std::shared_ptr<EndpointPlugin> candidate_;
+    std::filesystem::path path_;
+    std::unique_ptr<RouteTable> table_;  // The new version's route alone
+    std::atomic<std::uint64_t> every_;   // Copy one request in every_, 0 once stopped
+    std::atomic<std::uint64_t> counter_{0};
+    Arena arena_;                        // Used by pool_'s thread only
+
+    mutable std::mutex mutex_;
+    std::vector<double> live_us_;
+    std::vector<double> candidate_us_;
+    std::size_t live_errors_{0};
+    std::size_t candidate_errors_{0};
+
+    WorkerPool pool_;  // Last, stopped before the rest goes away
+};
+
+} // namespace core
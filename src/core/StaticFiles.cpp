@@ -0,0 +1,400 @@
+#include "StaticFiles.hpp"
+#include "Logger.hpp"
+#include <boost/beast/version.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace core {
+
+namespace {
+
+std::string_view contentTypeFor(std::string_view path) {
+    static const std::pair<std::string_view, std::string_view> types[] = {
+        {".html", "text/html"},
+        {".htm", "text/html"},
+        {".css", "text/css"},
+        {".js", "application/javascript"},
+        {".mjs", "application/javascript"},
+        {".json", "application/json"},
+        {".txt", "text/plain"},
+        {".xml", "application/xml"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".webp", "image/webp"},
+        {".ico", "image/x-icon"},
+        {".wasm", "application/wasm"},
+        {".woff", "font/woff"},
+        {".woff2", "font/woff2"},
+        {".pdf", "application/pdf"},
+        {".mp4", "video/mp4"},
+    };
+
+    auto dot = path.rfind('.');
+    if (dot != std::string_view::npos && path.find('/', dot) == std::string_view::npos) {
+        auto extension = path.substr(dot);
+        for (const auto& [suffix, type] : types) {
+            if (extension.size() == suffix.size() &&
+                std::equal(suffix.begin(), suffix.end(), extension.begin(),
+                           [](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); })) {
+                return type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+// Header values of a file, formatted without touching the heap
+struct Validators {
+    char lastModified[32];
+    char etag[40];
+
+    explicit Validators(const File& file) {
+        std::tm tm;
+        std::time_t modified = file.modifiedTime();
+        gmtime_r(&modified, &tm);
+        std::strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        std::snprintf(etag, sizeof(etag), "\"%llx-%llx\"",
+                      static_cast<unsigned long long>(modified),
+                      static_cast<unsigned long long>(file.size()));
+    }
+};
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Percent-decode a request path onto out, rejecting anything that could
+// leave the mounted directory once decoded. Empty and "." segments are
+// dropped, so every spelling of a file name maps to the one cache entry
+// that is invalidated when the file changes.
+bool appendDecodedPath(std::string_view path, ArenaString& out) {
+    auto start = out.size();
+    for (std::size_t i = 0; i < path.size(); ++i) {
+        char c = path[i];
+        if (c == '%') {
+            int high = i + 2 < path.size() ? hexValue(path[i + 1]) : -1;
+            int low = i + 2 < path.size() ? hexValue(path[i + 2]) : -1;
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            c = static_cast<char>(high * 16 + low);
+            i += 2;
+        }
+        if (c == '\0') {
+            return false;
+        }
+        out.push_back(c);
+    }
+
+    // Segments are moved down in place, the canonical path is never longer
+    auto end = out.size();
+    auto write = start;
+    bool directory = false;
+    for (auto pos = start; pos < end;) {
+        auto next = pos;
+        while (next < end && out[next] != '/') {
+            ++next;
+        }
+        std::string_view segment(out.data() + pos, next - pos);
+        if (segment == "..") {
+            return false;
+        }
+        directory = segment.empty() || segment == "." || next < end;
+        if (!segment.empty() && segment != ".") {
+            out[write++] = '/';
+            std::copy(out.data() + pos, out.data() + next, out.data() + write);
+            write += segment.size();
+        }
+        pos = next + 1;
+    }
+    out.resize(write);
+    if (directory) {
+        out.push_back('/');
+    }
+    return true;
+}
+
+bool readWhole(const File& file, std::string& out) {
+    out.resize(static_cast<std::size_t>(file.size()));
+    std::size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = ::pread(file.fd(), out.data() + done, out.size() - done, static_cast<off_t>(done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// Whether file is known by path alone. The monitor reports a change under
+// the name the file was written through, so a file reached through a
+// symlink or with other hard links could not have its entry dropped.
+bool reachedByOwnName(const File& file, std::string_view path) {
+    struct stat st;
+    if (::fstat(file.fd(), &st) != 0 || st.st_nlink != 1) {
+        return false;
+    }
+    char link[64];
+    std::snprintf(link, sizeof(link), "/proc/self/fd/%d", file.fd());
+    char target[4096];
+    auto size = ::readlink(link, target, sizeof(target));
+    return size > 0 && std::string_view(target, static_cast<std::size_t>(size)) == path;
+}
+
+bool matchesEtag(const StaticFiles::Request& req, std::string_view etag) {
+    auto it = req.find(http::field::if_none_match);
+    if (it == req.end()) {
+        return false;
+    }
+    std::string_view value(it->value().data(), it->value().size());
+    return value == "*" || value.find(etag) != std::string_view::npos;
+}
+
+StaticFiles::Response makeResponse(const StaticFiles::Request& req,
+                                   std::string_view contentType,
+                                   std::string_view lastModified,
+                                   std::string_view etag) {
+    auto view = [](std::string_view value) {
+        return boost::beast::string_view(value.data(), value.size());
+    };
+
+    StaticFiles::Response res{http::status::ok, req.version()};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, view(contentType));
+    res.set(http::field::last_modified, view(lastModified));
+    res.set(http::field::etag, view(etag));
+    res.keep_alive(req.keep_alive());
+    if (matchesEtag(req, etag)) {
+        res.result(http::status::not_modified);
+    }
+    return res;
+}
+
+} // namespace
+
+StaticFiles::StaticFiles(std::size_t cacheSize, std::size_t maxCachedFileSize)
+    : cache_size_(cacheSize)
+    , max_cached_file_size_(std::min(maxCachedFileSize, cacheSize)) {
+}
+
+StaticFiles::~StaticFiles() {
+    // The monitor thread calls back into the cache
+    stop();
+    for (const auto& mount : mounts_) {
+        ::close(mount.fd);
+    }
+}
+
+void StaticFiles::mount(const std::string& prefix, const std::filesystem::path& directory) {
+    Mount mount;
+    mount.prefix = prefix;
+    while (!mount.prefix.empty() && mount.prefix.back() == '/') {
+        mount.prefix.pop_back();
+    }
+    mount.root = std::filesystem::canonical(directory).string();
+    mount.fd = ::open(mount.root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (mount.fd < 0) {
+        throw std::filesystem::filesystem_error("Cannot open static directory", directory,
+                                                std::error_code(errno, std::generic_category()));
+    }
+
+    LOG_INFO << "Serving static files from " << mount.root << " at "
+             << (mount.prefix.empty() ? "/" : mount.prefix);
+
+    watchTree(mount.root);
+
+    // Longest prefix first, so nested mounts take precedence
+    auto pos = std::find_if(mounts_.begin(), mounts_.end(), [&](const Mount& other) {
+        return other.prefix.size() < mount.prefix.size();
+    });
+    mounts_.insert(pos, std::move(mount));
+}
+
+void StaticFiles::start() {
+    if (!mounts_.empty()) {
+        monitor_.start();
+    }
+}
+
+void StaticFiles::stop() {
+    monitor_.stop();
+}
+
+void StaticFiles::watchTree(const std::filesystem::path& directory) {
+    // A cached file must be dropped even if its writer keeps it open
+    WatchOptions options;
+    options.partialWrites = true;
+    options.recursive = true;
+
+    try {
+        monitor_.addWatch(directory, ".*",
+                          [this](const std::filesystem::path& path, FileEvent) { invalidate(path); },
+                          options);
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Failed to watch " << directory << ": " << e.what();
+    }
+}
+
+void StaticFiles::invalidate(const std::filesystem::path& path) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    ++generation_;
+    auto it = index_.find(path.native());
+    if (it == index_.end()) {
+        return;
+    }
+    auto entry = it->second;
+    cached_bytes_ -= (*entry)->body->size();
+    index_.erase(it);
+    lru_.erase(entry);
+}
+
+StaticFiles::EntryPtr StaticFiles::lookup(std::string_view path) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto it = index_.find(path);
+    if (it == index_.end()) {
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return *it->second;
+}
+
+void StaticFiles::insert(EntryPtr entry, std::uint64_t generation) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+
+    // The file changed while it was being read
+    if (generation != generation_ || index_.count(entry->path)) {
+        return;
+    }
+
+    cached_bytes_ += entry->body->size();
+    lru_.push_front(std::move(entry));
+    index_.emplace(lru_.front()->path, lru_.begin());
+
+    while (cached_bytes_ > cache_size_) {
+        const auto& victim = lru_.back();
+        cached_bytes_ -= victim->body->size();
+        index_.erase(victim->path);
+        lru_.pop_back();
+    }
+}
+
+std::optional<StaticFiles::Response> StaticFiles::serve(const Request& req) {
+    if (req.method() != http::verb::get && req.method() != http::verb::head) {
+        return std::nullopt;
+    }
+
+    std::string_view target(req.target().data(), req.target().size());
+    target = target.substr(0, target.find('?'));
+
+    auto mount = std::find_if(mounts_.begin(), mounts_.end(), [&](const Mount& m) {
+        return target.compare(0, m.prefix.size(), m.prefix) == 0 &&
+               (target.size() == m.prefix.size() || target[m.prefix.size()] == '/');
+    });
+    if (mount == mounts_.end()) {
+        return std::nullopt;
+    }
+
+    // Build the file name in the connection's arena
+    ArenaString path;
+    path.reserve(mount->root.size() + target.size() + 16);
+    path.append(mount->root);
+    if (!appendDecodedPath(target.substr(mount->prefix.size()), path)) {
+        return std::nullopt;
+    }
+    if (path.size() == mount->root.size() || path.back() == '/') {
+        path.append(path.back() == '/' ? "index.html" : "/index.html");
+    }
+
+    bool head = req.method() == http::verb::head;
+
+    if (auto entry = lookup(std::string_view(path.data(), path.size()))) {
+        auto res = makeResponse(req, entry->contentType, entry->lastModified, entry->etag);
+        if (res.result() == http::status::not_modified) {
+            return res;
+        }
+        if (head) {
+            res.content_length(entry->body->size());
+            return res;
+        }
+        res.body().append(entry->body);
+        res.prepare_payload();
+        return res;
+    }
+
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        generation = generation_;
+    }
+
+    // Open relative to the mount, so a symlink cannot lead out of it
+    auto relative = [&path, &mount] {
+        auto start = path.find_first_not_of('/', mount->root.size());
+        return path.c_str() + (start == ArenaString::npos ? path.size() : start);
+    };
+    std::error_code ec;
+    auto file = File::openBeneath(mount->fd, relative(), ec);
+    if (ec == std::errc::is_a_directory) {
+        path.append("/index.html");
+        file = File::openBeneath(mount->fd, relative(), ec);
+    }
+    if (!file) {
+        if (ec == std::errc::cross_device_link) {
+            LOG_WARNING << "Not serving " << std::string_view(path.data(), path.size())
+                        << ", it resolves outside of " << mount->root;
+        }
+        return std::nullopt;
+    }
+
+    Validators validators(*file);
+    auto contentType = contentTypeFor(path);
+    auto res = makeResponse(req, contentType, validators.lastModified, validators.etag);
+    if (res.result() == http::status::not_modified) {
+        return res;
+    }
+    if (head) {
+        res.content_length(file->size());
+        return res;
+    }
+
+    // Small files are read once and then served from memory
+    if (file->size() <= max_cached_file_size_ &&
+        reachedByOwnName(*file, std::string_view(path.data(), path.size()))) {
+        auto body = std::make_shared<std::string>();
+        if (readWhole(*file, *body)) {
+            auto entry = std::make_shared<Entry>();
+            entry->path.assign(path.data(), path.size());
+            entry->body = body;
+            entry->contentType = contentType;
+            entry->lastModified = validators.lastModified;
+            entry->etag = validators.etag;
+            insert(std::move(entry), generation);
+
+            res.body().append(std::move(body));
+            res.prepare_payload();
+            return res;
+        }
+    }
+
+    res.body().setFile(std::move(file));
+    res.prepare_payload();
+    return res;
+}
+
+} // namespace core
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "FileMonitor.hpp"
+#include "../plugins/endpoints/EndpointPlugin.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace core {
+
+// Serves directory trees under URL prefixes.
+// Small files are kept in an LRU cache together with their precomputed
+// header values and are sent from memory as shared buffers. Larger files go
+// out with sendfile(). Cached entries are dropped as soon as the inotify
+// monitor reports a change to the file. Files reached through a symlink or
+// with several hard links are not cached, a change to them may be reported
+// under another name.
+class StaticFiles {
+public:
+    using Request = plugins::endpoint::EndpointPlugin::Request;
+    using Response = plugins::endpoint::EndpointPlugin::Response;
+
+    static constexpr std::size_t CACHE_SIZE = 64 * 1024 * 1024;      // 64MB
+    static constexpr std::size_t MAX_CACHED_FILE_SIZE = 256 * 1024;  // 256KB
+
+    explicit StaticFiles(std::size_t cacheSize = CACHE_SIZE,
+                         std::size_t maxCachedFileSize = MAX_CACHED_FILE_SIZE);
+    ~StaticFiles();
+
+    // Prevent copying
+    StaticFiles(const StaticFiles&) = delete;
+    StaticFiles& operator=(const StaticFiles&) = delete;
+
+    // Serve the files under directory for request paths starting with prefix.
+    // Mounts are added before start().
+    void mount(const std::string& prefix, const std::filesystem::path& directory);
+
+    // Start watching the mounted directories for changes
+    void start();
+
+    // Stop watching
+    void stop();
+
+    // Response to a GET or HEAD request under one of the mounts, or nullopt
+    // when no mount has a file for it
+    std::optional<Response> serve(const Request& req);
+
+private:
+    struct Mount {
+        std::string prefix;  // Without a trailing slash, empty for "/"
+        std::string root;    // Canonical directory
+        int fd = -1;         // The directory, files are opened beneath it
+    };
+
+    struct Entry {
+        std::string path;
+        std::shared_ptr<const std::string> body;
+        std::string_view contentType;
+        std::string lastModified;
+        std::string etag;
+    };
+
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    void watchTree(const std::filesystem::path& directory);
+    void invalidate(const std::filesystem::path& path);
+    EntryPtr lookup(std::string_view path);
+    void insert(EntryPtr entry, std::uint64_t generation);
+
+    std::vector<Mount> mounts_;
+    std::size_t cache_size_;
+    std::size_t max_cached_file_size_;
+    FileMonitor monitor_;
+
+    std::mutex cache_mutex_;
+    std::list<EntryPtr> lru_;  // Most recently used first
+    std::unordered_map<std::string_view, std::list<EntryPtr>::iterator> index_;  // Keys view Entry::path
+    std::size_t cached_bytes_{0};
+    std::uint64_t generation_{0};  // Bumped by every invalidation
+};
+
+} // namespace core
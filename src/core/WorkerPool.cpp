@@ -0,0 +1,91 @@
+#include "WorkerPool.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <exception>
+
+namespace core {
+
+WorkerPool::WorkerPool(std::size_t threads, std::size_t capacity)
+    : capacity_(std::max<std::size_t>(1, capacity)) {
+    threads = std::max<std::size_t>(1, threads);
+    threads_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+bool WorkerPool::trySubmit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || queue_.size() >= capacity_) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        queue_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+    return true;
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+WorkerPool::Stats WorkerPool::stats() const {
+    Stats stats{};
+    stats.threads = threads_.size();
+    stats.capacity = capacity_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.queued = queue_.size();
+    }
+    stats.active = active_.load(std::memory_order_relaxed);
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void WorkerPool::workerLoop() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;  // Stopping and drained
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+            active_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Worker task failed: " << e.what();
+        } catch (...) {
+            LOG_ERROR << "Worker task failed with an unknown exception";
+        }
+
+        active_.fetch_sub(1, std::memory_order_relaxed);
+        completed_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace core
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+// Fixed set of threads for work that must not run on an IO thread.
+// The queue is bounded: when it is full, trySubmit() fails at once so the
+// caller can shed load instead of letting latency grow without limit.
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    struct Stats {
+        std::size_t threads;
+        std::size_t capacity;   // Queue limit
+        std::size_t queued;     // Tasks waiting for a thread
+        std::size_t active;     // Tasks running right now
+        std::uint64_t completed;
+        std::uint64_t rejected;
+    };
+
+    WorkerPool(std::size_t threads, std::size_t capacity);
+    ~WorkerPool();
+
+    // Prevent copying
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Queue a task, returns false when the queue is full or the pool stopped
+    bool trySubmit(Task task);
+
+    // Finish the queued tasks and join the threads
+    void stop();
+
+    Stats stats() const;
+
+private:
+    void workerLoop();
+
+    std::size_t capacity_;
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Task> queue_;
+    bool stopping_{false};
+
+    std::atomic<std::size_t> active_{0};
+    std::atomic<std::uint64_t> completed_{0};
+    std::atomic<std::uint64_t> rejected_{0};
+};
+
+} // namespace core
@@ -1,21 +1,40 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <boost/asio/co_spawn.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/config.hpp>
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <functional>
-#include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 #include <filesystem>
+#include <pthread.h>
+#include <sched.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 
+#include "core/Arena.hpp"
+#include "core/Epoch.hpp"
 #include "core/PluginManager.hpp"
 #include "core/Logger.hpp"
+#include "core/StaticFiles.hpp"
+#include "core/WorkerPool.hpp"
 #include "plugins/endpoints/EndpointPlugin.hpp"
 
 namespace beast = boost::beast;
@@ -23,21 +42,152 @@ namespace http = beast::http;
 namespace net = boost::asio;
 using tcp = boost::asio::ip::tcp;
 
+// Requests and responses keep their header fields in the session's arena
+using request_type = plugins::endpoint::EndpointPlugin::Request;
+using response_type = plugins::endpoint::EndpointPlugin::Response;
+
+// Runs a synchronous handler. A request sampled for a staged rollout is
+// timed, and a copy of it goes to the new version shadowing the route. A
+// live handler that throws counts as an error, as it does for the new
+// version.
+response_type call_handler(
+    core::RouteTable::Route const& route,
+    request_type const& req,
+    plugins::endpoint::RouteParams const& params)
+{
+    if (!route.shadow || !route.shadow->sample())
+        return core::callRoute(route, req, params);
+
+    auto const start = std::chrono::steady_clock::now();
+    try
+    {
+        auto res = core::callRoute(route, req, params);
+        route.shadow->recordLive(std::chrono::steady_clock::now() - start, res.result_int() >= 500);
+        route.shadow->mirror(req);
+        return res;
+    }
+    catch (...)
+    {
+        route.shadow->recordLive(std::chrono::steady_clock::now() - start, true);
+        route.shadow->mirror(req);
+        throw;
+    }
+}
+
+// Runs a coroutine handler and caches its response like the synchronous path.
+// The session pins the route table until the response has been sent, so the
+// route stays valid while the coroutine is suspended.
+net::awaitable<response_type> run_async_handler(
+    core::RouteTable::Route const& route,
+    request_type const& req,
+    plugins::endpoint::RouteParams params)
+{
+    auto const sampled = route.shadow && route.shadow->sample();
+    auto const start = std::chrono::steady_clock::now();
+    std::optional<response_type> result;
+    try
+    {
+        result.emplace(co_await route.async_handler(req, params));
+    }
+    catch (...)
+    {
+        if (sampled)
+        {
+            route.shadow->recordLive(std::chrono::steady_clock::now() - start, true);
+            route.shadow->mirror(req);
+        }
+        throw;
+    }
+    auto res = std::move(*result);
+    if (sampled)
+    {
+        route.shadow->recordLive(std::chrono::steady_clock::now() - start, res.result_int() >= 500);
+        route.shadow->mirror(req);
+    }
+    if (route.cache)
+        route.cache->store(req, res);
+    co_return res;
+}
+
+// Counters of the worker pool as a JSON document
+std::string server_stats(core::WorkerPool const& workers)
+{
+    auto const stats = workers.stats();
+    return "{\"workers\":{"
+        "\"threads\":" + std::to_string(stats.threads) +
+        ",\"capacity\":" + std::to_string(stats.capacity) +
+        ",\"queued\":" + std::to_string(stats.queued) +
+        ",\"active\":" + std::to_string(stats.active) +
+        ",\"completed\":" + std::to_string(stats.completed) +
+        ",\"rejected\":" + std::to_string(stats.rejected) + "}}";
+}
+
+// Retained plugin versions of every route as a JSON document. Routes,
+// file names and ids come from plugin manifests and file names and need no
+// escaping beyond quotes and backslashes. Files are named relative to the
+// first plugin directory, one outside it by its file name alone, so the
+// document does not reveal where the server keeps its plugins.
+std::string server_versions(core::PluginManager const& pluginManager)
+{
+    auto quote = [](std::string const& text)
+    {
+        std::string quoted = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                quoted.push_back('\\');
+            quoted.push_back(c);
+        }
+        return quoted + "\"";
+    };
+
+    auto file = [](std::filesystem::path const& deployed)
+    {
+        return deployed.is_absolute() ? deployed.filename().string() : deployed.string();
+    };
+
+    std::string json = "{";
+    for (auto const& [route, history] : pluginManager.versions())
+    {
+        if (json.size() > 1)
+            json += ",";
+        json += quote(route) + ":[";
+        for (auto const& version : history.versions)
+        {
+            if (json.back() != '[')
+                json += ",";
+            json += "{\"id\":" + quote(version.id) +
+                ",\"file\":" + quote(file(version.file)) +
+                ",\"deployed\":" + std::to_string(version.deployed) +
+                ",\"live\":" + (version.id == history.live ? "true" : "false") + "}";
+        }
+        json += "]";
+    }
+    return json + "}";
+}
+
 // This function produces an HTTP response for the given
 // request. The type of the response object depends on the
 // contents of the request, so the interface requires the
 // caller to pass a generic lambda for receiving the response.
-template<class Body, class Allocator, class Send>
+// Coroutine handlers are handed to spawn and blocking handlers to
+// offload instead, the caller keeps the request alive and the route table
+// pinned until their response has been sent. offload returns false when
+// the worker pool is saturated.
+template<class Body, class Allocator, class Send, class Spawn, class Offload>
 void handle_request(
-    http::request<Body, http::basic_fields<Allocator>>&& req,
+    http::request<Body, http::basic_fields<Allocator>> const& req,
     Send&& send,
-    std::shared_ptr<core::PluginManager> pluginManager)
+    Spawn&& spawn,
+    Offload&& offload,
+    std::shared_ptr<core::PluginManager> pluginManager,
+    std::shared_ptr<core::StaticFiles> staticFiles)
 {
     // Returns a bad request response
     auto const bad_request =
     [&req](beast::string_view why)
     {
-        http::response<http::string_body> res{http::status::bad_request, req.version()};
+        response_type res{http::status::bad_request, req.version()};
         res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
         res.set(http::field::content_type, "text/html");
         res.keep_alive(req.keep_alive());
@@ -55,22 +205,64 @@ void handle_request(
         return send(std::move(res));
     }
 
-    // Look for a matching endpoint plugin
-    auto endpointPlugins = pluginManager->getPluginsByType(core::PluginType::ENDPOINT);
-    for (const auto& plugin : endpointPlugins) {
-        auto endpointPlugin = std::dynamic_pointer_cast<plugins::endpoint::EndpointPlugin>(plugin);
-        if (endpointPlugin && 
-            endpointPlugin->getPath() == req.target() && 
-            endpointPlugin->getMethod() == std::string(req.method_string())) {
-            auto res = endpointPlugin->getHandler()(req);
+    auto const target = req.target();
+
+    // Look up the endpoint in the current route snapshot
+    plugins::endpoint::RouteParams params;
+    auto const* route = pluginManager->getRouteTable().find(
+        req.method(), std::string_view(target.data(), target.size()), params);
+    if (route) {
+        // Fresh entries and conditional GETs never reach the plugin
+        if (route->cache)
+        {
+            if (auto res = route->cache->lookup(req))
+                return send(std::move(*res));
+        }
+
+        if (route->async_handler)
+        {
+            return spawn(run_async_handler(*route, req, params));
+        }
+
+        if (route->blocking)
+        {
+            auto work = [route, &req, params]
+            {
+                auto res = call_handler(*route, req, params);
+                if (route->cache)
+                    route->cache->store(req, res);
+                return res;
+            };
+            if (offload(std::move(work)))
+                return;
+
+            // Shed the request rather than queue it without bound
+            response_type res{http::status::service_unavailable, req.version()};
+            res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+            res.set(http::field::content_type, "text/html");
+            res.set(http::field::retry_after, "1");
+            res.keep_alive(req.keep_alive());
+            res.body() = "Server busy, retry later";
+            res.prepare_payload();
             return send(std::move(res));
         }
+
+        if (!route->cache)
+            return send(call_handler(*route, req, params));
+
+        auto res = call_handler(*route, req, params);
+        route->cache->store(req, res);
+        return send(std::move(res));
     }
 
-    std::cout << "No matching endpoint found for: " << req.target() << std::endl;
+    // Fall back to the static file mounts
+    if (auto res = staticFiles->serve(req))
+        return send(std::move(*res));
+
+    LOG_DEBUG << "No matching endpoint found for: " << req.target();
 
     // No matching endpoint found
-    http::response<http::string_body> res{http::status::not_found, req.version()};
+    response_type res{http::status::not_found, req.version()};
     res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
     res.set(http::field::content_type, "text/html");
     res.keep_alive(req.keep_alive());
@@ -79,30 +271,187 @@ void handle_request(
     return send(std::move(res));
 }
 
+// Hands a rollback to the reload thread and resumes on the connection's
+// executor once it has finished, no thread waits for the load.
+net::awaitable<response_type> run_rollback(
+    std::shared_ptr<core::PluginManager> pluginManager,
+    std::string id,
+    request_type const& req)
+{
+    auto const done = co_await net::async_initiate<decltype(net::use_awaitable), void(bool)>(
+        [&pluginManager, &id](auto handler)
+        {
+            // The completion handler can only be moved, std::function copies
+            auto shared = std::make_shared<decltype(handler)>(std::move(handler));
+            pluginManager->rollback(id, [shared](bool done)
+            {
+                auto const executor = net::get_associated_executor(*shared);
+                net::post(executor, [shared, done]() mutable { std::move(*shared)(done); });
+            });
+        },
+        net::use_awaitable);
+
+    response_type res{done ? http::status::ok : http::status::not_found, req.version()};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "text/plain");
+    res.keep_alive(req.keep_alive());
+    res.body() = done ? "Rolled back to " + id : "Cannot roll back to " + id;
+    res.prepare_payload();
+    co_return res;
+}
+
+// Produces the response to a request on the admin listener, which serves
+// the operator endpoints under /_server/ and nothing else. Plugin routes
+// and static files are only served by the main listener.
+template<class Body, class Allocator, class Send, class Spawn>
+void handle_admin_request(
+    http::request<Body, http::basic_fields<Allocator>> const& req,
+    Send&& send,
+    Spawn&& spawn,
+    std::shared_ptr<core::PluginManager> pluginManager,
+    std::shared_ptr<core::WorkerPool> workers)
+{
+    auto const json = [&req](std::string body)
+    {
+        response_type res{http::status::ok, req.version()};
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::content_type, "application/json");
+        res.set(http::field::cache_control, "no-store");
+        res.keep_alive(req.keep_alive());
+        res.body() = std::move(body);
+        res.prepare_payload();
+        return res;
+    };
+
+    auto const target = std::string_view(req.target().data(), req.target().size());
+    if (req.method() == http::verb::get && target == "/_server/stats")
+        return send(json(server_stats(*workers)));
+
+    if (req.method() == http::verb::get && target == "/_server/versions")
+        return send(json(server_versions(*pluginManager)));
+
+    constexpr std::string_view rollback_prefix = "/_server/rollback/";
+    if (req.method() == http::verb::post && target.starts_with(rollback_prefix))
+        return spawn(run_rollback(pluginManager, std::string(target.substr(rollback_prefix.size())), req));
+
+    response_type res{http::status::not_found, req.version()};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "text/html");
+    res.keep_alive(req.keep_alive());
+    res.body() = "The resource '" + std::string(target) + "' was not found.";
+    res.prepare_payload();
+    return send(std::move(res));
+}
+
 //------------------------------------------------------------------------------
 
 // Report a failure
 void fail(beast::error_code ec, char const* what)
 {
-    std::cerr << what << ": " << ec.message() << "\n";
+    LOG_ERROR << what << ": " << ec.message();
 }
 
-// Handles an HTTP server connection
-class session : public std::enable_shared_from_this<session>
+// Completion handler whose operation state is allocated from a session's
+// HandlerMemory instead of the heap. Composed operations allocate their
+// intermediate steps through it too.
+template<class Handler>
+class session_handler
 {
-    beast::tcp_stream stream_;
+    core::HandlerMemory* memory_;
+    Handler handler_;
+
+public:
+    using allocator_type = core::HandlerAllocator<void>;
+
+    session_handler(core::HandlerMemory& memory, Handler handler)
+        : memory_(&memory)
+        , handler_(std::move(handler))
+    {
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return allocator_type(memory_);
+    }
+
+    template<class... Args>
+    void operator()(Args&&... args)
+    {
+        handler_(std::forward<Args>(args)...);
+    }
+};
+
+// Handles an HTTP server connection.
+// The executor type is concrete rather than net::any_io_executor: a strand
+// does not fit the small buffer of the type-erased executor, so every copy
+// made while starting an operation would go to the heap.
+template<class Executor>
+class session : public std::enable_shared_from_this<session<Executor>>
+{
+    using stream_type = beast::basic_stream<tcp, Executor>;
+    using timer_type = net::basic_waitable_timer<
+        std::chrono::steady_clock,
+        net::wait_traits<std::chrono::steady_clock>,
+        Executor>;
+    using tcp_cork = net::detail::socket_option::boolean<IPPROTO_TCP, TCP_CORK>;
+    using std::enable_shared_from_this<session>::shared_from_this;
+
+    // Outlives every operation on the session's objects, whose handlers
+    // hold the session
+    core::HandlerMemory handler_memory_;
+
+    stream_type stream_;
     beast::flat_buffer buffer_;
+
+    // Bounds how long a request may take to arrive and its response to go
+    // out. A new request only moves the deadline, the timer is armed again
+    // when it fires, so keep-alive requests start no timer operation of
+    // their own. Beast's per-operation stream timeout would.
+    timer_type deadline_timer_;
+    std::chrono::steady_clock::time_point deadline_;
+    bool timed_out_ = false;
     std::shared_ptr<core::PluginManager> pluginManager_;
-    http::request<http::string_body> req_;
-    std::shared_ptr<http::response<http::string_body>> res_;
+    std::shared_ptr<core::StaticFiles> staticFiles_;
+    std::shared_ptr<core::WorkerPool> workers_;
+    bool admin_;  // Accepted by the admin listener
+
+    // Keeps the route table a request was routed with, and the plugin
+    // libraries behind it, from being reclaimed until its response has been
+    // written: the response may still own buffers created by plugin code.
+    // Declared before the arena so it is released after the response.
+    core::Epoch::Pin pin_;
+
+    // Backs the header fields of the current request and response. It is
+    // rewound between keep-alive requests, so it has to outlive both.
+    core::Arena arena_;
+    std::optional<http::request_parser<http::string_body, core::ArenaAllocator<char>>> parser_;
+
+    // The request being answered. Coroutine and blocking handlers hold a
+    // reference to it until their response has been sent.
+    std::optional<request_type> req_;
+
+    // Reused for every response instead of a heap allocated copy. Writing
+    // through our own serializer also avoids Beast allocating one per write.
+    std::optional<response_type> res_;
+    std::optional<http::response_serializer<response_type::body_type, response_type::fields_type>> serializer_;
+
+    // File bodies are sent with sendfile() after the header
+    std::uint64_t file_sent_ = 0;
 
 public:
     // Take ownership of the stream
     session(
-        tcp::socket&& socket,
-        std::shared_ptr<core::PluginManager> pluginManager)
+        typename stream_type::socket_type&& socket,
+        std::shared_ptr<core::PluginManager> pluginManager,
+        std::shared_ptr<core::StaticFiles> staticFiles,
+        std::shared_ptr<core::WorkerPool> workers,
+        bool admin)
         : stream_(std::move(socket))
+        , deadline_timer_(stream_.get_executor())
         , pluginManager_(pluginManager)
+        , staticFiles_(staticFiles)
+        , workers_(workers)
+        , admin_(admin)
     {
     }
 
@@ -115,24 +464,81 @@ public:
         // thread-safe by default.
         net::dispatch(stream_.get_executor(),
                      beast::bind_front_handler(
-                         &session::do_read,
+                         &session::start,
                          shared_from_this()));
     }
 
+    void start()
+    {
+        do_read();
+        wait_deadline();
+    }
+
+    // Handler for the session's own operations, allocated from its memory
+    template<class Function>
+    auto bind(Function function)
+    {
+        return session_handler(
+            handler_memory_,
+            beast::bind_front_handler(function, shared_from_this()));
+    }
+
+    void expires_after(std::chrono::steady_clock::duration timeout)
+    {
+        deadline_ = std::chrono::steady_clock::now() + timeout;
+    }
+
+    // The timer does not keep the session alive, an idle connection is
+    // held by its pending read
+    void wait_deadline()
+    {
+        deadline_timer_.expires_at(deadline_);
+        deadline_timer_.async_wait(
+            [self = this->weak_from_this()](beast::error_code ec)
+            {
+                if(auto session = self.lock(); session && !ec)
+                    session->on_deadline();
+            });
+    }
+
+    void on_deadline()
+    {
+        if(std::chrono::steady_clock::now() < deadline_)
+            return wait_deadline();
+
+        // The pending operation completes with an error
+        timed_out_ = true;
+        beast::error_code ec;
+        stream_.socket().close(ec);
+    }
+
+    // The error an operation failed with, a timeout if the deadline closed
+    // the socket under it
+    beast::error_code timeout_or(beast::error_code ec) const
+    {
+        return ec && timed_out_ ? beast::error_code(beast::error::timeout) : ec;
+    }
+
     void do_read()
     {
-        // Make the request empty before reading,
-        // otherwise the operation behavior is undefined.
-        req_ = {};
+        // Drop everything that lives in the arena before rewinding it, then
+        // start a fresh parser whose fields allocate from the arena.
+        serializer_.reset();
+        res_.reset();
+        req_.reset();
+        parser_.reset();
+        arena_.reset();
+        pin_.release();
+        parser_.emplace(
+            std::piecewise_construct,
+            std::make_tuple(),
+            std::make_tuple(core::ArenaAllocator<char>(&arena_)));
 
         // Set the timeout.
-        stream_.expires_after(std::chrono::seconds(30));
+        expires_after(std::chrono::seconds(30));
 
         // Read a request
-        http::async_read(stream_, buffer_, req_,
-            beast::bind_front_handler(
-                &session::on_read,
-                shared_from_this()));
+        http::async_read(stream_, buffer_, *parser_, bind(&session::on_read));
     }
 
     void on_read(
@@ -146,25 +552,210 @@ public:
             return do_close();
 
         if(ec)
-            return fail(ec, "read");
+            return fail(timeout_or(ec), "read");
+
+        // Responses built by the handler allocate from this session's arena
+        core::Arena::Scope scope(arena_);
+
+        // Operator requests use no route table, and a rollback must not
+        // hold back the release of the version it replaces
+        req_.emplace(parser_->release());
+        if(admin_)
+        {
+            return handle_admin_request(
+                *req_,
+                [this](auto&& response)
+                {
+                    send_response(std::forward<decltype(response)>(response));
+                },
+                [this](net::awaitable<response_type> handler)
+                {
+                    spawn(std::move(handler));
+                },
+                pluginManager_,
+                workers_);
+        }
 
         // Send the response
+        pin_.hold();
         handle_request(
-            std::move(req_),
+            *req_,
             [this](auto&& response)
             {
-                // The lifetime of the response has to extend
-                // until the completion handler is called.
-                res_ = std::make_shared<http::response<http::string_body>>(std::forward<decltype(response)>(response));
-                
-                http::async_write(
-                    stream_,
-                    *res_,
-                    beast::bind_front_handler(
-                        &session::on_write,
-                        shared_from_this()));
+                send_response(std::forward<decltype(response)>(response));
+            },
+            [this](net::awaitable<response_type> handler)
+            {
+                spawn(std::move(handler));
+            },
+            [this](std::function<response_type()> work)
+            {
+                // Run the handler on a worker thread and deliver the
+                // response back on this connection's executor
+                return workers_->trySubmit(
+                    [self = shared_from_this(), work = std::move(work)]
+                    {
+                        std::exception_ptr error;
+                        response_type res;
+                        try
+                        {
+                            res = work();
+                        }
+                        catch(...)
+                        {
+                            error = std::current_exception();
+                        }
+                        net::post(
+                            self->stream_.get_executor(),
+                            [self, error, res = std::move(res)]() mutable
+                            {
+                                self->on_async_response(error, std::move(res));
+                            });
+                    });
             },
-            pluginManager_);
+            pluginManager_,
+            staticFiles_);
+    }
+
+    // Run a coroutine handler on this connection's executor
+    void spawn(net::awaitable<response_type> handler)
+    {
+        net::co_spawn(
+            stream_.get_executor(),
+            std::move(handler),
+            beast::bind_front_handler(
+                &session::on_async_response,
+                shared_from_this()));
+    }
+
+    void on_async_response(std::exception_ptr error, response_type res)
+    {
+        if(error)
+        {
+            try
+            {
+                std::rethrow_exception(error);
+            }
+            catch(std::exception const& e)
+            {
+                LOG_ERROR << "Handler for " << req_->target() << " failed: " << e.what();
+            }
+            catch(...)
+            {
+                LOG_ERROR << "Handler for " << req_->target() << " failed";
+            }
+
+            res = response_type{http::status::internal_server_error, req_->version()};
+            res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+            res.set(http::field::content_type, "text/html");
+            res.keep_alive(req_->keep_alive());
+            res.body() = "Internal server error";
+            res.prepare_payload();
+        }
+
+        send_response(std::move(res));
+    }
+
+    void send_response(response_type&& res)
+    {
+        // The lifetime of the response has to extend
+        // until the completion handler is called.
+        res_.emplace(std::move(res));
+        serializer_.emplace(*res_);
+
+        // Only the header of a file response goes through the
+        // serializer, the body is copied by the kernel. The socket
+        // is corked until the body is queued, so the header does not
+        // go out in a packet of its own and stall on delayed ACKs.
+        if(res_->body().isFile())
+        {
+            beast::error_code ec;
+            stream_.socket().set_option(tcp_cork(true), ec);
+            http::async_write_header(stream_, *serializer_, bind(&session::on_write_header));
+            return;
+        }
+
+        http::async_write(stream_, *serializer_, bind(&session::on_write));
+    }
+
+    void on_write_header(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
+        boost::ignore_unused(bytes_transferred);
+
+        if(ec)
+            return fail_file(timeout_or(ec), "write");
+
+        // sendfile() must not block the IO thread
+        stream_.socket().native_non_blocking(true, ec);
+        if(ec)
+            return fail_file(ec, "write");
+
+        file_sent_ = 0;
+        do_send_file();
+    }
+
+    // Give up on a file response. The response and the session's pin are
+    // let go right away rather than with the session, the pin holds back
+    // every reclamation. The response goes before the pin, it may own
+    // buffers created by plugin code.
+    void fail_file(beast::error_code ec, char const* what)
+    {
+        serializer_.reset();
+        res_.reset();
+        pin_.release();
+        fail(ec, what);
+    }
+
+    void do_send_file()
+    {
+        static constexpr std::uint64_t max_chunk = 1 << 20;
+
+        auto const& region = res_->body().file();
+        auto& socket = stream_.socket();
+        while(file_sent_ < region.length)
+        {
+            auto offset = static_cast<off_t>(region.offset + file_sent_);
+            auto const n = ::sendfile(
+                socket.native_handle(),
+                region.file->fd(),
+                &offset,
+                static_cast<std::size_t>(std::min(region.length - file_sent_, max_chunk)));
+            if(n > 0)
+            {
+                file_sent_ += static_cast<std::uint64_t>(n);
+                continue;
+            }
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                // Wait until the socket drains, within the usual timeout
+                // of the last progress
+                expires_after(std::chrono::seconds(30));
+                socket.async_wait(tcp::socket::wait_write, bind(&session::on_file_writable));
+                return;
+            }
+
+            // A zero return means the file shrank under us
+            beast::error_code ec = n == 0
+                ? beast::error_code(net::error::eof)
+                : beast::error_code(errno, beast::system_category());
+            return fail_file(ec, "sendfile");
+        }
+
+        beast::error_code ec;
+        socket.set_option(tcp_cork(false), ec);
+        on_write(ec, static_cast<std::size_t>(file_sent_));
+    }
+
+    void on_file_writable(beast::error_code ec)
+    {
+        if(ec)
+            return fail_file(timeout_or(ec), "sendfile");
+
+        do_send_file();
     }
 
     void on_write(
@@ -174,14 +765,11 @@ public:
         boost::ignore_unused(bytes_transferred);
 
         if(ec)
-            return fail(ec, "write");
+            return fail(timeout_or(ec), "write");
 
         // Determine if we should close the connection
         bool close = res_->need_eof();
 
-        // Clear the response to free memory
-        res_ = nullptr;
-
         if(close)
         {
             // This means we should close the connection, usually because
@@ -211,15 +799,30 @@ class listener : public std::enable_shared_from_this<listener>
     net::io_context& ioc_;
     tcp::acceptor acceptor_;
     std::shared_ptr<core::PluginManager> pluginManager_;
+    std::shared_ptr<core::StaticFiles> staticFiles_;
+    std::shared_ptr<core::WorkerPool> workers_;
+    bool per_core_;
+    bool admin_;
 
 public:
+    // In per-core mode every io_context has its own listener bound to the
+    // same endpoint with SO_REUSEPORT, and the kernel spreads connections
+    // across them. The admin listener serves only the operator endpoints.
     listener(
         net::io_context& ioc,
         tcp::endpoint endpoint,
-        std::shared_ptr<core::PluginManager> pluginManager)
+        std::shared_ptr<core::PluginManager> pluginManager,
+        std::shared_ptr<core::StaticFiles> staticFiles,
+        std::shared_ptr<core::WorkerPool> workers,
+        bool per_core = false,
+        bool admin = false)
         : ioc_(ioc)
         , acceptor_(ioc)
         , pluginManager_(pluginManager)
+        , staticFiles_(staticFiles)
+        , workers_(workers)
+        , per_core_(per_core)
+        , admin_(admin)
     {
         beast::error_code ec;
 
@@ -239,6 +842,17 @@ public:
             return;
         }
 
+        // Let each per-core listener bind the same port
+        if(per_core_)
+        {
+            acceptor_.set_option(reuse_port(true), ec);
+            if(ec)
+            {
+                fail(ec, "set_option(SO_REUSEPORT)");
+                return;
+            }
+        }
+
         // Bind to the server address
         acceptor_.bind(endpoint, ec);
         if(ec)
@@ -264,17 +878,35 @@ public:
     }
 
 private:
+    using reuse_port = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+    // Accepted sockets keep the concrete executor they were accepted on
+    template<class Executor>
+    using socket_type = typename tcp::socket::rebind_executor<Executor>::other;
+
     void do_accept()
     {
-        // The new connection gets its own strand
+        // A per-core io_context is only run by one thread, so the connection
+        // can use it directly. Otherwise the new connection gets its own strand.
+        if(per_core_)
+        {
+            acceptor_.async_accept(
+                ioc_.get_executor(),
+                beast::bind_front_handler(
+                    &listener::on_accept<socket_type<net::io_context::executor_type>>,
+                    shared_from_this()));
+            return;
+        }
+
         acceptor_.async_accept(
-            net::make_strand(ioc_),
+            net::make_strand(ioc_.get_executor()),
             beast::bind_front_handler(
-                &listener::on_accept,
+                &listener::on_accept<socket_type<net::strand<net::io_context::executor_type>>>,
                 shared_from_this()));
     }
 
-    void on_accept(beast::error_code ec, tcp::socket socket)
+    template<class Socket>
+    void on_accept(beast::error_code ec, Socket socket)
     {
         if(ec)
         {
@@ -283,9 +915,12 @@ private:
         else
         {
             // Create the session and run it
-            std::make_shared<session>(
+            std::make_shared<session<typename Socket::executor_type>>(
                 std::move(socket),
-                pluginManager_)->run();
+                pluginManager_,
+                staticFiles_,
+                workers_,
+                admin_)->run();
         }
 
         // Accept another connection
@@ -295,6 +930,25 @@ private:
 
 //------------------------------------------------------------------------------
 
+// How IO threads are organised
+enum class server_mode
+{
+    shared,     // One io_context run by all threads, a strand per connection
+    per_core    // One io_context and SO_REUSEPORT listener per thread
+};
+
+// Pin the calling thread to one CPU
+void pin_to_cpu(unsigned cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); rc != 0)
+        LOG_WARNING << "Failed to pin thread to CPU " << cpu << ": " << std::strerror(rc);
+}
+
+//------------------------------------------------------------------------------
+
 int main(int argc, char* argv[])
 {
     // Initialize logging
@@ -302,9 +956,9 @@ int main(int argc, char* argv[])
     LOG_INFO << "Starting web server...";
 
     // Check command line arguments.
-    if (argc != 4)
+    if (argc < 4)
     {
-        LOG_ERROR << "Usage: http-server-async <address> <port> <threads>";
+        LOG_ERROR << "Usage: http-server-async <address> <port> <threads> [--mode=shared|per-core] [--pin-cpus] [--static=<prefix>:<dir>]... [--plugins=<dir>]... [--workers=<n>] [--worker-queue=<n>] [--shadow=<percent>] [--shadow-margin=<percent>] [--shadow-samples=<n>] [--shadow-low-traffic=promote|wait|keep] [--admin=<address>:<port>]";
         LOG_ERROR << "Example: http-server-async 0.0.0.0 8080 1";
         return EXIT_FAILURE;
     }
@@ -313,38 +967,177 @@ int main(int argc, char* argv[])
     auto const port = static_cast<unsigned short>(std::atoi(argv[2]));
     auto const threads = std::max<int>(1, std::atoi(argv[3]));
 
+    auto mode = server_mode::shared;
+    bool pin_cpus = false;
+    std::size_t worker_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t worker_queue = 256;
+    core::RolloutPolicy rollout;
+    auto staticFiles = std::make_shared<core::StaticFiles>();
+    std::vector<std::filesystem::path> pluginDirs;
+    std::optional<tcp::endpoint> admin;
+    for (int i = 4; i < argc; ++i)
+    {
+        std::string_view const arg = argv[i];
+        if (arg == "--mode=shared")
+            mode = server_mode::shared;
+        else if (arg == "--mode=per-core")
+            mode = server_mode::per_core;
+        else if (arg == "--pin-cpus")
+            pin_cpus = true;
+        else if (arg.substr(0, 10) == "--workers=")
+            worker_threads = std::max(1, std::atoi(argv[i] + 10));
+        else if (arg.substr(0, 15) == "--worker-queue=")
+            worker_queue = std::max(1, std::atoi(argv[i] + 15));
+        else if (arg.substr(0, 9) == "--shadow=")
+            rollout.sample_rate = std::clamp(std::atof(argv[i] + 9), 0.0, 100.0) / 100;
+        else if (arg.substr(0, 16) == "--shadow-margin=")
+            rollout.margin = std::max(0.0, std::atof(argv[i] + 16)) / 100;
+        else if (arg.substr(0, 17) == "--shadow-samples=")
+            rollout.samples = std::max<std::size_t>(core::PluginManager::SHADOW_MIN_SAMPLES,
+                                                    std::max(0, std::atoi(argv[i] + 17)));
+        else if (arg == "--shadow-low-traffic=promote")
+            rollout.low_traffic = core::LowTraffic::promote;
+        else if (arg == "--shadow-low-traffic=wait")
+            rollout.low_traffic = core::LowTraffic::wait;
+        else if (arg == "--shadow-low-traffic=keep")
+            rollout.low_traffic = core::LowTraffic::keep;
+        else if (arg.substr(0, 9) == "--static=")
+        {
+            // --static=/assets:./public
+            auto const spec = arg.substr(9);
+            auto const colon = spec.find(':');
+            std::string const prefix(spec.substr(0, colon));
+            std::filesystem::path const dir(colon == std::string_view::npos ? "" : spec.substr(colon + 1));
+            if (prefix.empty() || prefix[0] != '/' || !std::filesystem::is_directory(dir))
+            {
+                LOG_ERROR << "Invalid static mount: " << arg;
+                return EXIT_FAILURE;
+            }
+            staticFiles->mount(prefix, dir);
+        }
+        else if (arg.substr(0, 10) == "--plugins=" && arg.size() > 10)
+            pluginDirs.emplace_back(arg.substr(10));
+        else if (arg.substr(0, 8) == "--admin=")
+        {
+            // --admin=127.0.0.1:9090, the port follows the last colon
+            auto const spec = arg.substr(8);
+            auto const colon = spec.rfind(':');
+            beast::error_code ec;
+            auto const admin_address = net::ip::make_address(
+                std::string(spec.substr(0, colon == std::string_view::npos ? 0 : colon)), ec);
+            auto const admin_port = colon == std::string_view::npos ? 0 : std::atoi(argv[i] + 8 + colon + 1);
+            if (ec || admin_port <= 0 || admin_port > 65535)
+            {
+                LOG_ERROR << "Invalid admin address: " << arg;
+                return EXIT_FAILURE;
+            }
+            admin.emplace(admin_address, static_cast<unsigned short>(admin_port));
+        }
+        else
+        {
+            LOG_ERROR << "Unknown option: " << arg;
+            return EXIT_FAILURE;
+        }
+    }
+
     LOG_INFO << "Server configuration:"
              << " address=" << address
              << " port=" << port
-             << " threads=" << threads;
+             << " threads=" << threads
+             << " mode=" << (mode == server_mode::per_core ? "per-core" : "shared")
+             << " pin_cpus=" << pin_cpus
+             << " workers=" << worker_threads
+             << " worker_queue=" << worker_queue
+             << " shadow=" << rollout.sample_rate * 100 << "%"
+             << " shadow_margin=" << rollout.margin * 100 << "%"
+             << " shadow_samples=" << rollout.samples
+             << " shadow_low_traffic=" << (rollout.low_traffic == core::LowTraffic::promote ? "promote"
+                                           : rollout.low_traffic == core::LowTraffic::wait ? "wait" : "keep")
+             << " admin=" << (admin ? admin->address().to_string() + ":" + std::to_string(admin->port()) : "off");
 
-    // Create required directories
-    std::filesystem::create_directories("endpoints");
+    if (pluginDirs.empty())
+        pluginDirs.emplace_back("endpoints");
 
-    // The io_context is required for all I/O
-    net::io_context ioc{threads};
-
-    // Create and initialize the plugin manager
+    // Create and initialize the plugin manager, it creates missing directories
     auto pluginManager = std::make_shared<core::PluginManager>();
-    pluginManager->initialize("endpoints");
+    pluginManager->setRolloutPolicy(rollout);
+    pluginManager->initialize(pluginDirs);
     pluginManager->start();
+    staticFiles->start();
 
-    // Create and launch a listening port
-    std::make_shared<listener>(
-        ioc,
-        tcp::endpoint{address, port},
-        pluginManager)->run();
+    // Blocking endpoints run here, off the IO threads
+    auto workers = std::make_shared<core::WorkerPool>(worker_threads, worker_queue);
+
+    // One io_context for the shared mode, one per thread for the per-core mode
+    std::vector<std::unique_ptr<net::io_context>> contexts;
+    if (mode == server_mode::per_core)
+    {
+        for (int i = 0; i < threads; ++i)
+        {
+            contexts.push_back(std::make_unique<net::io_context>(1));
+            std::make_shared<listener>(
+                *contexts.back(),
+                tcp::endpoint{address, port},
+                pluginManager,
+                staticFiles,
+                workers,
+                true)->run();
+        }
+    }
+    else
+    {
+        contexts.push_back(std::make_unique<net::io_context>(threads));
+        std::make_shared<listener>(
+            *contexts.back(),
+            tcp::endpoint{address, port},
+            pluginManager,
+            staticFiles,
+            workers)->run();
+    }
+
+    // The operator endpoints are only served to whoever can reach this
+    // address, and never on the main listener
+    if (admin)
+    {
+        std::make_shared<listener>(
+            *contexts.front(),
+            *admin,
+            pluginManager,
+            staticFiles,
+            workers,
+            false,
+            true)->run();
+    }
 
     // Run the I/O service on the requested number of threads
+    auto const cpus = std::max(1u, std::thread::hardware_concurrency());
+    // Route tables are read without reference counts. Between handlers an IO
+    // thread holds none of them and says so, and it goes offline while it
+    // waits for work, so replaced tables and plugins can be reclaimed.
+    auto run = [&](int index)
+    {
+        if (pin_cpus)
+            pin_to_cpu(static_cast<unsigned>(index) % cpus);
+
+        core::Epoch::Reader epoch_reader;
+        auto& ioc = *contexts[index % contexts.size()];
+        while (!ioc.stopped())
+        {
+            core::Epoch::quiescent();
+            if (ioc.poll_one() == 0)
+            {
+                core::Epoch::offline();
+                if (ioc.run_one() == 0)
+                    break;
+            }
+        }
+    };
+
     std::vector<std::thread> v;
     v.reserve(threads - 1);
     for(auto i = threads - 1; i > 0; --i)
-        v.emplace_back(
-        [&ioc]
-        {
-            ioc.run();
-        });
-    ioc.run();
+        v.emplace_back(run, i);
+    run(0);
 
     return EXIT_SUCCESS;
 }
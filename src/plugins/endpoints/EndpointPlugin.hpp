@@ -1,31 +1,147 @@
 #pragma once
 
 #include "../../core/Plugin.hpp"
+#include "../../core/Arena.hpp"
+#include "../../core/Payload.hpp"
+#include <boost/asio/awaitable.hpp>
 #include <boost/beast/http.hpp>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include <functional>
+#include <memory>
 
 namespace http = boost::beast::http;
 
 namespace plugins {
 namespace endpoint {
 
+// Path parameters matched by the router plus the query string of the request.
+// Names are views into the route table and values are views into the request
+// target, so filling this in never allocates.
+class RouteParams {
+public:
+    static constexpr std::size_t MAX_PARAMS = 8;
+
+    struct Param {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    // Value of a named parameter, empty if the route does not declare it
+    std::string_view get(std::string_view name) const {
+        for (std::size_t i = 0; i < count_; ++i) {
+            if (params_[i].name == name) {
+                return params_[i].value;
+            }
+        }
+        return {};
+    }
+
+    // Value of a named parameter as an integer, for {name:int} segments
+    std::optional<long long> getInt(std::string_view name) const {
+        auto value = get(name);
+        long long result = 0;
+        auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+        if (value.empty() || ec != std::errc() || ptr != value.data() + value.size()) {
+            return std::nullopt;
+        }
+        return result;
+    }
+
+    // Query string without the leading '?'
+    std::string_view query() const { return query_; }
+
+    std::size_t size() const { return count_; }
+    const Param* begin() const { return params_.data(); }
+    const Param* end() const { return params_.data() + count_; }
+
+    // Used by the router while matching
+    bool push(std::string_view name, std::string_view value) {
+        if (count_ == MAX_PARAMS) {
+            return false;
+        }
+        params_[count_++] = {name, value};
+        return true;
+    }
+    void pop() { --count_; }
+    void setQuery(std::string_view query) { query_ = query; }
+
+private:
+    std::array<Param, MAX_PARAMS> params_{};
+    std::size_t count_{0};
+    std::string_view query_;
+};
+
 class EndpointPlugin : public core::Plugin {
 public:
-    using Request = http::request<http::string_body>;
-    using Response = http::response<http::string_body>;
+    // Header fields live in the connection's arena while a handler runs, a
+    // Response constructed inside the handler picks it up automatically.
+    // The response body is a core::Payload: assign a string as before, or
+    // append shared immutable buffers, or point it at a file region.
+    using Fields = http::basic_fields<core::ArenaAllocator<char>>;
+    using Request = http::request<http::string_body, Fields>;
+    using Response = http::response<core::PayloadBody, Fields>;
     using Handler = std::function<Response(const Request&)>;
+    using RouteHandler = std::function<Response(const Request&, const RouteParams&)>;
+
+    // Coroutine handler for endpoints that wait on timers, sockets or files.
+    // It runs on the connection's executor and suspends instead of blocking
+    // the IO thread. The request stays valid until the coroutine finishes,
+    // the parameters are passed by value because the caller's copy does not.
+    using AsyncHandler = std::function<boost::asio::awaitable<Response>(const Request&, RouteParams)>;
+
+    // How the server may cache this route's responses. Only successful GET
+    // responses are cached, keyed by the request target plus the values of
+    // the vary headers. A zero ttl disables caching.
+    struct CachePolicy {
+        std::chrono::milliseconds ttl{0};
+        std::vector<std::string> vary;  // Request headers that select different entries
+    };
 
     virtual ~EndpointPlugin() = default;
-    
+
     // Implement Plugin interface
     core::PluginType getType() const override { return core::PluginType::ENDPOINT; }
     void cleanup() override { handler_ = nullptr; }  // Clear the cached handler
-    
-    // Endpoint-specific interface
+
+    // Endpoint-specific interface.
+    // The path is a route pattern: literal segments, typed parameters such as
+    // "/users/{id:int}" or "/files/{name}", and an optional trailing wildcard
+    // "/static/{rest*}" (or "/static/*") that captures the remainder of the path.
     virtual std::string getPath() const = 0;
     virtual std::string getMethod() const = 0;
-    
+
+    // A synthetic request the server sends through a new version of the
+    // endpoint before it takes over the route. The method is the endpoint's,
+    // the target must match its route.
+    struct WarmupRequest {
+        std::string target{};
+        std::string body{};
+        std::vector<std::pair<std::string, std::string>> headers{};
+    };
+
+    // Opt in to the response cache, responses are not cached by default
+    virtual CachePolicy getCachePolicy() const { return {}; }
+
+    // Requests that take the handler's cold paths: lazily built state,
+    // static singletons, first use of the library's pages. Each is handled
+    // a few times off the IO threads before the version serves, and an
+    // exception keeps the version from being swapped in. None by default,
+    // handlers are only ever called with requests the endpoint asked for.
+    virtual std::vector<WarmupRequest> getWarmupRequests() const { return {}; }
+
+    // Blocking endpoints do CPU-heavy or blocking work. Their synchronous
+    // handler runs on the server's worker pool instead of an IO thread, and
+    // requests are answered with 503 while the pool's queue is full.
+    virtual bool isBlocking() const { return false; }
+
     // Get the handler, creating it if necessary
     Handler getHandler() const {
         if (!handler_) {
@@ -34,13 +150,96 @@ public:
         return handler_;
     }
 
+    // Get a handler that also receives the matched path parameters
+    RouteHandler getRouteHandler() const {
+        return createRouteHandler();
+    }
+
+    // Get the coroutine handler, empty for synchronous endpoints
+    AsyncHandler getAsyncHandler() const {
+        return createAsyncHandler();
+    }
+
 protected:
-    // Create a new handler instance
-    virtual Handler createHandler() const = 0;
+    // Create a new handler instance. An endpoint implements this,
+    // createRouteHandler() or createAsyncHandler(); one with none of them is
+    // rejected when it is loaded.
+    virtual Handler createHandler() const { return nullptr; }
+
+    // Create a handler that reads path parameters. The default forwards to the
+    // plain handler, so endpoints without parameters only implement createHandler().
+    // Empty when there is no plain handler either.
+    virtual RouteHandler createRouteHandler() const {
+        auto handler = getHandler();
+        if (!handler) {
+            return nullptr;
+        }
+        return [handler = std::move(handler)](const Request& req, const RouteParams&) {
+            return handler(req);
+        };
+    }
+
+    // Create a coroutine handler. When this returns one, it is used instead
+    // of the synchronous handlers.
+    virtual AsyncHandler createAsyncHandler() const { return nullptr; }
 
 private:
     mutable Handler handler_;  // Cache the handler
 };
 
+// Several endpoints exported by one library, for a service with many
+// routes. They are loaded, initialized and warmed up together, and a new
+// version of the library replaces all of them in one route table swap.
+// Routes the new version no longer serves go away with the old one.
+class EndpointSet : public core::Plugin {
+public:
+    EndpointSet(std::string name, std::vector<std::shared_ptr<EndpointPlugin>> endpoints)
+        : name_(std::move(name)), endpoints_(std::move(endpoints)) {}
+
+    std::string getName() const override { return name_; }
+    core::PluginType getType() const override { return core::PluginType::ENDPOINT; }
+
+    void initialize() override {
+        for (const auto& endpoint : endpoints_) {
+            endpoint->initialize();
+        }
+    }
+
+    void cleanup() override {
+        for (const auto& endpoint : endpoints_) {
+            endpoint->cleanup();
+        }
+    }
+
+    const std::vector<std::shared_ptr<EndpointPlugin>>& endpoints() const { return endpoints_; }
+
+private:
+    std::string name_;
+    std::vector<std::shared_ptr<EndpointPlugin>> endpoints_;
+};
+
+template <class... Endpoints>
+std::shared_ptr<core::Plugin> makeEndpointSet(std::string name) {
+    return std::make_shared<EndpointSet>(
+        std::move(name), std::vector<std::shared_ptr<EndpointPlugin>>{std::make_shared<Endpoints>()...});
+}
+
+// The endpoints a plugin serves: the plugin itself, the members of a set,
+// or none. Each shares ownership of the plugin, which keeps its library
+// loaded while any of them is in use.
+inline std::vector<std::shared_ptr<EndpointPlugin>> endpointsOf(const std::shared_ptr<core::Plugin>& plugin) {
+    if (auto endpoint = std::dynamic_pointer_cast<EndpointPlugin>(plugin)) {
+        return {std::move(endpoint)};
+    }
+    std::vector<std::shared_ptr<EndpointPlugin>> endpoints;
+    if (auto set = std::dynamic_pointer_cast<EndpointSet>(plugin)) {
+        endpoints.reserve(set->endpoints().size());
+        for (const auto& endpoint : set->endpoints()) {
+            endpoints.emplace_back(plugin, endpoint.get());
+        }
+    }
+    return endpoints;
+}
+
 } // namespace endpoint
-} // namespace plugins 
\ No newline at end of file
+} // namespace plugins
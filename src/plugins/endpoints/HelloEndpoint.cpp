@@ -61,4 +61,5 @@ EndpointPlugin::Handler HelloEndpoint::createHandler() const {
 } // namespace plugins
 
 // Export the plugin
+PLUGIN_MANIFEST("HelloEndpoint", "endpoint", PLUGIN_ROUTE("GET", "/hello"))
 EXPORT_PLUGIN(plugins::endpoint::HelloEndpoint) 
\ No newline at end of file
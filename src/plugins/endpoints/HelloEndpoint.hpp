@@ -12,6 +12,8 @@ public:
     
     std::string getPath() const override { return "/hello"; }
     std::string getMethod() const override { return "GET"; }
+    // Initializes BuildInfo and the handler before the first real request
+    std::vector<WarmupRequest> getWarmupRequests() const override { return {{"/hello"}}; }
 
 protected:
     Handler createHandler() const override;
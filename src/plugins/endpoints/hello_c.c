@@ -0,0 +1,41 @@
+/*
+ * Endpoint plugin written in C against the plain C interface in
+ * core/EndpointAbi.h. Answers GET /hello-c/{name} with a greeting.
+ */
+
+#include "core/EndpointAbi.h"
+#include <stdio.h>
+
+static const endpoint_host_v1* host;
+
+static int hello(void* context, const endpoint_request* req, endpoint_response* res) {
+    (void)context;
+    char greeting[128];
+    endpoint_string name = host->param(req, ENDPOINT_STRING("name"));
+    int length = snprintf(greeting, sizeof greeting, "Hello, %.*s, from C!", (int)name.size, name.data);
+    if (length < 0 || (size_t)length >= sizeof greeting) {
+        host->set_status(res, 414);
+        return 0;
+    }
+    host->set_header(res, ENDPOINT_STRING("Content-Type"), ENDPOINT_STRING("text/plain"));
+    host->append_body(res, (endpoint_string){greeting, (size_t)length});
+    return 0;
+}
+
+static const endpoint_route_v1 routes[] = {
+    {.method = "GET", .path = "/hello-c/{name}", .handler = hello, .warmup_target = "/hello-c/warmup"},
+};
+
+static const endpoint_table_v1 table = {
+    .abi_version = ENDPOINT_ABI_VERSION,
+    .name = "HelloC",
+    .route_count = sizeof routes / sizeof routes[0],
+    .routes = routes,
+};
+
+ENDPOINT_EXPORT const endpoint_table_v1* webserver_endpoint_table_v1(const endpoint_host_v1* h) {
+    host = h;
+    return &table;
+}
+
+ENDPOINT_MANIFEST("HelloC", PLUGIN_ROUTE("GET", "/hello-c/{name}"))
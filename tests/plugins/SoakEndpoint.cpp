@@ -0,0 +1,42 @@
+// Answers GET /soak with the VERSION it was built with, followed by a page
+// the library owns and shares with every response. A response still in
+// flight when the library is replaced keeps the page, and with it the code
+// that frees it, alive; the library has to be unmapped after that.
+
+#include "plugins/endpoints/EndpointPlugin.hpp"
+#include <memory>
+
+namespace plugins {
+namespace endpoint {
+
+namespace {
+const auto page = std::make_shared<const std::string>(std::string(4096, 'x'));
+}
+
+class SoakEndpoint : public EndpointPlugin {
+public:
+    std::string getName() const override { return "SoakEndpoint"; }
+    void initialize() override {}
+
+    std::string getPath() const override { return "/soak"; }
+    std::string getMethod() const override { return "GET"; }
+
+protected:
+    Handler createHandler() const override {
+        return [](const Request& req) {
+            Response res{http::status::ok, req.version()};
+            res.set(http::field::content_type, "text/plain");
+            res.keep_alive(req.keep_alive());
+            res.body() = VERSION "\n";
+            res.body().append(page);
+            res.prepare_payload();
+            return res;
+        };
+    }
+};
+
+} // namespace endpoint
+} // namespace plugins
+
+PLUGIN_MANIFEST("SoakEndpoint", "endpoint", PLUGIN_ROUTE("GET", "/soak"))
+EXPORT_PLUGIN(plugins::endpoint::SoakEndpoint)
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""Reload a plugin many times under load and check the memory stays bounded.
+
+Starts the server with one build of the soak plugin and then deploys the two
+builds in turn, each renamed in under a new file name while the old one is
+removed. A second connection keeps requesting the route the whole time, so
+replaced versions still have responses in flight. Fails when the peak RSS
+grows past the ceiling, or when replaced libraries or their descriptors are
+not released.
+
+    reload_soak.py <webserver> <soak_a.so> <soak_b.so> [--reloads N] [--rss-ceiling MB]
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "bench"))
+from reload_latency import Client, free_port  # noqa: E402
+
+
+def rss(pid):
+    with open(f"/proc/{pid}/status") as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+
+def mapped(pid):
+    """Soak plugin versions mapped into the server"""
+    with open(f"/proc/{pid}/maps") as f:
+        return len({line.split()[4] for line in f if "libsoak_" in line})
+
+
+def descriptors(pid):
+    return len(os.listdir(f"/proc/{pid}/fd"))
+
+
+def serve(client, version, timeout=10):
+    deadline = time.monotonic() + timeout
+    while True:
+        status, body = client.get("/soak")
+        if status == 200 and body.startswith(version + "\n"):
+            return
+        if time.monotonic() > deadline:
+            raise TimeoutError(f"version {version} was not served within {timeout} s")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("server")
+    parser.add_argument("soak_a")
+    parser.add_argument("soak_b")
+    parser.add_argument("--reloads", type=int, default=1000)
+    parser.add_argument("--rss-ceiling", type=int, default=16, metavar="MB",
+                        help="allowed growth of the peak RSS over the first reloads")
+    args = parser.parse_args()
+
+    work = tempfile.mkdtemp(prefix="reload_soak.")
+    plugins = os.path.join(work, "endpoints")
+    staging = os.path.join(work, "staging")
+    os.makedirs(plugins)
+    os.makedirs(staging)
+    builds = {"a": args.soak_a, "b": args.soak_b}
+
+    def deploy(serial):
+        version = "ab"[serial % 2]
+        shutil.copy(builds[version], os.path.join(staging, "next.so"))
+        os.rename(os.path.join(staging, "next.so"), os.path.join(plugins, f"libsoak_{serial}.so"))
+        return version
+
+    deploy(0)
+    port = free_port()
+    server = subprocess.Popen([os.path.abspath(args.server), "127.0.0.1", str(port), "2",
+                               "--plugins=" + plugins],
+                              cwd=work, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    stop = threading.Event()
+    failures = []
+
+    def load():
+        try:
+            client = Client(port)
+            while not stop.is_set():
+                client.get("/soak")
+        except Exception as e:  # noqa: BLE001
+            failures.append(f"load connection failed: {e}")
+
+    loader = threading.Thread(target=load)
+    try:
+        deadline = time.monotonic() + 10
+        while True:
+            try:
+                client = Client(port)
+                serve(client, "a")
+                break
+            except OSError:
+                if time.monotonic() > deadline or server.poll() is not None:
+                    sys.exit("server did not start")
+                time.sleep(0.05)
+        loader.start()
+
+        # The baseline is taken once allocator pools and the first versions
+        # have settled, growth after that is what the ceiling bounds
+        settle = min(50, args.reloads)
+        base = peak = None
+        base_descriptors = None
+        start = time.monotonic()
+        for serial in range(1, args.reloads + 1):
+            serve(client, deploy(serial))
+            os.unlink(os.path.join(plugins, f"libsoak_{serial - 1}.so"))
+            if serial == settle:
+                base = peak = rss(server.pid)
+                base_descriptors = descriptors(server.pid)
+            elif base is not None:
+                peak = max(peak, rss(server.pid))
+            if serial % 100 == 0:
+                print(f"{serial:5d} reloads  rss {rss(server.pid)} kB  peak {peak} kB  "
+                      f"mapped {mapped(server.pid)}  fds {descriptors(server.pid)}", flush=True)
+            if failures:
+                break
+
+        stop.set()
+        loader.join()
+        # Replaced versions are released after a grace period
+        deadline = time.monotonic() + 5
+        while mapped(server.pid) > 1 and time.monotonic() < deadline:
+            client.get("/soak")
+            time.sleep(0.1)
+
+        ceiling = base + args.rss_ceiling * 1024
+        print(f"{args.reloads} reloads in {time.monotonic() - start:.1f} s: base {base} kB, "
+              f"peak {peak} kB, ceiling {ceiling} kB")
+        if peak > ceiling:
+            failures.append(f"peak RSS {peak} kB is over the ceiling of {ceiling} kB")
+        if mapped(server.pid) != 1:
+            failures.append(f"{mapped(server.pid)} versions of the plugin are still mapped")
+        if descriptors(server.pid) > base_descriptors + 2:
+            failures.append(f"descriptors grew from {base_descriptors} to {descriptors(server.pid)}")
+        if server.poll() is not None:
+            failures.append(f"server exited with {server.returncode}")
+    finally:
+        stop.set()
+        if loader.is_alive():
+            loader.join()
+        server.terminate()
+        server.wait()
+        shutil.rmtree(work, ignore_errors=True)
+
+    for failure in failures:
+        print("FAIL:", failure)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
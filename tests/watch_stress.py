@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""Drop thousands of files into watched directories and report the server's CPU.
+
+Starts the server with one plugin and a static mount, then writes the files,
+each in four chunks, into three places in turn: names that are not plugins
+into the plugin directory, files into the static mount, and .so files that
+are not libraries into the plugin directory. Reports the server's CPU time
+per file once it is idle again. Fails if the server does not settle, stops
+serving the plugin, or does not serve the last static file.
+
+    watch_stress.py <webserver> <plugin.so> [--files N] [--max-cpu-per-file US]
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "bench"))
+from reload_latency import Client, free_port  # noqa: E402
+
+
+def cpu_seconds(pid):
+    """User and system time of the process"""
+    with open(f"/proc/{pid}/stat") as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+def settle(pid, timeout=120):
+    """CPU time once the process has stopped using any"""
+    deadline = time.monotonic() + timeout
+    last = cpu_seconds(pid)
+    while time.monotonic() < deadline:
+        time.sleep(0.3)
+        now = cpu_seconds(pid)
+        if now == last:
+            return now
+        last = now
+    raise TimeoutError(f"server still busy after {timeout} s")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("server")
+    parser.add_argument("plugin")
+    parser.add_argument("--files", type=int, default=10000, help="files per case")
+    parser.add_argument("--max-cpu-per-file", type=float, default=0, metavar="US",
+                        help="fail a case above this server CPU time per file (default: report only)")
+    args = parser.parse_args()
+
+    work = tempfile.mkdtemp(prefix="watch_stress.")
+    plugins = os.path.join(work, "endpoints")
+    static = os.path.join(work, "static")
+    os.makedirs(plugins)
+    os.makedirs(static)
+    shutil.copy(args.plugin, os.path.join(plugins, "libstress_1.so"))
+
+    port = free_port()
+    server = subprocess.Popen([os.path.abspath(args.server), "127.0.0.1", str(port), "1",
+                               "--plugins=" + plugins, "--static=/files:" + static],
+                              cwd=work, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    failures = []
+    try:
+        deadline = time.monotonic() + 10
+        while True:
+            try:
+                client = Client(port)
+                status, _ = client.get("/soak")
+                if status == 200:
+                    break
+            except OSError:
+                pass
+            if time.monotonic() > deadline or server.poll() is not None:
+                sys.exit("server did not start")
+            time.sleep(0.05)
+
+        chunk = os.urandom(2048).hex().encode()
+        cases = [
+            ("non-plugin names, plugin directory", plugins, "note_{}.txt"),
+            ("static mount", static, "file_{}.bin"),
+            ("non-ELF .so files, plugin directory", plugins, "junk{}_1.so"),
+        ]
+        print(f"{'case':38} {'files':>6} {'cpu s':>7} {'us/file':>8} {'write s':>8}")
+        for label, directory, name in cases:
+            base = settle(server.pid)
+            start = time.monotonic()
+            for i in range(args.files):
+                with open(os.path.join(directory, name.format(i)), "wb") as f:
+                    for _ in range(4):
+                        f.write(chunk)
+                        f.flush()
+            written = time.monotonic() - start
+            used = settle(server.pid) - base
+            per_file = used / args.files * 1e6
+            print(f"{label:38} {args.files:6} {used:7.2f} {per_file:8.1f} {written:8.1f}", flush=True)
+            if args.max_cpu_per_file and per_file > args.max_cpu_per_file:
+                failures.append(f"{label}: {per_file:.1f} us per file is over {args.max_cpu_per_file} us")
+
+        # The first connection may have timed out while the files were written
+        client = Client(port)
+        status, _ = client.get("/soak")
+        if status != 200:
+            failures.append(f"plugin answered {status} after the files were dropped")
+        last = f"/files/file_{args.files - 1}.bin"
+        status, body = client.get(last)
+        if status != 200 or len(body) != 4 * len(chunk):
+            failures.append(f"{last} answered {status} with {len(body)} bytes")
+        if server.poll() is not None:
+            failures.append(f"server exited with {server.returncode}")
+    finally:
+        server.terminate()
+        server.wait()
+        shutil.rmtree(work, ignore_errors=True)
+
+    for failure in failures:
+        print("FAIL:", failure)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()